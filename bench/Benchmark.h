@@ -0,0 +1,172 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// マイクロベンチマークの計測と基準値との比較
+//  run() に渡した処理を回数を決めて繰り返し，1回あたりの時間の中央値を記録する．
+//  finish() で結果を CSV か JSON で出力し，基準値のファイルがあれば
+//  しきい値を超えて遅くなったものを報告する
+//  コマンドライン引数
+//   --format csv|json: 出力形式（既定は csv）
+//   --baseline ファイル名: 比較する基準値（以前に --format csv で出力したもの）
+//   --threshold パーセント: 遅くなったとみなす割合（既定は 10）
+//   --filter 文字列: 名前にこの文字列を含むものだけを計る
+//   --min-time 秒: 一つの計測にかける時間（既定は 0.2）
+class Benchmark {
+public:
+	// コンストラクタ
+	//  argc, argv: コマンドライン引数
+	Benchmark(int argc, char *argv[])
+		: json(false), threshold(10.0), minTime(0.2)
+	{
+		for (int i = 1; i < argc; i++) {
+			const std::string arg(argv[i]);
+			const char *const value(i + 1 < argc ? argv[i + 1] : NULL);
+			if (arg == "--format" && value) json = std::strcmp(argv[++i], "json") == 0;
+			else if (arg == "--baseline" && value) loadBaseline(argv[++i]);
+			else if (arg == "--threshold" && value) threshold = std::atof(argv[++i]);
+			else if (arg == "--filter" && value) filter = argv[++i];
+			else if (arg == "--min-time" && value) minTime = std::atof(argv[++i]);
+			else std::fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+		}
+	}
+
+	// 処理の時間を計る
+	//  name: 名前
+	//  body: 処理（引数の回数だけ繰り返すもの）
+	template <typename Body>
+	void run(const char *name, Body body) {
+		if (!filter.empty() && std::strstr(name, filter.c_str()) == NULL) return;
+
+		// 最短の計測時間の 1/10 を超えるまで回数を倍にする
+		size_t iterations(1);
+		for (;;) {
+			const double t(measure(body, iterations));
+			if (t >= minTime * 0.1 || iterations >= size_t(1) << 30) {
+				// 残りの時間で 5回計れる回数にする
+				const double scale(minTime / 5.0 / std::max(t, 1e-9));
+				iterations = std::max<size_t>(1, static_cast<size_t>(iterations * scale));
+				break;
+			}
+			iterations *= 2;
+		}
+
+		// 5回計って中央値をとる
+		double samples[5];
+		for (double &s : samples) s = measure(body, iterations) / iterations;
+		std::sort(samples, samples + 5);
+
+		const Result result = { name, iterations, samples[2] * 1e9 };
+		results.push_back(result);
+	}
+
+	// 結果を出力する
+	//  基準値より遅くなったものがあれば 1 を返す
+	int finish() const {
+		int regressions(0);
+
+		if (json) std::printf("{\n  \"threshold_pct\": %g,\n  \"benchmarks\": [\n", threshold);
+		else std::printf("name,iterations,ns_per_op,baseline_ns,change_pct,status\n");
+
+		for (size_t i = 0; i < results.size(); i++) {
+			const Result &r(results[i]);
+
+			// 基準値と比べる
+			const std::map<std::string, double>::const_iterator b(baseline.find(r.name));
+			const bool compared(b != baseline.end() && b->second > 0.0);
+			const double change(compared ? (r.ns / b->second - 1.0) * 100.0 : 0.0);
+			const char *const status(!compared ? "new" : change > threshold ? "regressed"
+				: change < -threshold ? "improved" : "ok");
+			if (compared && change > threshold) ++regressions;
+
+			if (json) {
+				std::printf("    { \"name\": \"%s\", \"iterations\": %zu, \"ns_per_op\": %.3f",
+					r.name.c_str(), r.iterations, r.ns);
+				if (compared) std::printf(", \"baseline_ns\": %.3f, \"change_pct\": %.2f", b->second, change);
+				std::printf(", \"status\": \"%s\" }%s\n", status, i + 1 < results.size() ? "," : "");
+			}
+			else {
+				std::printf("%s,%zu,%.3f,", r.name.c_str(), r.iterations, r.ns);
+				if (compared) std::printf("%.3f,%.2f,", b->second, change);
+				else std::printf(",,");
+				std::printf("%s\n", status);
+			}
+		}
+
+		if (json) std::printf("  ],\n  \"regressions\": %d\n}\n", regressions);
+		if (regressions > 0) {
+			std::fprintf(stderr, "%d benchmark(s) regressed by more than %g%%\n", regressions, threshold);
+		}
+		return regressions > 0 ? 1 : 0;
+	}
+
+	// 計算結果を使ったことにして最適化で処理が消えないようにする
+	template <typename T>
+	static void keep(const T &value) {
+		asm volatile("" : : "r"(&value) : "memory");
+	}
+
+private:
+	// 計測結果
+	struct Result {
+		// 名前
+		std::string name;
+		// 1回の計測での繰り返し回数
+		size_t iterations;
+		// 1回あたりの時間（ナノ秒）
+		double ns;
+	};
+
+	// JSON で出力するか
+	bool json;
+
+	// 遅くなったとみなす割合（パーセント）
+	double threshold;
+
+	// 一つの計測にかける時間（秒）
+	double minTime;
+
+	// 計る名前に含まれる文字列
+	std::string filter;
+
+	// 基準値（名前と 1回あたりのナノ秒）
+	std::map<std::string, double> baseline;
+
+	// 計測結果
+	std::vector<Result> results;
+
+	// body を iterations 回実行した時間（秒）を求める
+	template <typename Body>
+	static double measure(Body &body, size_t iterations) {
+		const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+		body(iterations);
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// CSV 形式の基準値を読み込む
+	void loadBaseline(const char *name) {
+		FILE *const fp(std::fopen(name, "r"));
+		if (fp == NULL) {
+			std::fprintf(stderr, "Can't open baseline: %s\n", name);
+			return;
+		}
+
+		// 先頭の行は見出しなので読み飛ばす
+		char line[512];
+		if (std::fgets(line, sizeof line, fp) != NULL) {
+			while (std::fgets(line, sizeof line, fp) != NULL) {
+				char key[256];
+				size_t iterations;
+				double ns;
+				if (std::sscanf(line, "%255[^,],%zu,%lf", key, &iterations, &ns) == 3) baseline[key] = ns;
+			}
+		}
+		std::fclose(fp);
+	}
+};
@@ -0,0 +1,71 @@
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include "JobSystem.h"
+
+using namespace std;
+
+// 経過時間（秒）を求める
+static double seconds(chrono::steady_clock::time_point start) {
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// 変換の更新を模した処理（3x4 行列の合成を繰り返す）
+static void update(float *m, size_t begin, size_t end) {
+	for (size_t n = begin; n < end; n++) {
+		float *const a(m + n * 12);
+		for (int r = 0; r < 64; r++) {
+			float t[12];
+			for (int j = 0; j < 4; j++) {
+				for (int i = 0; i < 3; i++) {
+					t[j * 3 + i] = a[i] * a[j * 3] + a[3 + i] * a[j * 3 + 1] + a[6 + i] * a[j * 3 + 2]
+						+ (j == 3 ? a[9 + i] : 0.0f);
+				}
+			}
+			for (int i = 0; i < 12; i++) a[i] = t[i] * 0.5f;
+		}
+	}
+}
+
+// 1フレーム分の処理時間（秒）を求める
+static double frame(JobSystem &jobs, vector<float> &m, size_t count) {
+	const chrono::steady_clock::time_point start(chrono::steady_clock::now());
+	for (int i = 0; i < 10; i++) {
+		jobs.parallel_for(count, 256, [&m](size_t begin, size_t end) { update(&m[0], begin, end); });
+	}
+	return seconds(start) / 10.0;
+}
+
+// ジョブ一つあたりのオーバーヘッド（秒）を求める
+//  parallel_for は分割が多すぎると粒度を大きくするので，実際に実行したジョブの数で割る
+static double overhead(JobSystem &jobs, size_t count) {
+	atomic<size_t> issued(0);
+	const chrono::steady_clock::time_point start(chrono::steady_clock::now());
+	for (int i = 0; i < 10; i++) {
+		jobs.parallel_for(count, 1, [&issued](size_t, size_t) { issued.fetch_add(1, memory_order_relaxed); });
+	}
+	return seconds(start) / static_cast<double>(issued.load());
+}
+
+// ワーカーの数を変えながら 1フレーム分の処理時間とジョブのオーバーヘッドを計る
+//  argv[1]: ワーカーの数の上限（省略時はハードウェアのスレッド数）
+int main(int argc, char *argv[]) {
+	const unsigned int hw(thread::hardware_concurrency());
+	const unsigned int maxThreads(argc > 1 ? atoi(argv[1]) : (hw > 0 ? hw : 1));
+	const size_t count(1 << 16);
+	vector<float> m(count * 12, 0.1f);
+
+	printf("threads,frame_ms,speedup,job_overhead_us\n");
+	double base(0.0);
+	for (unsigned int n = 1; n <= maxThreads; n = n < 4 ? n + 1 : n * 2) {
+		// 呼び出し元のスレッドも処理するのでワーカーは一つ少なくてよい
+		JobSystem jobs(static_cast<int>(n) - 1);
+		frame(jobs, m, count);
+		const double t(frame(jobs, m, count));
+		if (n == 1) base = t;
+		printf("%u,%.3f,%.2f,%.3f\n", n, t * 1e3, base / t, overhead(jobs, 4000) * 1e6);
+	}
+	return 0;
+}
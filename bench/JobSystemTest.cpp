@@ -0,0 +1,100 @@
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include "JobSystem.h"
+
+using namespace std;
+
+// 失敗した検査の数
+static int failures(0);
+
+// 条件を検査して結果を表示する
+static void check(bool condition, const char *name) {
+	printf("%s: %s\n", condition ? "ok" : "FAILED", name);
+	if (!condition) ++failures;
+}
+
+// 実行した順番を記録するジョブ
+struct Step {
+	atomic<int> *clock;
+	int order;
+};
+static void step(void *data, size_t, size_t) {
+	Step *const s(static_cast<Step *>(data));
+	s->order = s->clock->fetch_add(1);
+}
+
+// A の後に B を実行するジョブを登録して待つ
+//  B を先に取り出しても A が終わるまで実行しないことを確かめる
+static bool chain(JobSystem &jobs) {
+	atomic<int> clock(0);
+	Step a = { &clock, -1 }, b = { &clock, -1 };
+	JobSystem::Counter ca(0), cb(0);
+	jobs.run(&step, &a, 0, 1, ca);
+	jobs.run(&step, &b, 0, 1, cb, &ca);
+	jobs.wait(cb);
+	return a.order == 0 && b.order == 1 && ca.load() == 0;
+}
+
+// 多数のジョブが一つのカウンタを待つ
+static bool fanIn(JobSystem &jobs) {
+	const size_t count(1000);
+	atomic<int> clock(0);
+	vector<Step> first(count, Step{ &clock, -1 });
+	Step last = { &clock, -1 };
+	JobSystem::Counter c0(0), c1(0);
+	for (size_t i = 0; i < count; i++) jobs.run(&step, &first[i], 0, 1, c0);
+	jobs.run(&step, &last, 0, 1, c1, &c0);
+	jobs.wait(c1);
+	return last.order == static_cast<int>(count);
+}
+
+// 別のジョブシステムのワーカーから登録する
+//  スレッドのキューの番号がジョブシステムごとに分かれていることを確かめる．
+//  内側にはワーカー以外から同時に登録できないので一つずつ登録する
+static bool nested(JobSystem &outer, JobSystem &inner) {
+	atomic<int> sum(0);
+	mutex m;
+	outer.parallel_for(64, 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			lock_guard<mutex> lock(m);
+			inner.parallel_for(4, 1, [&](size_t b, size_t e) { sum += static_cast<int>(e - b); });
+		}
+	});
+	return sum.load() == 64 * 4;
+}
+
+// ジョブシステムの依存関係とワーカーのない場合の動作を確かめる
+//  失敗すれば 1 を返す．止まってしまったら 10秒で打ち切る
+int main() {
+	thread([]() {
+		this_thread::sleep_for(chrono::seconds(10));
+		printf("FAILED: timed out\n");
+		fflush(stdout);
+		_Exit(1);
+	}).detach();
+
+	for (int workers = 0; workers <= 3; workers++) {
+		JobSystem jobs(workers);
+		char name[64];
+		snprintf(name, sizeof name, "chain with %d workers", workers);
+		for (int i = 0; i < 100; i++) {
+			if (!chain(jobs)) {
+				check(false, name);
+				break;
+			}
+			if (i == 99) check(true, name);
+		}
+		snprintf(name, sizeof name, "fan-in with %d workers", workers);
+		check(fanIn(jobs), name);
+	}
+
+	JobSystem outer(2), inner(0);
+	check(nested(outer, inner), "nested job systems");
+
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,545 @@
+#include <cstdio>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include "Benchmark.h"
+#include "Matrix.h"
+#include "Affine.h"
+#include "DualQuaternion.h"
+#include "SolidShape.h"
+#include "Window.h"
+#include "Program.h"
+#include "Bvh.h"
+#include "DebugLines.h"
+#include "IndirectRenderer.h"
+#include "MultiView.h"
+#include "Mesh.h"
+#include "SolidShapeIndex.h"
+#include "StripShapeIndex.h"
+#include "JobSystem.h"
+
+using namespace std;
+
+// 面ごとに法線を変えた六面体の頂点属性を作る
+static vector<Object::Vertex> solidCube() {
+	// 各面の法線の軸と向き
+	static const int axis[] = { 0, 2, 1, 0, 1, 2 };
+	static const GLfloat sign[] = { -1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+
+	// 面内の 2つの三角形の頂点
+	static const GLfloat corner[][2] = {
+		{ -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f },
+		{ -1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f }
+	};
+
+	vector<Object::Vertex> vertex;
+	for (int f = 0; f < 6; f++) {
+		for (int c = 0; c < 6; c++) {
+			Object::Vertex v = {};
+			const int a(axis[f]);
+			v.position[a] = sign[f];
+			v.position[(a + 1) % 3] = corner[c][0] * sign[f];
+			v.position[(a + 2) % 3] = corner[c][1];
+			v.normal[a] = sign[f];
+			v.texcoord[0] = (corner[c][0] + 1.0f) * 0.5f;
+			v.texcoord[1] = (corner[c][1] + 1.0f) * 0.5f;
+			vertex.push_back(v);
+		}
+	}
+	return vertex;
+}
+
+// Matrix と Affine, Quaternion, DualQuaternion の演算
+//  同じ変換を Matrix で行う場合と比べる
+static void matrixBench(Benchmark &bench) {
+	const Matrix a(Matrix::rotate(0.5f, 1.0f, 2.0f, 3.0f) * Matrix::translate(1.0f, 2.0f, 3.0f));
+	const Matrix b(Matrix::lookat(3.0f, 4.0f, 5.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
+
+	bench.run("matrix/multiply", [&](size_t n) {
+		Matrix m(a);
+		for (size_t i = 0; i < n; i++) {
+			m = m * b;
+			Benchmark::keep(m);
+		}
+	});
+
+	bench.run("matrix/rotate", [](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			const Matrix m(Matrix::rotate(static_cast<GLfloat>(i) * 0.001f, 0.0f, 1.0f, 0.0f));
+			Benchmark::keep(m);
+		}
+	});
+
+	bench.run("matrix/lookat", [](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			const Matrix m(Matrix::lookat(3.0f, 4.0f, static_cast<GLfloat>(i & 7) + 5.0f,
+				0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
+			Benchmark::keep(m);
+		}
+	});
+
+	bench.run("matrix/perspective", [](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			const Matrix m(Matrix::perspective(1.0f, static_cast<GLfloat>(i & 7) + 1.0f, 1.0f, 10.0f));
+			Benchmark::keep(m);
+		}
+	});
+
+	bench.run("matrix/getNormalMatrix", [&](size_t n) {
+		GLfloat normal[9];
+		for (size_t i = 0; i < n; i++) {
+			a.getNormalMatrix(normal);
+			Benchmark::keep(normal);
+		}
+	});
+
+	bench.run("matrix/inverse", [&](size_t n) {
+		Matrix m(a);
+		for (size_t i = 0; i < n; i++) {
+			m = m.inverse();
+			Benchmark::keep(m);
+		}
+	});
+
+	// 同じ変換を Affine で合成する
+	const Affine c(a), d(b);
+	bench.run("affine/multiply", [&](size_t n) {
+		Affine m(c);
+		for (size_t i = 0; i < n; i++) {
+			m = m * d;
+			Benchmark::keep(m);
+		}
+	});
+
+	bench.run("affine/inverse", [&](size_t n) {
+		Affine m(c);
+		for (size_t i = 0; i < n; i++) {
+			m = m.inverse();
+			Benchmark::keep(m);
+		}
+	});
+
+	bench.run("affine/inverseRigid", [&](size_t n) {
+		Affine m(c);
+		for (size_t i = 0; i < n; i++) {
+			m = m.inverseRigid();
+			Benchmark::keep(m);
+		}
+	});
+
+	// 回転を四元数で作って合成する
+	bench.run("quaternion/rotate", [](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			const Affine m(Quaternion::rotate(static_cast<GLfloat>(i) * 0.001f, 0.0f, 1.0f, 0.0f));
+			Benchmark::keep(m);
+		}
+	});
+
+	const Quaternion p(Quaternion::rotate(0.5f, 1.0f, 2.0f, 3.0f)), q(Quaternion::rotate(1.5f, 3.0f, 2.0f, 1.0f));
+	bench.run("quaternion/multiply", [&](size_t n) {
+		Quaternion r(p);
+		for (size_t i = 0; i < n; i++) {
+			r = (r * q).normalize();
+			Benchmark::keep(r);
+		}
+	});
+
+	bench.run("quaternion/nlerp", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			const Quaternion r(Quaternion::nlerp(p, q, static_cast<GLfloat>(i & 1023) / 1023.0f));
+			Benchmark::keep(r);
+		}
+	});
+
+	bench.run("quaternion/slerp", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			const Quaternion r(Quaternion::slerp(p, q, static_cast<GLfloat>(i & 1023) / 1023.0f));
+			Benchmark::keep(r);
+		}
+	});
+
+	// 剛体変換を双対四元数で合成，補間する
+	const DualQuaternion e(DualQuaternion::rigid(p, 1.0f, 2.0f, 3.0f));
+	const DualQuaternion f(DualQuaternion::rigid(q, -3.0f, 0.0f, 5.0f));
+	bench.run("dualquaternion/multiply", [&](size_t n) {
+		DualQuaternion r(e);
+		for (size_t i = 0; i < n; i++) {
+			r = r * f;
+			Benchmark::keep(r);
+		}
+	});
+
+	bench.run("dualquaternion/inverse", [&](size_t n) {
+		DualQuaternion r(e);
+		for (size_t i = 0; i < n; i++) {
+			r = r.inverse();
+			Benchmark::keep(r);
+		}
+	});
+
+	bench.run("dualquaternion/nlerp", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			const DualQuaternion r(DualQuaternion::nlerp(e, f, static_cast<GLfloat>(i & 1023) / 1023.0f));
+			Benchmark::keep(r);
+		}
+	});
+
+	bench.run("dualquaternion/toAffine", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			const Affine m(e.toAffine());
+			Benchmark::keep(m);
+		}
+	});
+}
+
+// 起伏のある n x n の格子の頂点とインデックスを作る（三角形は 2n^2 個）
+static void grid(int n, vector<Object::Vertex> &vertex, vector<GLuint> &index) {
+	vertex.resize((n + 1) * (n + 1));
+	for (int j = 0; j <= n; j++) {
+		for (int i = 0; i <= n; i++) {
+			Object::Vertex &v(vertex[j * (n + 1) + i]);
+			v = Object::Vertex();
+			v.position[0] = static_cast<GLfloat>(i) / n * 2.0f - 1.0f;
+			v.position[2] = static_cast<GLfloat>(j) / n * 2.0f - 1.0f;
+			v.position[1] = 0.1f * sin(v.position[0] * 20.0f) * cos(v.position[2] * 15.0f);
+		}
+	}
+	index.clear();
+	for (int j = 0; j < n; j++) {
+		for (int i = 0; i < n; i++) {
+			const GLuint a(j * (n + 1) + i), b(a + 1), c(a + n + 2), d(a + n + 1);
+			const GLuint quad[] = { a, d, c, a, c, b };
+			index.insert(index.end(), quad, quad + 6);
+		}
+	}
+}
+
+// BVH の構築と光線の交差判定（200万三角形）
+static void bvhBench(Benchmark &bench) {
+	vector<Object::Vertex> vertex;
+	vector<GLuint> index;
+	grid(1000, vertex, index);
+	JobSystem jobs;
+
+	bench.run("bvh/build", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			const Bvh bvh(static_cast<GLsizei>(vertex.size()), vertex.data(),
+				static_cast<GLsizei>(index.size()), index.data(), &jobs);
+			Benchmark::keep(bvh);
+		}
+	});
+
+	const Bvh bvh(static_cast<GLsizei>(vertex.size()), vertex.data(),
+		static_cast<GLsizei>(index.size()), index.data(), &jobs);
+	bench.run("bvh/pick", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			// 上から斜めに格子を見下ろす光線
+			const GLfloat s(static_cast<GLfloat>(i % 1021) / 1021.0f * 1.6f - 0.8f);
+			const GLfloat origin[] = { s, 1.0f, -1.5f }, direction[] = { 0.1f, -1.0f, 1.7f + s };
+			Bvh::Hit hit = { 1e30f, 0, 0.0f, 0.0f };
+			bvh.intersect(origin, direction, hit);
+			Benchmark::keep(hit);
+		}
+	});
+}
+
+// 球の頂点とストリップのインデックスの生成（1024 x 512 分割）
+static void meshBench(Benchmark &bench) {
+	JobSystem jobs;
+	bench.run("mesh/sphere/serial", [](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			const Mesh mesh(Mesh::sphere(1024, 512));
+			Benchmark::keep(mesh);
+		}
+	});
+	bench.run("mesh/sphere/parallel", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			const Mesh mesh(Mesh::sphere(1024, 512, &jobs));
+			Benchmark::keep(mesh);
+		}
+	});
+}
+
+// 図形の作成と描画の発行（GPU の完了まで含める）
+static void shapeBench(Benchmark &bench) {
+	const vector<Object::Vertex> cube(solidCube());
+
+	bench.run("shape/construct", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			const SolidShape shape(3, static_cast<GLsizei>(cube.size()), cube.data());
+		}
+		glFinish();
+	});
+
+	const SolidShape shape(3, static_cast<GLsizei>(cube.size()), cube.data());
+	bench.run("shape/draw", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) shape.draw();
+		glFinish();
+	});
+}
+
+// デバッグ用の線分の追加と描画（1フレーム 100万本）
+static void linesBench(Benchmark &bench) {
+	const GLsizei count(1 << 20);
+	DebugLines lines(count);
+	const GLfloat lo[] = { -1.0f, -1.0f, -1.0f }, hi[] = { 1.0f, 1.0f, 1.0f };
+
+	// 100万本の線分を追加する
+	const auto record([&]() {
+		for (GLsizei i = 0; i < count; i += 16) {
+			const GLfloat x(static_cast<GLfloat>(i) * 1e-6f);
+			const GLfloat a[] = { x, 0.0f, 0.0f }, b[] = { x, 1.0f, 0.0f };
+			lines.box(lo, hi, Affine::translate(x, 0.0f, 0.0f));
+			lines.line(a, b);
+			lines.setDepthTest(false);
+			lines.line(b, a);
+			lines.setDepthTest(true);
+			lines.line(a, b);
+			lines.line(b, a);
+		}
+	});
+
+	bench.run("lines/record", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			record();
+			lines.clear();
+		}
+	});
+
+	const GLuint program(loadProgram("cloud.vert", "cloud.frag"));
+	glUseProgram(program);
+	glUniformMatrix4x3fv(glGetUniformLocation(program, "modelview"), 1, GL_FALSE, Affine::identity().data());
+	glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, Matrix::identity().data());
+	bench.run("lines/draw", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			record();
+			lines.draw();
+		}
+		glFinish();
+	});
+	glDeleteProgram(program);
+}
+
+// n x n x n 個の立方体を一辺 12 の範囲に並べる変換を作る
+static vector<Affine> placement(int n) {
+	vector<Affine> transform;
+	const GLfloat spacing(12.0f / n), s(spacing * 0.3f);
+	for (int z = 0; z < n; z++) {
+		for (int y = 0; y < n; y++) {
+			for (int x = 0; x < n; x++) {
+				transform.push_back(Affine::translate((x + 0.5f) * spacing - 6.0f, (y + 0.5f) * spacing - 6.0f,
+					(z + 0.5f) * spacing - 6.0f) * Affine::scale(s, s, s));
+			}
+		}
+	}
+	return transform;
+}
+
+// 図形ごとの描画と GPU でカリングした間接描画（GPU の完了まで含める）
+//  格子状に並べた立方体の一部が視錐台に入るようにする
+static void indirectBench(Benchmark &bench) {
+	const vector<Object::Vertex> cube(solidCube());
+	const Matrix projection(Matrix::perspective(0.5f, 1.0f, 1.0f, 10.0f));
+	const Affine view(Matrix::lookat(3.0f, 4.0f, 5.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
+
+	// 図形ごとに変換行列を設定して描く
+	const GLuint program(loadProgram("point.vert", "point.frag"));
+	glUseProgram(program);
+	glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, projection.data());
+	const GLint modelviewLoc(glGetUniformLocation(program, "modelview"));
+	const GLint normalMatrixLoc(glGetUniformLocation(program, "normalMatrix"));
+	const SolidShape shape(3, static_cast<GLsizei>(cube.size()), cube.data());
+	const vector<Affine> small(placement(10));
+	bench.run("indirect/shapes/1k", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			for (const Affine &p : small) {
+				const Affine modelview(view * p);
+				GLfloat normalMatrix[9];
+				modelview.getNormalMatrix(normalMatrix);
+				glUniformMatrix4x3fv(modelviewLoc, 1, GL_FALSE, modelview.data());
+				glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, normalMatrix);
+				shape.draw();
+			}
+		}
+		glFinish();
+	});
+	glDeleteProgram(program);
+
+	if (!IndirectRenderer::isSupported()) {
+		fprintf(stderr, "No OpenGL 4.3, skipping indirect rendering benchmarks\n");
+		return;
+	}
+
+	// 物体の数を変えて cull() と draw() を計る
+	const GLuint indirectProgram(loadProgram("indirect.vert", "point.frag"));
+	glUseProgram(indirectProgram);
+	glUniformMatrix4fv(glGetUniformLocation(indirectProgram, "projection"), 1, GL_FALSE, projection.data());
+	const struct { const char *name; int side; } size[] = {
+		{ "indirect/multidraw/1k", 10 }, { "indirect/multidraw/1M", 100 }
+	};
+	for (const auto &s : size) {
+		const vector<Affine> transform(placement(s.side));
+		IndirectRenderer renderer(static_cast<GLsizei>(transform.size()));
+		const int mesh(renderer.addMesh(static_cast<GLsizei>(cube.size()), cube.data()));
+		for (const Affine &p : transform) renderer.add(mesh, p);
+		bench.run(s.name, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				renderer.cull(projection, view);
+				glUseProgram(indirectProgram);
+				renderer.draw();
+			}
+			glFinish();
+		});
+	}
+	glDeleteProgram(indirectProgram);
+}
+
+// 4 つのビューの描画（GPU の完了まで含める）
+//  ビューごとに図形を全部描き直すのと，インスタンス描画で一度に描くのを比べる
+static void multiviewBench(Benchmark &bench) {
+	const vector<Object::Vertex> cube(solidCube());
+	const Matrix projection(Matrix::perspective(0.5f, 1.0f, 1.0f, 10.0f));
+	const Affine view(Matrix::lookat(3.0f, 4.0f, 5.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
+	const SolidShape shape(3, static_cast<GLsizei>(cube.size()), cube.data());
+	const vector<Affine> transform(placement(10));
+	const int views(4);
+
+	// ビューごとに y 軸中心に回した変換
+	Affine orbit[views];
+	for (int v = 0; v < views; v++) {
+		orbit[v] = view * Affine(Quaternion::rotate(6.2831853f * v / views, 0.0f, 1.0f, 0.0f)) * view.inverse();
+	}
+
+	// 図形の変換行列を設定して描く
+	const auto submit([&](GLint modelviewLoc, GLint normalMatrixLoc, GLsizei instances) {
+		for (const Affine &p : transform) {
+			const Affine modelview(view * p);
+			GLfloat normalMatrix[9];
+			modelview.getNormalMatrix(normalMatrix);
+			glUniformMatrix4x3fv(modelviewLoc, 1, GL_FALSE, modelview.data());
+			glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, normalMatrix);
+			shape.draw(instances);
+		}
+	});
+
+	// ビューごとにビューポートを変えて描き直す
+	const GLuint program(loadProgram("point.vert", "point.frag"));
+	glUseProgram(program);
+	glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, projection.data());
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	const GLsizei w(viewport[2] / 2), h(viewport[3] / 2);
+	bench.run("multiview/passes/4", [&](size_t n) {
+		const GLint viewLoc(glGetUniformLocation(program, "view"));
+		const GLint modelviewLoc(glGetUniformLocation(program, "modelview"));
+		const GLint normalMatrixLoc(glGetUniformLocation(program, "normalMatrix"));
+		for (size_t i = 0; i < n; i++) {
+			for (int v = 0; v < views; v++) {
+				glViewport(v % 2 * w, (1 - v / 2) * h, w, h);
+				glUniformMatrix4x3fv(viewLoc, 1, GL_FALSE, orbit[v].data());
+				submit(modelviewLoc, normalMatrixLoc, 1);
+			}
+		}
+		glFinish();
+	});
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glDeleteProgram(program);
+
+	// 一度の描画で全部のビューに描く
+	const GLuint multiviewProgram(loadProgram("point.vert", "point.frag", "multiview.geom"));
+	glUseProgram(multiviewProgram);
+	MultiView multiview(views);
+	for (int v = 0; v < views; v++) multiview.setView(v, orbit[v], projection);
+	bench.run("multiview/instanced/4", [&](size_t n) {
+		const GLint modelviewLoc(glGetUniformLocation(multiviewProgram, "modelview"));
+		const GLint normalMatrixLoc(glGetUniformLocation(multiviewProgram, "normalMatrix"));
+		for (size_t i = 0; i < n; i++) {
+			multiview.begin(glGetUniformLocation(multiviewProgram, "view"),
+				glGetUniformLocation(multiviewProgram, "projection"), glGetUniformLocation(multiviewProgram, "layered"));
+			submit(modelviewLoc, normalMatrixLoc, views);
+			multiview.end();
+		}
+		glFinish();
+	});
+	glDeleteProgram(multiviewProgram);
+}
+
+// 同じ球を三角形とストリップで描く（GPU の完了まで含める）
+static void stripBench(Benchmark &bench) {
+	const Mesh mesh(Mesh::sphere(256, 128));
+	const vector<GLuint> triangles(mesh.getTriangles());
+	const SolidShapeIndex list(3, mesh.getVertexCount(), mesh.getVertex(),
+		static_cast<GLsizei>(triangles.size()), triangles.data());
+	const StripShapeIndex strip(3, mesh.getVertexCount(), mesh.getVertex(), mesh.getIndexCount(), mesh.getIndex());
+
+	const GLuint program(loadProgram("point.vert", "point.frag"));
+	glUseProgram(program);
+	glUniformMatrix4x3fv(glGetUniformLocation(program, "modelview"), 1, GL_FALSE,
+		Affine::scale(0.5f, 0.5f, 0.5f).data());
+	glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, Matrix::identity().data());
+	bench.run("mesh/draw/triangles", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) list.draw();
+		glFinish();
+	});
+	bench.run("mesh/draw/strips", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) strip.draw();
+		glFinish();
+	});
+	glDeleteProgram(program);
+}
+
+// シェーダの読み込みとプログラムオブジェクトの作成
+static void programBench(Benchmark &bench) {
+	bench.run("program/readShaderSource", [](size_t n) {
+		vector<GLchar> source;
+		for (size_t i = 0; i < n; i++) {
+			readShaderSource("point.vert", source);
+			Benchmark::keep(source);
+		}
+	});
+
+	bench.run("program/loadProgram", [](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			const GLuint program(loadProgram("point.vert", "point.frag"));
+			glDeleteProgram(program);
+		}
+		glFinish();
+	});
+}
+
+// sample の処理のマイクロベンチマーク
+//  シェーダのソースファイルを読むので sample ディレクトリで実行する
+//  引数は Benchmark.h を参照
+int main(int argc, char *argv[]) {
+	Benchmark bench(argc, argv);
+
+	// OpenGL を使わないものを計る
+	matrixBench(bench);
+	bvhBench(bench);
+	meshBench(bench);
+
+	// 見えないウィンドウを開いて OpenGL を使うものを計る
+	if (glfwInit() == GL_FALSE) {
+		fprintf(stderr, "Can't initialize GLFW, skipping OpenGL benchmarks\n");
+	}
+	else {
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		{
+			Window window(64, 64, "bench");
+			fprintf(stderr, "GL_RENDERER: %s\n", glGetString(GL_RENDERER));
+			shapeBench(bench);
+			programBench(bench);
+			linesBench(bench);
+			indirectBench(bench);
+			multiviewBench(bench);
+			stripBench(bench);
+		}
+		glfwTerminate();
+	}
+
+	return bench.finish();
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include <algorithm>
+#include <GL/glew.h>
+#include "Matrix.h"
+#include "Quaternion.h"
+
+// アフィン変換行列（4x4 の最下行 (0, 0, 0, 1) を省略した 3x4 行列）
+//  要素は列優先で 3要素ずつ 4列並べる．
+//  GLSL の mat4x3 と同じ並びなので glUniformMatrix4x3fv でそのまま送れる
+class Affine {
+public:
+	// コンストラクタ
+	Affine() {}
+
+	// 配列の内容で初期化するコンストラクタ
+	//  a: GLfloat型の12要素の配列
+	Affine(const GLfloat *a) {
+		std::copy(a, a + 12, matrix);
+	}
+
+	// 変換行列の上 3行から初期化するコンストラクタ
+	//  m: 最下行が (0, 0, 0, 1) の変換行列
+	explicit Affine(const Matrix &m) {
+		const GLfloat *const a(m.data());
+		for (int j = 0; j < 4; j++) {
+			std::copy(a + j * 4, a + j * 4 + 3, matrix + j * 3);
+		}
+	}
+
+	// 四元数の回転から初期化するコンストラクタ
+	explicit Affine(const Quaternion &q) {
+		q.getMatrix(matrix);
+		std::fill(matrix + 9, matrix + 12, 0.0f);
+	}
+
+	// 乗算（乗算 36回）
+	Affine operator*(const Affine &m) const {
+		Affine t;
+		for (int j = 0; j < 3; j++) {
+			for (int i = 0; i < 3; i++) {
+				t.matrix[j * 3 + i] = matrix[i] * m.matrix[j * 3]
+					+ matrix[3 + i] * m.matrix[j * 3 + 1]
+					+ matrix[6 + i] * m.matrix[j * 3 + 2];
+			}
+		}
+		for (int i = 0; i < 3; i++) {
+			t.matrix[9 + i] = matrix[i] * m.matrix[9]
+				+ matrix[3 + i] * m.matrix[10]
+				+ matrix[6 + i] * m.matrix[11]
+				+ matrix[9 + i];
+		}
+		return t;
+	}
+
+	// 変換行列の配列を返す
+	const GLfloat *data() const {
+		return matrix;
+	}
+
+	// 4x4 の変換行列に戻す
+	Matrix toMatrix() const {
+		GLfloat a[16];
+		for (int j = 0; j < 4; j++) {
+			std::copy(matrix + j * 3, matrix + j * 3 + 3, a + j * 4);
+			a[j * 4 + 3] = 0.0f;
+		}
+		a[15] = 1.0f;
+		return Matrix(a);
+	}
+
+	// 単位行列を設定する
+	void loadIdentity() {
+		std::fill(matrix, matrix + 12, 0.0f);
+		matrix[0] = matrix[4] = matrix[8] = 1.0f;
+	}
+
+	// 単位行列を作成する
+	static Affine identity() {
+		Affine t;
+		t.loadIdentity();
+		return t;
+	}
+
+	// (x, y, z)だけ平行移動する変換行列を作成する
+	static Affine translate(GLfloat x, GLfloat y, GLfloat z) {
+		Affine t;
+
+		t.loadIdentity();
+		t.matrix[9] = x;
+		t.matrix[10] = y;
+		t.matrix[11] = z;
+		return t;
+	}
+
+	// (x, y, z)倍に拡大縮小する変換行列を作成する
+	static Affine scale(GLfloat x, GLfloat y, GLfloat z) {
+		Affine t;
+
+		t.loadIdentity();
+		t.matrix[0] = x;
+		t.matrix[4] = y;
+		t.matrix[8] = z;
+		return t;
+	}
+
+	// 回転と平行移動だけからなる変換の逆変換を求める
+	//  回転部分を転置し，平行移動を逆向きに回転する
+	Affine inverseRigid() const {
+		Affine t;
+		for (int j = 0; j < 3; j++) {
+			for (int i = 0; i < 3; i++) {
+				t.matrix[j * 3 + i] = matrix[i * 3 + j];
+			}
+		}
+		for (int i = 0; i < 3; i++) {
+			t.matrix[9 + i] = -(matrix[i * 3] * matrix[9]
+				+ matrix[i * 3 + 1] * matrix[10]
+				+ matrix[i * 3 + 2] * matrix[11]);
+		}
+		return t;
+	}
+
+	// 一般のアフィン変換の逆変換を求める
+	//  正則でなければ単位行列を返す
+	Affine inverse() const {
+		Affine t;
+		const GLfloat *const a(matrix);
+
+		// 3x3 部分の余因子行列（の転置）
+		t.matrix[0] = a[4] * a[8] - a[5] * a[7];
+		t.matrix[1] = a[2] * a[7] - a[1] * a[8];
+		t.matrix[2] = a[1] * a[5] - a[2] * a[4];
+		t.matrix[3] = a[5] * a[6] - a[3] * a[8];
+		t.matrix[4] = a[0] * a[8] - a[2] * a[6];
+		t.matrix[5] = a[2] * a[3] - a[0] * a[5];
+		t.matrix[6] = a[3] * a[7] - a[4] * a[6];
+		t.matrix[7] = a[1] * a[6] - a[0] * a[7];
+		t.matrix[8] = a[0] * a[4] - a[1] * a[3];
+
+		const GLfloat det(a[0] * t.matrix[0] + a[3] * t.matrix[1] + a[6] * t.matrix[2]);
+		if (det == 0.0f) return identity();
+
+		const GLfloat r(1.0f / det);
+		for (int i = 0; i < 9; i++) t.matrix[i] *= r;
+		for (int i = 0; i < 3; i++) {
+			t.matrix[9 + i] = -(t.matrix[i] * a[9]
+				+ t.matrix[3 + i] * a[10]
+				+ t.matrix[6 + i] * a[11]);
+		}
+		return t;
+	}
+
+	// 法線ベクトルの変換行列を求める
+	//  回転・平行移動・一様な拡大縮小だけからなる変換に限り，
+	//  3x3 部分がそのまま使える（大きさはシェーダで正規化する）
+	void getNormalMatrix(GLfloat *m) const {
+		std::copy(matrix, matrix + 9, m);
+	}
+
+private:
+	// 変換行列の要素
+	GLfloat matrix[12];
+};
@@ -0,0 +1,504 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define BVH_USE_SSE2 1
+#endif
+#include <GL/glew.h>
+#include "Object.h"
+#include "JobSystem.h"
+
+// 三角形の境界ボリューム階層 (BVH)
+//  ビンに分けた SAH (surface area heuristic) で分割し，葉の三角形は 4つずつまとめて
+//  SSE2 で同時に交差判定する．深くなりすぎた部分木は中央値で分割して探索のスタックに収める．
+//  ジョブシステムを渡すと大きなノードの集計と上の方で分かれた部分木の構築を並列に行う
+class Bvh {
+public:
+	// 交差の結果
+	struct Hit {
+		// 光線のパラメータ
+		GLfloat t;
+		// 三角形の番号
+		GLuint triangle;
+		// 三角形上の重心座標
+		GLfloat u, v;
+	};
+
+	// コンストラクタ
+	//  vertexcount: 頂点の数
+	//  vertex: 頂点属性を格納した配列
+	//  indexcount: 頂点のインデックスの要素数（0 なら頂点を 3つずつ三角形にする）
+	//  index: 頂点のインデックスを格納した配列
+	//  jobs: 並列に構築するときのジョブシステム
+	Bvh(GLsizei vertexcount, const Object::Vertex *vertex,
+		GLsizei indexcount = 0, const GLuint *index = NULL, JobSystem *jobs = NULL)
+		: vertex(vertex), index(index), jobs(jobs)
+	{
+		const size_t count((index != NULL ? indexcount : vertexcount) / 3);
+		if (count == 0) return;
+
+		// 三角形ごとの境界ボックス
+		box.resize(count);
+		order.resize(count);
+		forEach(count, [this](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				Box &b(box[i]);
+				for (int k = 0; k < 3; k++) {
+					const GLfloat *const p(position(static_cast<GLuint>(i), k));
+					for (int j = 0; j < 3; j++) {
+						b.lo[j] = k == 0 ? p[j] : std::min(b.lo[j], p[j]);
+						b.hi[j] = k == 0 ? p[j] : std::max(b.hi[j], p[j]);
+					}
+				}
+				order[i] = static_cast<GLuint>(i);
+			}
+		});
+
+		// 上の方は一つずつ分割し，小さくなった部分木は並列に作る
+		const size_t grain(jobs != NULL && jobs->getWorkerCount() > 0
+			? std::max<size_t>(count / (8 * (jobs->getWorkerCount() + 1)), 4096) : count + 1);
+		std::vector<Task> tasks;
+		nodes.resize(1);
+		split(nodes, packets, 0, 0, count, 0, grain, &tasks);
+
+		std::vector<Subtree> subtrees(tasks.size());
+		forEach(tasks.size(), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				Subtree &s(subtrees[i]);
+				s.nodes.resize(1);
+				split(s.nodes, s.packets, 0, tasks[i].begin, tasks[i].end, tasks[i].depth, 0, NULL);
+			}
+		}, 1);
+
+		// 部分木をつなぐ（ノードの番号とパケットの番号をずらす）
+		for (size_t i = 0; i < tasks.size(); i++) {
+			const Subtree &s(subtrees[i]);
+			const uint32_t base(static_cast<uint32_t>(nodes.size()) - 1);
+			const uint32_t packetBase(static_cast<uint32_t>(packets.size()));
+			for (size_t n = 0; n < s.nodes.size(); n++) {
+				Node node(s.nodes[n]);
+				node.first += node.count > 0 ? packetBase : base;
+				if (n == 0) nodes[tasks[i].node] = node;
+				else nodes.push_back(node);
+			}
+			packets.insert(packets.end(), s.packets.begin(), s.packets.end());
+		}
+
+		// 構築にだけ使ったものを捨てる
+		std::vector<Box>().swap(box);
+		std::vector<GLuint>().swap(order);
+	}
+
+	// 光線と最も近くで交わる三角形を求める
+	//  origin: 光線の始点
+	//  direction: 光線の方向（正規化しなくてよい）
+	//  hit: 交差の結果（hit.t より遠いものは無視する）
+	//  交わる三角形があれば true を返す
+	bool intersect(const GLfloat *origin, const GLfloat *direction, Hit &hit) const {
+		if (nodes.empty()) return false;
+
+		GLfloat inv[3];
+		for (int j = 0; j < 3; j++) inv[j] = 1.0f / direction[j];
+
+		// 子を二つ積んで一つ取り出すので，積むのは木の深さ + 1 個まで
+		bool found(false);
+		uint32_t stack[stackSize];
+		int top(0);
+		GLfloat t(hit.t);
+		if (!slab(nodes[0], origin, inv, t)) return false;
+		stack[top++] = 0;
+		while (top > 0) {
+			const Node &n(nodes[stack[--top]]);
+			if (n.count > 0) {
+				// 葉の三角形を 4つずつ調べる
+				for (uint32_t p = n.first; p < n.first + n.count; p++) {
+					found |= triangles(packets[p], origin, direction, hit);
+				}
+				continue;
+			}
+
+			// 近い方の子を先に調べるように遠い方を先に積む
+			const Node &a(nodes[n.first]), &b(nodes[n.first + 1]);
+			GLfloat ta(hit.t), tb(hit.t);
+			const bool ha(slab(a, origin, inv, ta)), hb(slab(b, origin, inv, tb));
+			if (ha && hb) {
+				stack[top++] = ta < tb ? n.first + 1 : n.first;
+				stack[top++] = ta < tb ? n.first : n.first + 1;
+			}
+			else if (ha) stack[top++] = n.first;
+			else if (hb) stack[top++] = n.first + 1;
+		}
+		return found;
+	}
+
+	// 境界ボックスの最小点と最大点を返す
+	const GLfloat *getBoundsMin() const { return nodes[0].lo; }
+	const GLfloat *getBoundsMax() const { return nodes[0].hi; }
+
+	// ノードの数を返す
+	size_t getNodeCount() const { return nodes.size(); }
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	Bvh(const Bvh &b);
+
+	// 代入によるコピー禁止
+	Bvh &operator=(const Bvh &b);
+
+	// 葉に置く三角形の数の上限と，SAH によらず葉にする三角形の数
+	static const size_t maxLeaf = 16;
+	static const size_t minLeaf = 4;
+
+	// SAH のビンの数
+	static const int bins = 16;
+
+	// これより深いノードは SAH によらず葉に収まるまで中央値で半分にする
+	//  三角形の数は 2^32 未満なので，木の深さは medianDepth + 32 より浅くなる
+	static const int medianDepth = 64;
+
+	// 探索のスタックの大きさ
+	static const int stackSize = 128;
+	static_assert(medianDepth + 32 < stackSize, "traversal stack can overflow");
+
+	// ノード（count が 0 なら子は first と first + 1，そうでなければ first から count 個のパケット）
+	struct Node {
+		GLfloat lo[3];
+		uint32_t first;
+		GLfloat hi[3];
+		uint32_t count;
+	};
+
+	// 4つの三角形（頂点 0 と 2辺を成分ごとに並べたもの）
+	struct alignas(16) Packet {
+		GLfloat v0[3][4], e1[3][4], e2[3][4];
+		GLuint id[4];
+	};
+
+	// 境界ボックス
+	struct Box {
+		GLfloat lo[3], hi[3];
+
+		// 空にする
+		void clear() {
+			std::fill(lo, lo + 3, FLT_MAX);
+			std::fill(hi, hi + 3, -FLT_MAX);
+		}
+
+		// 広げる
+		void grow(const Box &b) {
+			for (int j = 0; j < 3; j++) {
+				lo[j] = std::min(lo[j], b.lo[j]);
+				hi[j] = std::max(hi[j], b.hi[j]);
+			}
+		}
+
+		// 表面積の半分
+		GLfloat area() const {
+			const GLfloat x(hi[0] - lo[0]), y(hi[1] - lo[1]), z(hi[2] - lo[2]);
+			return x < 0.0f ? 0.0f : x * y + y * z + z * x;
+		}
+	};
+
+	// ビン
+	struct Bin {
+		Box box;
+		size_t count;
+	};
+
+	// 並列に作る部分木
+	struct Task {
+		uint32_t node;
+		size_t begin, end;
+		int depth;
+	};
+
+	// 部分木
+	struct Subtree {
+		std::vector<Node> nodes;
+		std::vector<Packet> packets;
+	};
+
+	// 頂点属性とインデックス
+	const Object::Vertex *const vertex;
+	const GLuint *const index;
+
+	// 並列に構築するときのジョブシステム
+	JobSystem *const jobs;
+
+	// ノード
+	std::vector<Node> nodes;
+
+	// 葉の三角形
+	std::vector<Packet> packets;
+
+	// 構築中の三角形ごとの境界ボックスと並び
+	std::vector<Box> box;
+	std::vector<GLuint> order;
+
+	// 三角形 i の k 番目の頂点の位置
+	const GLfloat *position(GLuint i, int k) const {
+		return vertex[index != NULL ? index[i * 3 + k] : i * 3 + k].position;
+	}
+
+	// ジョブシステムがあれば [0, count) を分けて並列に処理する
+	template <typename F>
+	void forEach(size_t count, const F &body, size_t grain = 16384, bool parallel = true) const {
+		if (parallel && jobs != NULL && count > grain) jobs->parallel_for(count, grain, body);
+		else body(0, count);
+	}
+
+	// order[begin, end) の三角形で深さ depth のノード self を作る
+	//  grain より少なくなった部分木は tasks に回す（tasks が NULL ならすべて作る）
+	void split(std::vector<Node> &tree, std::vector<Packet> &leaf, uint32_t self,
+		size_t begin, size_t end, int depth, size_t grain, std::vector<Task> *tasks) {
+		const size_t count(end - begin);
+
+		// 部分木を作るジョブの中ではさらに分けない
+		const bool parallel(tasks != NULL);
+		std::mutex merge;
+
+		// 境界ボックスと重心の範囲を求める（重心は 2倍した値）
+		Box bounds, centroid;
+		bounds.clear();
+		centroid.clear();
+		forEach(count, [&](size_t b, size_t e) {
+			Box lb, lc;
+			lb.clear();
+			lc.clear();
+			for (size_t i = begin + b; i < begin + e; i++) {
+				const Box &t(box[order[i]]);
+				lb.grow(t);
+				for (int j = 0; j < 3; j++) {
+					const GLfloat c(t.lo[j] + t.hi[j]);
+					lc.lo[j] = std::min(lc.lo[j], c);
+					lc.hi[j] = std::max(lc.hi[j], c);
+				}
+			}
+			std::lock_guard<std::mutex> lock(merge);
+			bounds.grow(lb);
+			centroid.grow(lc);
+		}, 16384, parallel);
+		std::copy(bounds.lo, bounds.lo + 3, tree[self].lo);
+		std::copy(bounds.hi, bounds.hi + 3, tree[self].hi);
+
+		// 重心の範囲が最も広い軸で分割を探す
+		int axis(0);
+		for (int j = 1; j < 3; j++) {
+			if (centroid.hi[j] - centroid.lo[j] > centroid.hi[axis] - centroid.lo[axis]) axis = j;
+		}
+		const GLfloat extent(centroid.hi[axis] - centroid.lo[axis]);
+		const bool deep(depth >= medianDepth);
+		if ((count <= minLeaf || extent <= 0.0f || deep) && count <= maxLeaf) {
+			makeLeaf(tree[self], leaf, begin, end);
+			return;
+		}
+
+		size_t middle(begin);
+		if (extent > 0.0f && !deep) {
+			// 三角形を重心でビンに分ける
+			const GLfloat scale(bins / extent);
+			const auto binOf([&](GLuint t) {
+				const int b(static_cast<int>((box[t].lo[axis] + box[t].hi[axis] - centroid.lo[axis]) * scale));
+				return std::min(b, bins - 1);
+			});
+			Bin bin[bins];
+			for (Bin &b : bin) {
+				b.box.clear();
+				b.count = 0;
+			}
+			forEach(count, [&](size_t b, size_t e) {
+				Bin local[bins];
+				for (Bin &l : local) {
+					l.box.clear();
+					l.count = 0;
+				}
+				for (size_t i = begin + b; i < begin + e; i++) {
+					Bin &l(local[binOf(order[i])]);
+					l.box.grow(box[order[i]]);
+					++l.count;
+				}
+				std::lock_guard<std::mutex> lock(merge);
+				for (int k = 0; k < bins; k++) {
+					bin[k].box.grow(local[k].box);
+					bin[k].count += local[k].count;
+				}
+			}, 16384, parallel);
+
+			// 左右のコストが最小になる境界を求める
+			GLfloat right[bins];
+			size_t rightCount[bins];
+			Box acc;
+			acc.clear();
+			size_t n(0);
+			for (int k = bins - 1; k > 0; k--) {
+				acc.grow(bin[k].box);
+				n += bin[k].count;
+				right[k] = acc.area() * n;
+				rightCount[k] = n;
+			}
+			int best(-1);
+			GLfloat cost(FLT_MAX);
+			acc.clear();
+			n = 0;
+			for (int k = 0; k < bins - 1; k++) {
+				acc.grow(bin[k].box);
+				n += bin[k].count;
+				if (n == 0 || rightCount[k + 1] == 0) continue;
+				const GLfloat c(acc.area() * n + right[k + 1]);
+				if (c < cost) {
+					cost = c;
+					best = k;
+				}
+			}
+
+			// 分けない方が安ければ葉にする
+			if (count <= maxLeaf && cost >= bounds.area() * count) {
+				makeLeaf(tree[self], leaf, begin, end);
+				return;
+			}
+			if (best >= 0) {
+				middle = static_cast<size_t>(std::partition(order.begin() + begin, order.begin() + end,
+					[&](GLuint t) { return binOf(t) <= best; }) - order.begin());
+			}
+		}
+		if (middle == begin || middle == end) {
+			// 分けられないか深くなりすぎたら重心の中央値で半分にする
+			middle = begin + count / 2;
+			std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+				[&](GLuint a, GLuint b) { return box[a].lo[axis] + box[a].hi[axis] < box[b].lo[axis] + box[b].hi[axis]; });
+		}
+
+		// 子を作る
+		const uint32_t child(static_cast<uint32_t>(tree.size()));
+		tree[self].first = child;
+		tree[self].count = 0;
+		tree.resize(tree.size() + 2);
+		const size_t range[][2] = { { begin, middle }, { middle, end } };
+		for (uint32_t c = 0; c < 2; c++) {
+			if (tasks != NULL && range[c][1] - range[c][0] < grain) {
+				const Task task = { child + c, range[c][0], range[c][1], depth + 1 };
+				tasks->push_back(task);
+			}
+			else {
+				split(tree, leaf, child + c, range[c][0], range[c][1], depth + 1, grain, tasks);
+			}
+		}
+	}
+
+	// order[begin, end) の三角形を 4つずつパケットにして葉にする
+	void makeLeaf(Node &node, std::vector<Packet> &leaf, size_t begin, size_t end) const {
+		node.first = static_cast<uint32_t>(leaf.size());
+		node.count = static_cast<uint32_t>((end - begin + 3) / 4);
+		for (size_t i = begin; i < end; i += 4) {
+			Packet p = {};
+			for (size_t l = 0; l < 4 && i + l < end; l++) {
+				const GLuint t(order[i + l]);
+				const GLfloat *const a(position(t, 0)), *const b(position(t, 1)), *const c(position(t, 2));
+				for (int j = 0; j < 3; j++) {
+					p.v0[j][l] = a[j];
+					p.e1[j][l] = b[j] - a[j];
+					p.e2[j][l] = c[j] - a[j];
+				}
+				p.id[l] = t;
+			}
+			leaf.push_back(p);
+		}
+	}
+
+	// 光線が境界ボックスと tmax より手前で交わるか（交われば tmax に入る位置を入れる）
+	static bool slab(const Node &n, const GLfloat *origin, const GLfloat *inv, GLfloat &tmax) {
+		GLfloat t0(0.0f), t1(tmax);
+		for (int j = 0; j < 3; j++) {
+			GLfloat a((n.lo[j] - origin[j]) * inv[j]), b((n.hi[j] - origin[j]) * inv[j]);
+			if (a > b) std::swap(a, b);
+			t0 = std::max(t0, a);
+			t1 = std::min(t1, b);
+		}
+		if (t0 > t1) return false;
+		tmax = t0;
+		return true;
+	}
+
+	// パケットの 4つの三角形と光線の交差を調べる (Moller-Trumbore)
+	static bool triangles(const Packet &p, const GLfloat *o, const GLfloat *d, Hit &hit) {
+#if defined(BVH_USE_SSE2)
+		const __m128 dx(_mm_set1_ps(d[0])), dy(_mm_set1_ps(d[1])), dz(_mm_set1_ps(d[2]));
+		const __m128 e1x(_mm_load_ps(p.e1[0])), e1y(_mm_load_ps(p.e1[1])), e1z(_mm_load_ps(p.e1[2]));
+		const __m128 e2x(_mm_load_ps(p.e2[0])), e2y(_mm_load_ps(p.e2[1])), e2z(_mm_load_ps(p.e2[2]));
+
+		// P = D x E2, det = E1 . P
+		const __m128 px(_mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y)));
+		const __m128 py(_mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z)));
+		const __m128 pz(_mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x)));
+		const __m128 det(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz)));
+		const __m128 inv(_mm_div_ps(_mm_set1_ps(1.0f), det));
+
+		// T = O - V0, u = T . P / det
+		const __m128 tx(_mm_sub_ps(_mm_set1_ps(o[0]), _mm_load_ps(p.v0[0])));
+		const __m128 ty(_mm_sub_ps(_mm_set1_ps(o[1]), _mm_load_ps(p.v0[1])));
+		const __m128 tz(_mm_sub_ps(_mm_set1_ps(o[2]), _mm_load_ps(p.v0[2])));
+		const __m128 u(_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv));
+
+		// Q = T x E1, v = D . Q / det, t = E2 . Q / det
+		const __m128 qx(_mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y)));
+		const __m128 qy(_mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z)));
+		const __m128 qz(_mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x)));
+		const __m128 v(_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv));
+		const __m128 t(_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv));
+
+		// 三角形の内側で始点より先かつ今までより近いもの
+		const __m128 zero(_mm_setzero_ps());
+		__m128 mask(_mm_cmpneq_ps(det, zero));
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+		mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+		mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, zero));
+		mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(hit.t)));
+		int bits(_mm_movemask_ps(mask));
+		if (bits == 0) return false;
+
+		alignas(16) GLfloat ts[4], us[4], vs[4];
+		_mm_store_ps(ts, t);
+		_mm_store_ps(us, u);
+		_mm_store_ps(vs, v);
+		for (int l = 0; bits != 0; l++, bits >>= 1) {
+			if ((bits & 1) && ts[l] < hit.t) {
+				hit.t = ts[l];
+				hit.u = us[l];
+				hit.v = vs[l];
+				hit.triangle = p.id[l];
+			}
+		}
+		return true;
+#else
+		bool found(false);
+		for (int l = 0; l < 4; l++) {
+			const GLfloat e1[3] = { p.e1[0][l], p.e1[1][l], p.e1[2][l] };
+			const GLfloat e2[3] = { p.e2[0][l], p.e2[1][l], p.e2[2][l] };
+			const GLfloat q[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+			const GLfloat det(e1[0] * q[0] + e1[1] * q[1] + e1[2] * q[2]);
+			if (det == 0.0f) continue;
+			const GLfloat inv(1.0f / det);
+			const GLfloat s[3] = { o[0] - p.v0[0][l], o[1] - p.v0[1][l], o[2] - p.v0[2][l] };
+			const GLfloat u((s[0] * q[0] + s[1] * q[1] + s[2] * q[2]) * inv);
+			const GLfloat r[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+			const GLfloat v((d[0] * r[0] + d[1] * r[1] + d[2] * r[2]) * inv);
+			const GLfloat t((e2[0] * r[0] + e2[1] * r[1] + e2[2] * r[2]) * inv);
+			if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f && t < hit.t) {
+				hit.t = t;
+				hit.u = u;
+				hit.v = v;
+				hit.triangle = p.id[l];
+				found = true;
+			}
+		}
+		return found;
+#endif
+	}
+};
@@ -0,0 +1,225 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include <GL/glew.h>
+#include "Matrix.h"
+#include "Affine.h"
+#include "GlTrace.h"
+
+// デバッグ用の線分をまとめて描く
+//  line(), box(), frustum(), axis() で追加した線分を CPU の配列に溜めておき，
+//  draw() で一つの頂点バッファに転送して，デプステストの有無ごとに一回ずつ描く．
+//  配列は最初に capacity 本分確保するので追加ではメモリを確保しない．
+//  頂点バッファは描画のたびに溜めた分の大きさで作り直す．
+//  あふれた分は捨てて数える．描画スレッドからだけ使う
+class DebugLines {
+public:
+	// 頂点
+	struct Vertex {
+		// 位置
+		GLfloat position[3];
+		// 色
+		GLubyte color[4];
+	};
+
+	// コンストラクタ
+	//  capacity: 1フレームに描ける線分の数
+	DebugLines(GLsizei capacity = 1 << 20)
+		: capacity(capacity), vertex(size_t(capacity) * 2), tested(0), overlay(0), depth(true), dropped(0)
+	{
+		std::fill(color, color + 4, GLubyte(255));
+
+		// 頂点バッファは描画のたびに作り直すのでここでは確保しない
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glGenBuffers(1, &vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), static_cast<Vertex *>(0)->position);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), static_cast<Vertex *>(0)->color);
+		glEnableVertexAttribArray(3);
+	}
+
+	// デストラクタ
+	virtual ~DebugLines() {
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &vbo);
+	}
+
+	// これから追加する線分の色を設定する
+	void setColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a = 1.0f) {
+		const GLfloat c[] = { r, g, b, a };
+		for (int i = 0; i < 4; i++) {
+			color[i] = static_cast<GLubyte>(std::min(std::max(c[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+		}
+	}
+
+	// これから追加する線分をデプステストするかを設定する（false なら常に手前に描く）
+	void setDepthTest(bool enable) {
+		depth = enable;
+	}
+
+	// 線分を追加する
+	//  a, b: 両端の位置
+	void line(const GLfloat *a, const GLfloat *b) {
+		Vertex *const v(reserve(1));
+		if (v == NULL) return;
+		set(v[0], a);
+		set(v[1], b);
+	}
+
+	// 直方体の稜線を追加する
+	//  lo, hi: 境界ボックスの最小点と最大点
+	//  transform: 境界ボックスに適用する変換
+	void box(const GLfloat *lo, const GLfloat *hi, const Affine &transform = Affine::identity()) {
+		const GLfloat *const m(transform.data());
+		GLfloat corner[8][3];
+		for (int c = 0; c < 8; c++) {
+			const GLfloat p[] = { (c & 1) ? hi[0] : lo[0], (c & 2) ? hi[1] : lo[1], (c & 4) ? hi[2] : lo[2] };
+			for (int i = 0; i < 3; i++) {
+				corner[c][i] = m[i] * p[0] + m[3 + i] * p[1] + m[6 + i] * p[2] + m[9 + i];
+			}
+		}
+		edges(corner);
+	}
+
+	// 視錐台の稜線を追加する
+	//  m: 線分の座標系からクリッピング座標系への変換行列（投影変換行列 x ビュー変換行列）
+	void frustum(const Matrix &m) {
+		const Matrix inverse(m.inverse());
+		const GLfloat *const a(inverse.data());
+		GLfloat corner[8][3];
+		for (int c = 0; c < 8; c++) {
+			// 正規化デバイス座標系の立方体の頂点を戻す
+			const GLfloat p[] = { (c & 1) ? 1.0f : -1.0f, (c & 2) ? 1.0f : -1.0f, (c & 4) ? 1.0f : -1.0f };
+			GLfloat q[4];
+			for (int i = 0; i < 4; i++) {
+				q[i] = a[i] * p[0] + a[4 + i] * p[1] + a[8 + i] * p[2] + a[12 + i];
+			}
+			for (int i = 0; i < 3; i++) corner[c][i] = q[3] != 0.0f ? q[i] / q[3] : q[i];
+		}
+		edges(corner);
+	}
+
+	// 座標軸を x 軸は赤，y 軸は緑，z 軸は青で追加する
+	//  frame: 座標軸の原点と向きを表す変換
+	//  length: 軸の長さ
+	void axis(const Affine &frame, GLfloat length = 1.0f) {
+		Vertex *const v(reserve(3));
+		if (v == NULL) return;
+		const GLfloat *const m(frame.data());
+		for (int j = 0; j < 3; j++) {
+			GLfloat end[3];
+			for (int i = 0; i < 3; i++) end[i] = m[9 + i] + m[j * 3 + i] * length;
+			set(v[j * 2], m + 9);
+			set(v[j * 2 + 1], end);
+			for (int k = 0; k < 2; k++) {
+				GLubyte *const c(v[j * 2 + k].color);
+				c[0] = j == 0 ? 255 : 0;
+				c[1] = j == 1 ? 255 : 0;
+				c[2] = j == 2 ? 255 : 0;
+				c[3] = 255;
+			}
+		}
+	}
+
+	// 溜めた線分を描いて空にする
+	//  シェーダプログラムと変換行列は呼び出し側で設定しておく
+	void draw() {
+		if (tested + overlay > 0) {
+			// 溜めた分の大きさで頂点バッファを作り直して GPU が使用中の内容を待たないようにする
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferData(GL_ARRAY_BUFFER, size_t(tested + overlay) * sizeof(Vertex), NULL, GL_STREAM_DRAW);
+
+			// デプステストするものは先頭から，しないものは末尾から溜めてあるので続けて詰める
+			glBindVertexArray(vao);
+			if (tested > 0) {
+				glBufferSubData(GL_ARRAY_BUFFER, 0, tested * sizeof(Vertex), vertex.data());
+				GlTrace::drawArrays(GL_LINES, 0, tested);
+			}
+			if (overlay > 0) {
+				glBufferSubData(GL_ARRAY_BUFFER, tested * sizeof(Vertex), overlay * sizeof(Vertex),
+					vertex.data() + vertex.size() - overlay);
+				glDisable(GL_DEPTH_TEST);
+				GlTrace::drawArrays(GL_LINES, tested, overlay);
+				glEnable(GL_DEPTH_TEST);
+			}
+		}
+		clear();
+	}
+
+	// 溜めた線分を描かずに捨てる
+	void clear() {
+		tested = overlay = 0;
+	}
+
+	// 溜めている線分の数を返す
+	GLsizei getLineCount() const { return (tested + overlay) / 2; }
+
+	// あふれて捨てた線分の数を返す
+	size_t getDroppedCount() const { return dropped; }
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	DebugLines(const DebugLines &d);
+
+	// 代入によるコピー禁止
+	DebugLines &operator=(const DebugLines &d);
+
+	// 1フレームに描ける線分の数
+	const GLsizei capacity;
+
+	// 溜めている頂点（デプステストするものは先頭から，しないものは末尾から詰める）
+	std::vector<Vertex> vertex;
+
+	// デプステストする頂点の数としない頂点の数
+	GLsizei tested, overlay;
+
+	// これから追加する線分の色とデプステストの有無
+	GLubyte color[4];
+	bool depth;
+
+	// あふれて捨てた線分の数
+	size_t dropped;
+
+	// 頂点配列オブジェクトと頂点バッファオブジェクト
+	GLuint vao, vbo;
+
+	// count 本分の頂点の置き場を確保する（入りきらなければ NULL）
+	Vertex *reserve(GLsizei count) {
+		if (tested + overlay + count * 2 > capacity * 2) {
+			dropped += count;
+			return NULL;
+		}
+		if (depth) {
+			Vertex *const v(vertex.data() + tested);
+			tested += count * 2;
+			return v;
+		}
+		overlay += count * 2;
+		return vertex.data() + vertex.size() - overlay;
+	}
+
+	// 頂点に位置と現在の色を設定する
+	void set(Vertex &v, const GLfloat *p) const {
+		v.position[0] = p[0];
+		v.position[1] = p[1];
+		v.position[2] = p[2];
+		std::copy(color, color + 4, v.color);
+	}
+
+	// 8つの頂点（番号の各ビットが x, y, z の最大側）を結ぶ 12本の稜線を追加する
+	void edges(const GLfloat (*corner)[3]) {
+		Vertex *const v(reserve(12));
+		if (v == NULL) return;
+		int n(0);
+		for (int c = 0; c < 8; c++) {
+			for (int bit = 1; bit < 8; bit <<= 1) {
+				if (c & bit) continue;
+				set(v[n++], corner[c]);
+				set(v[n++], corner[c | bit]);
+			}
+		}
+	}
+};
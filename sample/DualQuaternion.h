@@ -0,0 +1,69 @@
+#pragma once
+#include <GL/glew.h>
+#include "Quaternion.h"
+#include "Affine.h"
+
+// 双対四元数（回転と平行移動の組）
+class DualQuaternion {
+public:
+	// コンストラクタ（恒等変換）
+	DualQuaternion() : real(), dual(0.0f, 0.0f, 0.0f, 0.0f) {}
+
+	// 実部と双対部を指定して初期化するコンストラクタ
+	DualQuaternion(const Quaternion &real, const Quaternion &dual)
+		: real(real), dual(dual) {}
+
+	// 回転 q の後に (x, y, z) だけ平行移動する変換を作成する
+	//  q: 単位四元数
+	static DualQuaternion rigid(const Quaternion &q, GLfloat x, GLfloat y, GLfloat z) {
+		return DualQuaternion(q, Quaternion(0.0f, x * 0.5f, y * 0.5f, z * 0.5f) * q);
+	}
+
+	// 乗算（d * e は e の後に d を適用する変換）
+	DualQuaternion operator*(const DualQuaternion &e) const {
+		return DualQuaternion(real * e.real, real * e.dual + dual * e.real);
+	}
+
+	// 逆変換（単位双対四元数に限る）
+	DualQuaternion inverse() const {
+		return DualQuaternion(real.conjugate(), dual.conjugate());
+	}
+
+	// 平行移動量を取り出す
+	//  t: 3要素の配列
+	void getTranslation(GLfloat *t) const {
+		const Quaternion p((dual * 2.0f) * real.conjugate());
+		t[0] = p.x;
+		t[1] = p.y;
+		t[2] = p.z;
+	}
+
+	// アフィン変換行列に変換する
+	Affine toAffine() const {
+		GLfloat a[12];
+		real.getMatrix(a);
+		getTranslation(a + 9);
+		return Affine(a);
+	}
+
+	// 正規化線形補間（スキニングの DLB と同じ）
+	//  t: 0 で a, 1 で b
+	static DualQuaternion nlerp(const DualQuaternion &a, const DualQuaternion &b, GLfloat t) {
+		const GLfloat s(a.real.dot(b.real) < 0.0f ? -t : t);
+		const Quaternion r(a.real * (1.0f - t) + b.real * s);
+		const Quaternion d(a.dual * (1.0f - t) + b.dual * s);
+		const GLfloat l(sqrt(r.dot(r)));
+		if (l == 0.0f) return a;
+
+		// 実部を単位長にし，双対部から実部に平行な成分を取り除く
+		const GLfloat il(1.0f / l);
+		const Quaternion rn(r * il);
+		const Quaternion dn(d * il);
+		return DualQuaternion(rn, dn + rn * -rn.dot(dn));
+	}
+
+	// 実部（回転）
+	Quaternion real;
+	// 双対部（平行移動を含む）
+	Quaternion dual;
+};
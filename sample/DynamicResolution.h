@@ -0,0 +1,163 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <GL/glew.h>
+#include "ResolutionController.h"
+
+// 縮小した解像度でフレームバッファオブジェクトに描き，拡大して出力する
+//  倍率は ResolutionController が GPU の処理時間から決める．
+//  描画先は余裕を持って確保し，倍率の変更はビューポートの変更だけで済ませる
+class DynamicResolution {
+public:
+	// コンストラクタ
+	//  budget: 目標とする 1フレームの GPU 時間（秒）
+	//  minScale: 解像度の倍率の下限
+	DynamicResolution(double budget = 0.9 / 60.0, GLfloat minScale = 0.5f)
+		: controller(budget, minScale, 1.0f)
+		, fbo(0), capacity{ 0, 0 }, size{ 0, 0 }, frame(0), pending(0)
+		, timer(GLEW_ARB_timer_query != GL_FALSE)
+		, last(std::chrono::steady_clock::now())
+	{
+		glGenRenderbuffers(2, renderbuffer);
+		glGenFramebuffers(1, &fbo);
+		if (timer) glGenQueries(queryCount, query);
+	}
+
+	// デストラクタ
+	virtual ~DynamicResolution() {
+		if (timer) glDeleteQueries(queryCount, query);
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteRenderbuffers(2, renderbuffer);
+	}
+
+	// 描画先を縮小したフレームバッファオブジェクトに切り替える
+	//  出力先は呼び出した時点のフレームバッファとビューポートにする
+	void begin() {
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+
+		// 出力先より小さければ描画先を確保しなおす
+		reserve(viewport[2], viewport[3]);
+
+		// 描画する大きさ
+		const GLfloat scale(controller.getScale());
+		size[0] = std::max(static_cast<GLint>(viewport[2] * scale + 0.5f), 1);
+		size[1] = std::max(static_cast<GLint>(viewport[3] * scale + 0.5f), 1);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glViewport(0, 0, size[0], size[1]);
+
+		// GPU の処理時間の計測を開始する
+		if (timer && pending < queryCount) {
+			glBeginQuery(GL_TIME_ELAPSED, query[frame % queryCount]);
+		}
+	}
+
+	// 描いた画像を拡大して出力先に転送する
+	void end() {
+		if (timer && pending < queryCount) {
+			glEndQuery(GL_TIME_ELAPSED);
+			++frame;
+			++pending;
+		}
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+		glBlitFramebuffer(0, 0, size[0], size[1],
+			viewport[0], viewport[1], viewport[0] + viewport[2], viewport[1] + viewport[3],
+			GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		glBindFramebuffer(GL_FRAMEBUFFER, target);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+		// 計測の済んだものから倍率を更新する
+		if (timer) {
+			while (pending > 0) {
+				const GLuint q(query[(frame - pending) % queryCount]);
+				GLint available;
+				glGetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE, &available);
+				if (available == GL_FALSE) break;
+
+				GLuint64 elapsed;
+				glGetQueryObjectui64v(q, GL_QUERY_RESULT, &elapsed);
+				controller.update(static_cast<double>(elapsed) * 1.0e-9);
+				--pending;
+			}
+		}
+		else {
+			// タイマークエリが使えなければフレームの間隔で代用する
+			const std::chrono::steady_clock::time_point now(std::chrono::steady_clock::now());
+			controller.update(std::chrono::duration<double>(now - last).count());
+			last = now;
+		}
+	}
+
+	// 目標のフレーム時間を設定する
+	void setBudget(double time) { controller.setBudget(time); }
+
+	// 現在の倍率を返す
+	GLfloat getScale() const { return controller.getScale(); }
+
+	// 平滑化したフレーム時間を返す
+	double getFrameTime() const { return controller.getFrameTime(); }
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	DynamicResolution(const DynamicResolution &d);
+
+	// 代入によるコピー禁止
+	DynamicResolution &operator=(const DynamicResolution &d);
+
+	// 同時に計測できるフレームの数
+	static const int queryCount = 4;
+
+	// 倍率を決める
+	ResolutionController controller;
+
+	// フレームバッファオブジェクト名
+	GLuint fbo;
+
+	// カラーバッファとデプスバッファのレンダーバッファ名
+	GLuint renderbuffer[2];
+
+	// 確保してある描画先の大きさ
+	GLint capacity[2];
+
+	// このフレームで描画する大きさ
+	GLint size[2];
+
+	// 出力先のビューポートとフレームバッファ
+	GLint viewport[4];
+	GLint target;
+
+	// タイマークエリ
+	GLuint query[queryCount];
+
+	// 発行したクエリの数と結果を待っているクエリの数
+	unsigned int frame, pending;
+
+	// タイマークエリが使えるか
+	const bool timer;
+
+	// 前のフレームの終了時刻（タイマークエリが使えないとき）
+	std::chrono::steady_clock::time_point last;
+
+	// 描画先を少なくとも width x height 確保する
+	void reserve(GLint width, GLint height) {
+		if (width <= capacity[0] && height <= capacity[1]) return;
+
+		// ウィンドウのドラッグ中に何度も確保しなおさないように余裕を持たせる
+		capacity[0] = std::max(capacity[0], (width + width / 4 + 63) & ~63);
+		capacity[1] = std::max(capacity[1], (height + height / 4 + 63) & ~63);
+
+		glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer[0]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, capacity[0], capacity[1]);
+		glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer[1]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, capacity[0], capacity[1]);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer[0]);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffer[1]);
+	}
+};
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+// フレームごとに使い捨てるデータのための線形アロケータ
+//  最初に確保した領域を先頭から順に切り出し，reset() でまとめて解放する
+class FrameArena {
+public:
+	// コンストラクタ
+	//  capacity: 確保しておく領域の大きさ（バイト）
+	FrameArena(size_t capacity = 1 << 20)
+		: buffer(capacity), used(0), peak(0), count(0), overflow(0)
+	{
+	}
+
+	// 領域を切り出す
+	//  size: 大きさ（バイト）
+	//  align: 境界（2のべき乗）
+	//  足りなければ NULL を返す
+	void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+		const uintptr_t base(reinterpret_cast<uintptr_t>(buffer.data()));
+		const uintptr_t start((base + used + align - 1) & ~(static_cast<uintptr_t>(align) - 1));
+		const size_t end(start - base + size);
+		if (end > buffer.size()) {
+			++overflow;
+			return NULL;
+		}
+		used = end;
+		if (used > peak) peak = used;
+		++count;
+		return reinterpret_cast<void *>(start);
+	}
+
+	// 型 T の要素 n 個分の領域を切り出して既定値で初期化する
+	//  T はデストラクタを呼ばなくてよい型に限る
+	template <typename T>
+	T *allocate(size_t n) {
+		void *const p(allocate(sizeof(T) * n, alignof(T)));
+		if (p == NULL) return NULL;
+		T *const t(static_cast<T *>(p));
+		for (size_t i = 0; i < n; i++) new(t + i) T();
+		return t;
+	}
+
+	// 切り出した領域をすべて解放する（フレームの開始時に呼ぶ）
+	void reset() {
+		used = 0;
+		count = 0;
+	}
+
+	// 使用中の大きさを返す
+	size_t getUsed() const { return used; }
+
+	// 使用中の大きさの最大値を返す
+	size_t getPeak() const { return peak; }
+
+	// 前回の reset() 以降に切り出した回数を返す
+	size_t getAllocationCount() const { return count; }
+
+	// 領域が足りずに切り出せなかった回数を返す
+	size_t getOverflowCount() const { return overflow; }
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	FrameArena(const FrameArena &a);
+
+	// 代入によるコピー禁止
+	FrameArena &operator=(const FrameArena &a);
+
+	// 領域
+	std::vector<unsigned char> buffer;
+
+	// 使用中の大きさと最大値
+	size_t used, peak;
+
+	// 切り出した回数
+	size_t count;
+
+	// 切り出せなかった回数
+	size_t overflow;
+};
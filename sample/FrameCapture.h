@@ -0,0 +1,230 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <GL/glew.h>
+#include "FrameWriter.h"
+
+// フレームバッファオブジェクトに描いた画像を非同期に読み出して記録する
+//  glReadPixels はピクセルバッファオブジェクトのリングに対して発行し，
+//  フェンスが通過したものから順に書き出しスレッドに渡す．
+//  描画スレッドは GPU の完了を待たない
+class FrameCapture {
+public:
+	// コンストラクタ
+	//  width, height: 記録する画像の大きさ
+	//  path: 出力先
+	//  format: 出力形式
+	//  count: ピクセルバッファオブジェクトの数（読み出しが何フレーム遅れてよいか）
+	FrameCapture(int width, int height, const std::string &path,
+		FrameWriter::Format format, int count = 4)
+		: width(width), height(height), slots(count), head(0), tail(0)
+		, dropped(0), cpuTime(0.0)
+		, writer(new FrameWriter(path, format, width, height))
+	{
+		// 描画先のフレームバッファオブジェクト
+		glGenRenderbuffers(2, renderbuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer[0]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer[1]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer[0]);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffer[1]);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		// 読み出し先のピクセルバッファオブジェクト
+		for (Slot &slot : slots) {
+			glGenBuffers(1, &slot.pbo);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+			glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		returned.reserve(count);
+		released.reserve(count);
+	}
+
+	// デストラクタ（読み出し中のフレームをすべて書き出してから終了する）
+	virtual ~FrameCapture() {
+		collect(true);
+		writer.reset();
+		recycle();
+
+		for (Slot &slot : slots) {
+			if (slot.fence != NULL) glDeleteSync(slot.fence);
+			glDeleteBuffers(1, &slot.pbo);
+		}
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteRenderbuffers(2, renderbuffer);
+	}
+
+	// 描画先を記録用のフレームバッファオブジェクトに切り替える
+	void begin() {
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glViewport(0, 0, width, height);
+	}
+
+	// 描いた画像の読み出しを発行し，ウィンドウに転送する
+	void end() {
+		const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+
+		// 書き出しが済んだピクセルバッファオブジェクトを再利用できるようにする
+		recycle();
+
+		// 空いているピクセルバッファオブジェクトに読み出す
+		Slot &slot(slots[head]);
+		if (slot.state == FREE) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+			glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			slot.state = PENDING;
+			head = (head + 1) % slots.size();
+		}
+		else {
+			// 書き出しが追いつかなければこのフレームは記録しない
+			++dropped;
+		}
+
+		// ウィンドウに転送する
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, width, height,
+			viewport[0], viewport[1], viewport[0] + viewport[2], viewport[1] + viewport[3],
+			GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+		// GPU が読み出しを終えたものを書き出しスレッドに渡す
+		collect(false);
+
+		cpuTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// 記録する画像の幅を返す
+	int getWidth() const { return width; }
+
+	// 記録する画像の高さを返す
+	int getHeight() const { return height; }
+
+	// 記録できなかったフレームの数を返す
+	int getDroppedCount() const { return dropped; }
+
+	// 書き出しを待っているフレームの数を返す
+	size_t getQueueDepth() const { return writer->getQueueDepth(); }
+
+	// 直前の end() にかかった CPU 時間（秒）を返す
+	double getCpuTime() const { return cpuTime; }
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	FrameCapture(const FrameCapture &c);
+
+	// 代入によるコピー禁止
+	FrameCapture &operator=(const FrameCapture &c);
+
+	// ピクセルバッファオブジェクトの状態
+	enum State {
+		// 空いている
+		FREE,
+		// GPU が読み出し中
+		PENDING,
+		// マップして書き出しスレッドに渡した
+		MAPPED
+	};
+
+	// 読み出し先
+	struct Slot {
+		GLuint pbo;
+		GLsync fence;
+		State state;
+		Slot() : pbo(0), fence(NULL), state(FREE) {}
+	};
+
+	// 記録する画像の大きさ
+	const int width, height;
+
+	// フレームバッファオブジェクト名
+	GLuint fbo;
+
+	// カラーバッファとデプスバッファのレンダーバッファ名
+	GLuint renderbuffer[2];
+
+	// 切り替える前のビューポート
+	GLint viewport[4];
+
+	// ピクセルバッファオブジェクトのリング
+	std::vector<Slot> slots;
+
+	// 次に読み出すスロットと次に書き出しスレッドに渡すスロット
+	size_t head, tail;
+
+	// 記録できなかったフレームの数
+	int dropped;
+
+	// 直前の end() にかかった CPU 時間
+	double cpuTime;
+
+	// 書き出しが済んで返却されたスロットと，マップを解除するスロット
+	//  二つを入れ替えて使い，フレームごとに確保しなおさない
+	std::vector<int> returned, released;
+	std::mutex returnedMutex;
+
+	// 書き出しスレッド
+	std::unique_ptr<FrameWriter> writer;
+
+	// 読み出しが終わったスロットをマップして書き出しスレッドに渡す
+	//  wait: true なら GPU の完了を待つ
+	void collect(bool wait) {
+		while (slots[tail].state == PENDING) {
+			Slot &slot(slots[tail]);
+			const GLenum status(glClientWaitSync(slot.fence,
+				wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000 : 0));
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+			glDeleteSync(slot.fence);
+			slot.fence = NULL;
+
+			// 書き出しが済むまでマップしたままにしておく（描画スレッドでは複写しない）
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+			const GLubyte *const pixels(static_cast<const GLubyte *>(
+				glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, width * height * 4, GL_MAP_READ_BIT)));
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			slot.state = MAPPED;
+			writer->push(pixels, static_cast<int>(tail), release, this);
+
+			tail = (tail + 1) % slots.size();
+		}
+	}
+
+	// 返却されたスロットのマップを解除する
+	void recycle() {
+		{
+			std::lock_guard<std::mutex> lock(returnedMutex);
+			released.swap(returned);
+		}
+		for (int i : released) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slots[i].pbo);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			slots[i].state = FREE;
+		}
+		released.clear();
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	// 書き出しスレッドからスロットの返却を受け取る
+	static void release(void *user, int slot) {
+		FrameCapture *const instance(static_cast<FrameCapture *>(user));
+		std::lock_guard<std::mutex> lock(instance->returnedMutex);
+		instance->returned.push_back(slot);
+	}
+};
@@ -0,0 +1,316 @@
+#pragma once
+#include <cstdio>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <GL/glew.h>
+
+// 読み出したフレームをファイルに書き出すスレッド
+//  描画スレッドからは画素の配列を渡すだけで，変換と書き込みはこのスレッドで行う
+class FrameWriter {
+public:
+	// 出力形式
+	enum Format {
+		// RGBA を一つのファイルに連結する
+		RAW,
+		// フレームごとの PNG ファイル
+		PNG,
+		// YUV4MPEG2 (4:2:0) のストリーム
+		Y4M
+	};
+
+	// 書き出しが済んだフレームを通知する関数
+	//  user: 登録時に渡したポインタ, slot: フレームを渡したときの番号
+	typedef void (*Callback)(void *user, int slot);
+
+	// コンストラクタ
+	//  path: 出力先（PNG のときは末尾に連番と拡張子を付ける）
+	//  format: 出力形式
+	//  width, height: フレームの大きさ
+	//  fps: Y4M に記録するフレームレート
+	FrameWriter(const std::string &path, Format format, int width, int height, int fps = 60)
+		: path(path), format(format), width(width), height(height), fps(fps)
+		, file(NULL), frameCount(0), jobs(64), first(0), count(0), quit(false)
+	{
+		if (format != PNG) {
+			file = fopen(path.c_str(), "wb");
+			if (file == NULL) {
+				std::fprintf(stderr, "Can't open capture file: %s\n", path.c_str());
+			}
+			else if (format == Y4M) {
+				std::fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+			}
+		}
+		thread = std::thread(&FrameWriter::run, this);
+	}
+
+	// デストラクタ（残っているフレームを書き終えてから終了する）
+	virtual ~FrameWriter() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		condition.notify_one();
+		thread.join();
+		if (file != NULL) fclose(file);
+	}
+
+	// フレームを書き出しの待ち行列に加える
+	//  pixels: 下の行から並んだ RGBA の画素（書き出しが済むまで保持すること）
+	//  slot: 書き出し後に callback に渡す番号
+	void push(const GLubyte *pixels, int slot, Callback callback, void *user) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			const Job job = { pixels, slot, callback, user };
+
+			// 待ち行列が満杯なら広げる（通常は読み出しのリングより大きいので起きない）
+			if (count == jobs.size()) {
+				std::rotate(jobs.begin(), jobs.begin() + first, jobs.end());
+				jobs.resize(jobs.size() * 2);
+				first = 0;
+			}
+			jobs[(first + count++) % jobs.size()] = job;
+		}
+		condition.notify_one();
+	}
+
+	// 待ち行列に残っているフレームの数を返す
+	size_t getQueueDepth() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return count;
+	}
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	FrameWriter(const FrameWriter &w);
+
+	// 代入によるコピー禁止
+	FrameWriter &operator=(const FrameWriter &w);
+
+	// 書き出すフレーム
+	struct Job {
+		const GLubyte *pixels;
+		int slot;
+		Callback callback;
+		void *user;
+	};
+
+	// 出力先
+	const std::string path;
+
+	// 出力形式
+	const Format format;
+
+	// フレームの大きさ
+	const int width, height;
+
+	// フレームレート
+	const int fps;
+
+	// 出力ファイル（PNG 以外）
+	FILE *file;
+
+	// 書き出したフレームの数
+	int frameCount;
+
+	// PNG のファイル名
+	std::string fileName;
+
+	// 作業用の配列（フレームごとに確保しなおさない）
+	std::vector<GLubyte> work, raw, header;
+
+	// 書き出しの待ち行列（リングバッファ）
+	std::vector<Job> jobs;
+	size_t first, count;
+
+	// 待ち行列の排他制御
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	// 終了要求
+	bool quit;
+
+	// 書き出しスレッド
+	std::thread thread;
+
+	// 書き出しスレッドの処理
+	void run() {
+		for (;;) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this] { return quit || count > 0; });
+				if (count == 0) return;
+				job = jobs[first];
+				first = (first + 1) % jobs.size();
+				--count;
+			}
+
+			switch (format) {
+			case RAW: writeRaw(job.pixels); break;
+			case PNG: writePng(job.pixels); break;
+			case Y4M: writeY4m(job.pixels); break;
+			}
+			++frameCount;
+
+			// 画素の配列を返す
+			job.callback(job.user, job.slot);
+		}
+	}
+
+	// 上下を反転して RGBA のまま書き出す
+	void writeRaw(const GLubyte *pixels) {
+		if (file == NULL) return;
+		const size_t stride(width * 4);
+		for (int y = height - 1; y >= 0; --y) {
+			fwrite(pixels + y * stride, 1, stride, file);
+		}
+	}
+
+	// YUV 4:2:0 に変換して書き出す
+	void writeY4m(const GLubyte *pixels) {
+		if (file == NULL) return;
+		const int cw((width + 1) / 2), ch((height + 1) / 2);
+		work.resize(width * height + cw * ch * 2);
+		GLubyte *const py(&work[0]);
+		GLubyte *const pu(py + width * height);
+		GLubyte *const pv(pu + cw * ch);
+
+		// 輝度（BT.601 フルレンジ）
+		for (int y = 0; y < height; y++) {
+			const GLubyte *p(pixels + (height - 1 - y) * width * 4);
+			for (int x = 0; x < width; x++, p += 4) {
+				py[y * width + x] = static_cast<GLubyte>((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+			}
+		}
+
+		// 色差は 2x2 画素の平均から求める
+		for (int y = 0; y < ch; y++) {
+			for (int x = 0; x < cw; x++) {
+				int r(0), g(0), b(0), n(0);
+				for (int j = y * 2; j < y * 2 + 2 && j < height; j++) {
+					const GLubyte *p(pixels + ((height - 1 - j) * width + x * 2) * 4);
+					for (int i = x * 2; i < x * 2 + 2 && i < width; i++, p += 4, n++) {
+						r += p[0]; g += p[1]; b += p[2];
+					}
+				}
+				r /= n; g /= n; b /= n;
+				pu[y * cw + x] = static_cast<GLubyte>(((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128);
+				pv[y * cw + x] = static_cast<GLubyte>(((128 * r - 107 * g - 21 * b + 128) >> 8) + 128);
+			}
+		}
+
+		fputs("FRAME\n", file);
+		fwrite(&work[0], 1, work.size(), file);
+	}
+
+	// 無圧縮の deflate ブロックで PNG を書き出す
+	void writePng(const GLubyte *pixels) {
+		char name[32];
+		std::snprintf(name, sizeof name, "_%05d.png", frameCount);
+		fileName.assign(path).append(name);
+		FILE *const fp(fopen(fileName.c_str(), "wb"));
+		if (fp == NULL) return;
+
+		// 各行の先頭にフィルタの種類 (0) を付けた画像データ
+		const size_t stride(width * 4 + 1);
+		raw.resize(stride * height);
+		for (int y = 0; y < height; y++) {
+			raw[y * stride] = 0;
+			std::copy(pixels + (height - 1 - y) * width * 4, pixels + (height - y) * width * 4, &raw[y * stride + 1]);
+		}
+
+		// zlib ストリーム
+		work.clear();
+		work.push_back(0x78);
+		work.push_back(0x01);
+		for (size_t i = 0; i < raw.size(); i += 65535) {
+			const size_t n(std::min<size_t>(raw.size() - i, 65535));
+			work.push_back(i + n == raw.size() ? 1 : 0);
+			work.push_back(static_cast<GLubyte>(n));
+			work.push_back(static_cast<GLubyte>(n >> 8));
+			work.push_back(static_cast<GLubyte>(~n));
+			work.push_back(static_cast<GLubyte>(~n >> 8));
+			work.insert(work.end(), raw.begin() + i, raw.begin() + i + n);
+		}
+		// Adler-32 （剰余は桁あふれしない 5552 バイトごとにまとめて求める）
+		unsigned int a(1), b(0);
+		for (size_t i = 0; i < raw.size(); ) {
+			const size_t e(std::min<size_t>(raw.size(), i + 5552));
+			for (; i < e; i++) {
+				a += raw[i];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+		putBE(work, (b << 16) | a);
+
+		static const GLubyte signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		fwrite(signature, 1, sizeof signature, fp);
+
+		header.clear();
+		putBE(header, width);
+		putBE(header, height);
+		header.push_back(8);	// ビット深度
+		header.push_back(6);	// RGBA
+		header.push_back(0);
+		header.push_back(0);
+		header.push_back(0);
+		writeChunk(fp, "IHDR", &header[0], header.size());
+		writeChunk(fp, "IDAT", &work[0], work.size());
+		writeChunk(fp, "IEND", NULL, 0);
+		fclose(fp);
+	}
+
+	// 32bit の値をビッグエンディアンで格納する
+	static void store(GLubyte *p, unsigned int n) {
+		p[0] = static_cast<GLubyte>(n >> 24);
+		p[1] = static_cast<GLubyte>(n >> 16);
+		p[2] = static_cast<GLubyte>(n >> 8);
+		p[3] = static_cast<GLubyte>(n);
+	}
+
+	// 32bit の値をビッグエンディアンで追加する
+	static void putBE(std::vector<GLubyte> &v, unsigned int n) {
+		GLubyte p[4];
+		store(p, n);
+		v.insert(v.end(), p, p + 4);
+	}
+
+	// CRC-32 の表を作る
+	static std::vector<unsigned int> crcTable() {
+		std::vector<unsigned int> table(256);
+		for (unsigned int n = 0; n < 256; n++) {
+			unsigned int c(n);
+			for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0xedb88320u & (0u - (c & 1u)));
+			table[n] = c;
+		}
+		return table;
+	}
+
+	// PNG のチャンクを書き出す
+	static void writeChunk(FILE *fp, const char *type, const GLubyte *data, size_t size) {
+		// CRC はチャンクの種類とデータについて求める
+		static const std::vector<unsigned int> table(crcTable());
+		unsigned int crc(0xffffffffu);
+		for (int i = 0; i < 4; i++) {
+			crc = table[(crc ^ static_cast<GLubyte>(type[i])) & 0xff] ^ (crc >> 8);
+		}
+		for (size_t i = 0; i < size; i++) {
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		}
+
+		GLubyte length[4], check[4];
+		store(length, static_cast<unsigned int>(size));
+		store(check, crc ^ 0xffffffffu);
+		fwrite(length, 1, 4, fp);
+		fwrite(type, 1, 4, fp);
+		if (size > 0) fwrite(data, 1, size, fp);
+		fwrite(check, 1, 4, fp);
+	}
+};
@@ -0,0 +1,749 @@
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+#include <map>
+#include <GL/glew.h>
+
+// OpenGL の呼び出しの記録
+//  GLEW の関数ポインタを差し替えて，バッファオブジェクトと頂点配列オブジェクトの操作，
+//  プログラムオブジェクトのリンク，glUseProgram, glUniform*, 描画の呼び出しをファイルに書き出す．
+//  glDrawArrays と glDrawElements は GLEW を通らないので drawArrays(), drawElements() から呼ぶ
+//  （インスタンス描画もここから呼ぶ）．プリミティブリスタートの切り替えも primitiveRestart() から行う．
+//  記録を始めたときに残っているバッファの内容と頂点配列やプログラム，uniform 変数の値は
+//  最初にまとめて書き出すので，記録したフレームだけを tools/GlReplay で再生できる．
+//  テクスチャとフレームバッファオブジェクトは記録しない．描画スレッドからだけ使う
+//
+//  ファイルの形式（リトルエンディアン）
+//   0: "GLT1"
+//   4 以降: 記録の種類 (uint8_t), 内容の長さ (uint32_t), 内容 を繰り返す
+class GlTrace {
+public:
+	// 記録の種類
+	enum Op {
+		FRAME_BEGIN = 1,			// ビューポート (int32_t x 4), 消去色 (float x 4), デプステスト, 背面カリング (uint8_t x 2)
+		FRAME_END,					// なし
+		GEN_BUFFER,					// 名前
+		DELETE_BUFFER,				// 名前
+		BIND_BUFFER,				// ターゲット, 名前
+		BUFFER_DATA,				// ターゲット, 使い方, 長さ (uint64_t), 内容の有無 (uint8_t), 内容
+		BUFFER_SUB_DATA,			// ターゲット, 位置 (uint64_t), 長さ (uint64_t), 内容
+		GEN_VERTEX_ARRAY,			// 名前
+		DELETE_VERTEX_ARRAY,		// 名前
+		BIND_VERTEX_ARRAY,			// 名前
+		VERTEX_ATTRIB_POINTER,		// 番号, 要素数, 型, 正規化 (uint8_t), 間隔, 位置 (uint64_t)
+		ENABLE_VERTEX_ATTRIB,		// 番号
+		DISABLE_VERTEX_ATTRIB,		// 番号
+		PROGRAM,					// 名前, シェーダ, attribute 変数, 出力変数, uniform 変数の一覧
+		DELETE_PROGRAM,				// 名前
+		USE_PROGRAM,				// 名前
+		UNIFORM,					// 種類, 場所, 数, 転置 (uint8_t), 値
+		DRAW_ARRAYS,				// 基本図形, 最初の頂点, 頂点の数
+		DRAW_ELEMENTS,				// 基本図形, 要素数, 型, 位置 (uint64_t), 頂点番号に足す値
+		DRAW_ARRAYS_INSTANCED,		// DRAW_ARRAYS に続けてインスタンスの数
+		DRAW_ELEMENTS_INSTANCED,	// DRAW_ELEMENTS に続けてインスタンスの数
+		PRIMITIVE_RESTART,			// 有効 (uint8_t), 区切りのインデックス
+		OP_COUNT
+	};
+
+	// uniform 変数の種類
+	enum Uniform {
+		UNIFORM_1IV, UNIFORM_1FV, UNIFORM_2FV, UNIFORM_3FV, UNIFORM_4FV,
+		UNIFORM_MATRIX_3FV, UNIFORM_MATRIX_4FV, UNIFORM_MATRIX_4X3FV, UNIFORM_COUNT
+	};
+
+	// uniform 変数の種類ごとの要素数
+	static int components(int kind) {
+		static const int n[] = { 1, 1, 2, 3, 4, 9, 16, 12 };
+		return kind >= 0 && kind < UNIFORM_COUNT ? n[kind] : 0;
+	}
+
+	// コンストラクタ
+	//  name: 記録するファイル名
+	//  glewInit() の後，記録したいオブジェクトを作る前に作る
+	GlTrace(const char *name)
+		: file(std::fopen(name, "wb")), pending(0), remaining(0), recording(false), frames(0), bytes(0)
+	{
+		if (file == NULL) {
+			std::fprintf(stderr, "Can't open trace file: %s\n", name);
+			return;
+		}
+		std::fwrite("GLT1", 1, 4, file);
+		bytes = 4;
+
+		// GLEW の関数ポインタを差し替える
+		instance() = this;
+		hook(__glewGenBuffers, real.genBuffers, genBuffers);
+		hook(__glewDeleteBuffers, real.deleteBuffers, deleteBuffers);
+		hook(__glewBindBuffer, real.bindBuffer, bindBuffer);
+		hook(__glewBufferData, real.bufferData, bufferData);
+		hook(__glewBufferSubData, real.bufferSubData, bufferSubData);
+		hook(__glewGenVertexArrays, real.genVertexArrays, genVertexArrays);
+		hook(__glewDeleteVertexArrays, real.deleteVertexArrays, deleteVertexArrays);
+		hook(__glewBindVertexArray, real.bindVertexArray, bindVertexArray);
+		hook(__glewVertexAttribPointer, real.vertexAttribPointer, vertexAttribPointer);
+		hook(__glewEnableVertexAttribArray, real.enableVertexAttribArray, enableVertexAttribArray);
+		hook(__glewDisableVertexAttribArray, real.disableVertexAttribArray, disableVertexAttribArray);
+		hook(__glewBindFragDataLocation, real.bindFragDataLocation, bindFragDataLocation);
+		hook(__glewLinkProgram, real.linkProgram, linkProgram);
+		hook(__glewDeleteProgram, real.deleteProgram, deleteProgram);
+		hook(__glewUseProgram, real.useProgram, useProgram);
+		hook(__glewUniform1i, real.uniform1i, uniform1i);
+		hook(__glewUniform1f, real.uniform1f, uniform1f);
+		hook(__glewUniform1iv, real.uniform1iv, uniform1iv);
+		hook(__glewUniform1fv, real.uniform1fv, uniform1fv);
+		hook(__glewUniform2fv, real.uniform2fv, uniform2fv);
+		hook(__glewUniform3fv, real.uniform3fv, uniform3fv);
+		hook(__glewUniform4fv, real.uniform4fv, uniform4fv);
+		hook(__glewUniformMatrix3fv, real.uniformMatrix3fv, uniformMatrix3fv);
+		hook(__glewUniformMatrix4fv, real.uniformMatrix4fv, uniformMatrix4fv);
+		hook(__glewUniformMatrix4x3fv, real.uniformMatrix4x3fv, uniformMatrix4x3fv);
+		hook(__glewDrawElementsBaseVertex, real.drawElementsBaseVertex, drawElementsBaseVertex);
+	}
+
+	// デストラクタ
+	virtual ~GlTrace() {
+		if (file == NULL) return;
+
+		// 関数ポインタを元に戻す
+		__glewGenBuffers = real.genBuffers;
+		__glewDeleteBuffers = real.deleteBuffers;
+		__glewBindBuffer = real.bindBuffer;
+		__glewBufferData = real.bufferData;
+		__glewBufferSubData = real.bufferSubData;
+		__glewGenVertexArrays = real.genVertexArrays;
+		__glewDeleteVertexArrays = real.deleteVertexArrays;
+		__glewBindVertexArray = real.bindVertexArray;
+		__glewVertexAttribPointer = real.vertexAttribPointer;
+		__glewEnableVertexAttribArray = real.enableVertexAttribArray;
+		__glewDisableVertexAttribArray = real.disableVertexAttribArray;
+		__glewBindFragDataLocation = real.bindFragDataLocation;
+		__glewLinkProgram = real.linkProgram;
+		__glewDeleteProgram = real.deleteProgram;
+		__glewUseProgram = real.useProgram;
+		__glewUniform1i = real.uniform1i;
+		__glewUniform1f = real.uniform1f;
+		__glewUniform1iv = real.uniform1iv;
+		__glewUniform1fv = real.uniform1fv;
+		__glewUniform2fv = real.uniform2fv;
+		__glewUniform3fv = real.uniform3fv;
+		__glewUniform4fv = real.uniform4fv;
+		__glewUniformMatrix3fv = real.uniformMatrix3fv;
+		__glewUniformMatrix4fv = real.uniformMatrix4fv;
+		__glewUniformMatrix4x3fv = real.uniformMatrix4x3fv;
+		__glewDrawElementsBaseVertex = real.drawElementsBaseVertex;
+		instance() = NULL;
+
+		std::fclose(file);
+	}
+
+	// ファイルが開けたか
+	bool isValid() const { return file != NULL; }
+
+	// 次の beginFrame() から frames フレームを記録する
+	void capture(int frames) {
+		if (file != NULL && !recording) pending = frames;
+	}
+
+	// フレームの始まり（記録中ならビューポートと消去色を書き出す）
+	void beginFrame() {
+		if (pending > 0) {
+			// 記録を始めるときは今の状態を書き出す
+			remaining = pending;
+			pending = 0;
+			recording = true;
+			snapshot();
+		}
+		if (!recording) return;
+
+		GLint viewport[4];
+		GLfloat clear[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glGetFloatv(GL_COLOR_CLEAR_VALUE, clear);
+		put(viewport, sizeof viewport);
+		put(clear, sizeof clear);
+		put(static_cast<uint8_t>(glIsEnabled(GL_DEPTH_TEST)));
+		put(static_cast<uint8_t>(glIsEnabled(GL_CULL_FACE)));
+		write(FRAME_BEGIN);
+	}
+
+	// フレームの終わり（指定したフレーム数を記録したら止める）
+	void endFrame() {
+		if (!recording) return;
+		write(FRAME_END);
+		++frames;
+		if (--remaining <= 0) {
+			recording = false;
+			std::fflush(file);
+		}
+	}
+
+	// 記録中か
+	bool isRecording() const { return recording; }
+
+	// 記録したフレームの数と書き出した長さを返す
+	int getFrameCount() const { return frames; }
+	uint64_t getByteCount() const { return bytes; }
+
+	// glDrawArrays を呼んで記録する
+	//  instances: 1 でなければ glDrawArraysInstanced で描く
+	static void drawArrays(GLenum mode, GLint first, GLsizei count, GLsizei instances = 1) {
+		if (instances == 1) glDrawArrays(mode, first, count);
+		else glDrawArraysInstanced(mode, first, count, instances);
+		GlTrace *const t(instance());
+		if (t == NULL || !t->recording) return;
+		t->put(mode);
+		t->put(first);
+		t->put(count);
+		if (instances != 1) t->put(instances);
+		t->write(instances == 1 ? DRAW_ARRAYS : DRAW_ARRAYS_INSTANCED);
+	}
+
+	// glDrawElements を呼んで記録する
+	//  instances: 1 でなければ glDrawElementsInstanced で描く
+	static void drawElements(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances = 1) {
+		if (instances == 1) glDrawElements(mode, count, type, indices);
+		else glDrawElementsInstanced(mode, count, type, indices, instances);
+		GlTrace *const t(instance());
+		if (t != NULL && t->recording) t->elements(mode, count, type, indices, 0, instances);
+	}
+
+	// プリミティブリスタートを切り替えて記録する
+	//  enable: 有効にするか
+	//  index: 図形を区切るインデックス
+	static void primitiveRestart(bool enable, GLuint index = 0xffffffff) {
+		if (enable) {
+			glEnable(GL_PRIMITIVE_RESTART);
+			glPrimitiveRestartIndex(index);
+		}
+		else glDisable(GL_PRIMITIVE_RESTART);
+		GlTrace *const t(instance());
+		if (t == NULL || !t->recording) return;
+		t->put(static_cast<uint8_t>(enable));
+		t->put(index);
+		t->write(PRIMITIVE_RESTART);
+	}
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	GlTrace(const GlTrace &t);
+
+	// 代入によるコピー禁止
+	GlTrace &operator=(const GlTrace &t);
+
+	// 差し替える前の関数
+	struct Functions {
+		PFNGLGENBUFFERSPROC genBuffers;
+		PFNGLDELETEBUFFERSPROC deleteBuffers;
+		PFNGLBINDBUFFERPROC bindBuffer;
+		PFNGLBUFFERDATAPROC bufferData;
+		PFNGLBUFFERSUBDATAPROC bufferSubData;
+		PFNGLGENVERTEXARRAYSPROC genVertexArrays;
+		PFNGLDELETEVERTEXARRAYSPROC deleteVertexArrays;
+		PFNGLBINDVERTEXARRAYPROC bindVertexArray;
+		PFNGLVERTEXATTRIBPOINTERPROC vertexAttribPointer;
+		PFNGLENABLEVERTEXATTRIBARRAYPROC enableVertexAttribArray;
+		PFNGLDISABLEVERTEXATTRIBARRAYPROC disableVertexAttribArray;
+		PFNGLBINDFRAGDATALOCATIONPROC bindFragDataLocation;
+		PFNGLLINKPROGRAMPROC linkProgram;
+		PFNGLDELETEPROGRAMPROC deleteProgram;
+		PFNGLUSEPROGRAMPROC useProgram;
+		PFNGLUNIFORM1IPROC uniform1i;
+		PFNGLUNIFORM1FPROC uniform1f;
+		PFNGLUNIFORM1IVPROC uniform1iv;
+		PFNGLUNIFORM1FVPROC uniform1fv;
+		PFNGLUNIFORM2FVPROC uniform2fv;
+		PFNGLUNIFORM3FVPROC uniform3fv;
+		PFNGLUNIFORM4FVPROC uniform4fv;
+		PFNGLUNIFORMMATRIX3FVPROC uniformMatrix3fv;
+		PFNGLUNIFORMMATRIX4FVPROC uniformMatrix4fv;
+		PFNGLUNIFORMMATRIX4X3FVPROC uniformMatrix4x3fv;
+		PFNGLDRAWELEMENTSBASEVERTEXPROC drawElementsBaseVertex;
+	} real;
+
+	// リンクしたプログラムオブジェクト
+	struct Program {
+		// 書き出す記録の内容
+		std::vector<unsigned char> record;
+		// uniform 変数の場所と型
+		std::vector<std::pair<GLint, GLenum>> uniforms;
+	};
+
+	// glBindFragDataLocation で指定した出力変数
+	struct FragData {
+		GLuint program;
+		GLuint color;
+		std::string name;
+	};
+
+	// 記録するファイル
+	FILE *const file;
+
+	// 記録を始めるフレームの数と残りのフレームの数
+	int pending, remaining;
+
+	// 記録中か
+	bool recording;
+
+	// 記録したフレームの数と書き出した長さ
+	int frames;
+	uint64_t bytes;
+
+	// 作成されているバッファオブジェクトと頂点配列オブジェクト
+	std::set<GLuint> buffers, arrays;
+
+	// リンクしたプログラムオブジェクト
+	std::map<GLuint, Program> programs;
+
+	// リンク前に指定された出力変数
+	std::vector<FragData> fragData;
+
+	// 書き出し中の記録の内容
+	std::vector<unsigned char> record;
+
+	// 記録しているインスタンス
+	static GlTrace *&instance() {
+		static GlTrace *trace(NULL);
+		return trace;
+	}
+
+	// 関数ポインタを差し替える
+	template <typename F>
+	static void hook(F &glew, F &saved, F replacement) {
+		saved = glew;
+		glew = replacement;
+	}
+
+	// 記録の内容を追加する
+	void put(const void *data, size_t size) {
+		const unsigned char *const p(static_cast<const unsigned char *>(data));
+		record.insert(record.end(), p, p + size);
+	}
+	template <typename T>
+	void put(const T &value) {
+		put(&value, sizeof value);
+	}
+	void put(const std::string &s) {
+		put(static_cast<uint32_t>(s.size()));
+		put(s.data(), s.size());
+	}
+
+	// 記録を一つ書き出す
+	void write(Op op) {
+		const uint8_t code(static_cast<uint8_t>(op));
+		const uint32_t size(static_cast<uint32_t>(record.size()));
+		std::fwrite(&code, 1, 1, file);
+		std::fwrite(&size, 4, 1, file);
+		if (size > 0) std::fwrite(record.data(), 1, size, file);
+		bytes += 5 + size;
+		record.clear();
+	}
+
+	// 名前一つの記録を書き出す
+	void name(Op op, GLuint n) {
+		put(n);
+		write(op);
+	}
+
+	// glDrawElements の記録を書き出す
+	void elements(GLenum mode, GLsizei count, GLenum type, const void *indices, GLint basevertex,
+		GLsizei instances = 1) {
+		put(mode);
+		put(count);
+		put(type);
+		put(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(indices)));
+		put(basevertex);
+		if (instances != 1) put(instances);
+		write(instances == 1 ? DRAW_ELEMENTS : DRAW_ELEMENTS_INSTANCED);
+	}
+
+	// glUniform* の記録を書き出す
+	void uniform(Uniform kind, GLint location, GLsizei count, GLboolean transpose, const void *value) {
+		put(static_cast<uint32_t>(kind));
+		put(location);
+		put(count);
+		put(static_cast<uint8_t>(transpose));
+		put(value, size_t(count) * components(kind) * 4);
+		write(UNIFORM);
+	}
+
+	// 記録を始めたときの状態を書き出す
+	void snapshot() {
+		GLint buffer, array, program;
+		glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &buffer);
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &array);
+		glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+		// バッファオブジェクトの内容
+		std::vector<unsigned char> data;
+		for (const GLuint b : buffers) {
+			name(GEN_BUFFER, b);
+			real.bindBuffer(GL_ARRAY_BUFFER, b);
+			GLint size, usage;
+			glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+			glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_USAGE, &usage);
+			if (size <= 0) continue;
+			data.resize(size);
+			glGetBufferSubData(GL_ARRAY_BUFFER, 0, size, data.data());
+			put(static_cast<GLenum>(GL_ARRAY_BUFFER));
+			put(b);
+			write(BIND_BUFFER);
+			put(static_cast<GLenum>(GL_ARRAY_BUFFER));
+			put(static_cast<GLenum>(usage));
+			put(static_cast<uint64_t>(size));
+			put(static_cast<uint8_t>(1));
+			put(data.data(), data.size());
+			write(BUFFER_DATA);
+		}
+
+		// 頂点配列オブジェクトの attribute 変数の設定
+		GLint attribs;
+		glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &attribs);
+		for (const GLuint a : arrays) {
+			name(GEN_VERTEX_ARRAY, a);
+			name(BIND_VERTEX_ARRAY, a);
+			real.bindVertexArray(a);
+			GLint element;
+			glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &element);
+			put(static_cast<GLenum>(GL_ELEMENT_ARRAY_BUFFER));
+			put(static_cast<GLuint>(element));
+			write(BIND_BUFFER);
+			for (GLint i = 0; i < attribs; i++) {
+				GLint enabled, binding, size, type, normalized, stride;
+				GLvoid *pointer;
+				glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+				glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &binding);
+				if (!enabled && binding == 0) continue;
+				glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_SIZE, &size);
+				glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
+				glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &normalized);
+				glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+				glGetVertexAttribPointerv(i, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+				put(static_cast<GLenum>(GL_ARRAY_BUFFER));
+				put(static_cast<GLuint>(binding));
+				write(BIND_BUFFER);
+				attribPointer(i, size, type, static_cast<GLboolean>(normalized), stride, pointer);
+				if (enabled) name(ENABLE_VERTEX_ATTRIB, i);
+			}
+		}
+
+		// プログラムオブジェクトと uniform 変数の値
+		GLfloat value[16];
+		for (const auto &p : programs) {
+			put(p.second.record.data(), p.second.record.size());
+			write(PROGRAM);
+			name(USE_PROGRAM, p.first);
+			real.useProgram(p.first);
+			for (const auto &u : p.second.uniforms) {
+				const Uniform kind(uniformKind(u.second));
+				if (kind == UNIFORM_COUNT) continue;
+				if (kind == UNIFORM_1IV) glGetUniformiv(p.first, u.first, reinterpret_cast<GLint *>(value));
+				else glGetUniformfv(p.first, u.first, value);
+				uniform(kind, u.first, 1, GL_FALSE, value);
+			}
+		}
+
+		// 結合の状態を戻す
+		real.bindBuffer(GL_ARRAY_BUFFER, buffer);
+		real.bindVertexArray(array);
+		real.useProgram(program);
+		put(static_cast<GLenum>(GL_ARRAY_BUFFER));
+		put(static_cast<GLuint>(buffer));
+		write(BIND_BUFFER);
+		name(BIND_VERTEX_ARRAY, array);
+		name(USE_PROGRAM, program);
+	}
+
+	// uniform 変数の型から記録の種類を求める（記録しない型なら UNIFORM_COUNT）
+	static Uniform uniformKind(GLenum type) {
+		switch (type) {
+		case GL_INT: case GL_BOOL:
+		case GL_SAMPLER_2D: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_CUBE: case GL_SAMPLER_BUFFER:
+			return UNIFORM_1IV;
+		case GL_FLOAT: return UNIFORM_1FV;
+		case GL_FLOAT_VEC2: return UNIFORM_2FV;
+		case GL_FLOAT_VEC3: return UNIFORM_3FV;
+		case GL_FLOAT_VEC4: return UNIFORM_4FV;
+		case GL_FLOAT_MAT3: return UNIFORM_MATRIX_3FV;
+		case GL_FLOAT_MAT4: return UNIFORM_MATRIX_4FV;
+		case GL_FLOAT_MAT4x3: return UNIFORM_MATRIX_4X3FV;
+		}
+		return UNIFORM_COUNT;
+	}
+
+	// glVertexAttribPointer の記録を書き出す
+	void attribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer) {
+		put(index);
+		put(size);
+		put(type);
+		put(static_cast<uint8_t>(normalized));
+		put(stride);
+		put(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(pointer)));
+		write(VERTEX_ATTRIB_POINTER);
+	}
+
+	// リンクしたプログラムオブジェクトのシェーダと変数の場所を調べて記録の内容を作る
+	void link(GLuint program) {
+		GLint status;
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status == GL_FALSE) return;
+		Program &p(programs[program]);
+		p.uniforms.clear();
+		put(program);
+
+		// シェーダのソースプログラム
+		GLuint shader[8];
+		GLsizei count;
+		glGetAttachedShaders(program, 8, &count, shader);
+		put(static_cast<uint32_t>(count));
+		for (GLsizei i = 0; i < count; i++) {
+			GLint type, length;
+			glGetShaderiv(shader[i], GL_SHADER_TYPE, &type);
+			glGetShaderiv(shader[i], GL_SHADER_SOURCE_LENGTH, &length);
+			std::vector<GLchar> source(length > 0 ? length : 1, '\0');
+			glGetShaderSource(shader[i], static_cast<GLsizei>(source.size()), NULL, source.data());
+			put(static_cast<GLenum>(type));
+			put(std::string(source.data()));
+		}
+
+		// attribute 変数の場所
+		GLint n, size;
+		GLenum type;
+		GLchar buffer[256];
+		glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &n);
+		put(static_cast<uint32_t>(n));
+		for (GLint i = 0; i < n; i++) {
+			glGetActiveAttrib(program, i, sizeof buffer, NULL, &size, &type, buffer);
+			put(glGetAttribLocation(program, buffer));
+			put(std::string(buffer));
+		}
+
+		// 出力変数の場所
+		uint32_t outputs(0);
+		for (const FragData &f : fragData) if (f.program == program) ++outputs;
+		put(outputs);
+		for (const FragData &f : fragData) {
+			if (f.program != program) continue;
+			put(static_cast<GLint>(f.color));
+			put(f.name);
+		}
+
+		// uniform 変数の場所（配列は要素ごと）
+		std::vector<std::pair<GLint, std::string>> table;
+		glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &n);
+		for (GLint i = 0; i < n; i++) {
+			glGetActiveUniform(program, i, sizeof buffer, NULL, &size, &type, buffer);
+			std::string base(buffer);
+			if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0) base.resize(base.size() - 3);
+			for (GLint e = 0; e < size; e++) {
+				const std::string element(size > 1 ? base + "[" + std::to_string(e) + "]" : base);
+				const GLint location(glGetUniformLocation(program, element.c_str()));
+				if (location < 0) continue;
+				table.push_back(std::make_pair(location, element));
+				p.uniforms.push_back(std::make_pair(location, type));
+			}
+		}
+		put(static_cast<uint32_t>(table.size()));
+		for (const auto &u : table) {
+			put(u.first);
+			put(u.second);
+		}
+		p.record = record;
+		if (recording) write(PROGRAM);
+		else record.clear();
+	}
+
+	// 差し替えた関数
+	static void GLAPIENTRY genBuffers(GLsizei n, GLuint *names) {
+		GlTrace &t(*instance());
+		t.real.genBuffers(n, names);
+		for (GLsizei i = 0; i < n; i++) {
+			t.buffers.insert(names[i]);
+			if (t.recording) t.name(GEN_BUFFER, names[i]);
+		}
+	}
+
+	static void GLAPIENTRY deleteBuffers(GLsizei n, const GLuint *names) {
+		GlTrace &t(*instance());
+		for (GLsizei i = 0; i < n; i++) {
+			t.buffers.erase(names[i]);
+			if (t.recording) t.name(DELETE_BUFFER, names[i]);
+		}
+		t.real.deleteBuffers(n, names);
+	}
+
+	static void GLAPIENTRY bindBuffer(GLenum target, GLuint buffer) {
+		GlTrace &t(*instance());
+		t.real.bindBuffer(target, buffer);
+		if (!t.recording) return;
+		t.put(target);
+		t.put(buffer);
+		t.write(BIND_BUFFER);
+	}
+
+	static void GLAPIENTRY bufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage) {
+		GlTrace &t(*instance());
+		t.real.bufferData(target, size, data, usage);
+		if (!t.recording) return;
+		t.put(target);
+		t.put(usage);
+		t.put(static_cast<uint64_t>(size));
+		t.put(static_cast<uint8_t>(data != NULL));
+		if (data != NULL) t.put(data, size);
+		t.write(BUFFER_DATA);
+	}
+
+	static void GLAPIENTRY bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data) {
+		GlTrace &t(*instance());
+		t.real.bufferSubData(target, offset, size, data);
+		if (!t.recording) return;
+		t.put(target);
+		t.put(static_cast<uint64_t>(offset));
+		t.put(static_cast<uint64_t>(size));
+		t.put(data, size);
+		t.write(BUFFER_SUB_DATA);
+	}
+
+	static void GLAPIENTRY genVertexArrays(GLsizei n, GLuint *names) {
+		GlTrace &t(*instance());
+		t.real.genVertexArrays(n, names);
+		for (GLsizei i = 0; i < n; i++) {
+			t.arrays.insert(names[i]);
+			if (t.recording) t.name(GEN_VERTEX_ARRAY, names[i]);
+		}
+	}
+
+	static void GLAPIENTRY deleteVertexArrays(GLsizei n, const GLuint *names) {
+		GlTrace &t(*instance());
+		for (GLsizei i = 0; i < n; i++) {
+			t.arrays.erase(names[i]);
+			if (t.recording) t.name(DELETE_VERTEX_ARRAY, names[i]);
+		}
+		t.real.deleteVertexArrays(n, names);
+	}
+
+	static void GLAPIENTRY bindVertexArray(GLuint array) {
+		GlTrace &t(*instance());
+		t.real.bindVertexArray(array);
+		if (t.recording) t.name(BIND_VERTEX_ARRAY, array);
+	}
+
+	static void GLAPIENTRY vertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized,
+		GLsizei stride, const void *pointer) {
+		GlTrace &t(*instance());
+		t.real.vertexAttribPointer(index, size, type, normalized, stride, pointer);
+		if (t.recording) t.attribPointer(index, size, type, normalized, stride, pointer);
+	}
+
+	static void GLAPIENTRY enableVertexAttribArray(GLuint index) {
+		GlTrace &t(*instance());
+		t.real.enableVertexAttribArray(index);
+		if (t.recording) t.name(ENABLE_VERTEX_ATTRIB, index);
+	}
+
+	static void GLAPIENTRY disableVertexAttribArray(GLuint index) {
+		GlTrace &t(*instance());
+		t.real.disableVertexAttribArray(index);
+		if (t.recording) t.name(DISABLE_VERTEX_ATTRIB, index);
+	}
+
+	static void GLAPIENTRY bindFragDataLocation(GLuint program, GLuint color, const GLchar *name) {
+		GlTrace &t(*instance());
+		t.real.bindFragDataLocation(program, color, name);
+		const FragData f = { program, color, name };
+		t.fragData.push_back(f);
+	}
+
+	static void GLAPIENTRY linkProgram(GLuint program) {
+		GlTrace &t(*instance());
+		t.real.linkProgram(program);
+		t.link(program);
+	}
+
+	static void GLAPIENTRY deleteProgram(GLuint program) {
+		GlTrace &t(*instance());
+		t.real.deleteProgram(program);
+		t.programs.erase(program);
+		for (size_t i = t.fragData.size(); i-- > 0;) {
+			if (t.fragData[i].program == program) t.fragData.erase(t.fragData.begin() + i);
+		}
+		if (t.recording) t.name(DELETE_PROGRAM, program);
+	}
+
+	static void GLAPIENTRY useProgram(GLuint program) {
+		GlTrace &t(*instance());
+		t.real.useProgram(program);
+		if (t.recording) t.name(USE_PROGRAM, program);
+	}
+
+	static void GLAPIENTRY uniform1i(GLint location, GLint v0) {
+		GlTrace &t(*instance());
+		t.real.uniform1i(location, v0);
+		if (t.recording) t.uniform(UNIFORM_1IV, location, 1, GL_FALSE, &v0);
+	}
+
+	static void GLAPIENTRY uniform1f(GLint location, GLfloat v0) {
+		GlTrace &t(*instance());
+		t.real.uniform1f(location, v0);
+		if (t.recording) t.uniform(UNIFORM_1FV, location, 1, GL_FALSE, &v0);
+	}
+
+	static void GLAPIENTRY uniform1iv(GLint location, GLsizei count, const GLint *value) {
+		GlTrace &t(*instance());
+		t.real.uniform1iv(location, count, value);
+		if (t.recording) t.uniform(UNIFORM_1IV, location, count, GL_FALSE, value);
+	}
+
+	static void GLAPIENTRY uniform1fv(GLint location, GLsizei count, const GLfloat *value) {
+		GlTrace &t(*instance());
+		t.real.uniform1fv(location, count, value);
+		if (t.recording) t.uniform(UNIFORM_1FV, location, count, GL_FALSE, value);
+	}
+
+	static void GLAPIENTRY uniform2fv(GLint location, GLsizei count, const GLfloat *value) {
+		GlTrace &t(*instance());
+		t.real.uniform2fv(location, count, value);
+		if (t.recording) t.uniform(UNIFORM_2FV, location, count, GL_FALSE, value);
+	}
+
+	static void GLAPIENTRY uniform3fv(GLint location, GLsizei count, const GLfloat *value) {
+		GlTrace &t(*instance());
+		t.real.uniform3fv(location, count, value);
+		if (t.recording) t.uniform(UNIFORM_3FV, location, count, GL_FALSE, value);
+	}
+
+	static void GLAPIENTRY uniform4fv(GLint location, GLsizei count, const GLfloat *value) {
+		GlTrace &t(*instance());
+		t.real.uniform4fv(location, count, value);
+		if (t.recording) t.uniform(UNIFORM_4FV, location, count, GL_FALSE, value);
+	}
+
+	static void GLAPIENTRY uniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
+		GlTrace &t(*instance());
+		t.real.uniformMatrix3fv(location, count, transpose, value);
+		if (t.recording) t.uniform(UNIFORM_MATRIX_3FV, location, count, transpose, value);
+	}
+
+	static void GLAPIENTRY uniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
+		GlTrace &t(*instance());
+		t.real.uniformMatrix4fv(location, count, transpose, value);
+		if (t.recording) t.uniform(UNIFORM_MATRIX_4FV, location, count, transpose, value);
+	}
+
+	static void GLAPIENTRY uniformMatrix4x3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
+		GlTrace &t(*instance());
+		t.real.uniformMatrix4x3fv(location, count, transpose, value);
+		if (t.recording) t.uniform(UNIFORM_MATRIX_4X3FV, location, count, transpose, value);
+	}
+
+	static void GLAPIENTRY drawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices,
+		GLint basevertex) {
+		GlTrace &t(*instance());
+		t.real.drawElementsBaseVertex(mode, count, type, indices, basevertex);
+		if (t.recording) t.elements(mode, count, type, indices, basevertex);
+	}
+};
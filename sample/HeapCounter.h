@@ -0,0 +1,26 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// ヒープの確保の回数と大きさを数える
+//  数えるには operator new をこのカウンタを増やすものに置き換えておく
+class HeapCounter {
+public:
+	// 確保の回数
+	static std::atomic<size_t> &allocations() {
+		static std::atomic<size_t> count(0);
+		return count;
+	}
+
+	// 確保した大きさの合計
+	static std::atomic<size_t> &bytes() {
+		static std::atomic<size_t> total(0);
+		return total;
+	}
+
+	// 確保を記録する
+	static void record(size_t size) {
+		allocations().fetch_add(1, std::memory_order_relaxed);
+		bytes().fetch_add(size, std::memory_order_relaxed);
+	}
+};
@@ -0,0 +1,310 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include <GL/glew.h>
+#include "Object.h"
+#include "Matrix.h"
+#include "Affine.h"
+#include "Program.h"
+
+// 物体の視錐台カリングと描画の発行を GPU で行う
+//  形状の頂点とインデックスは一つの頂点バッファとインデックスバッファにまとめ，
+//  物体ごとの変換行列と境界ボックスはシェーダストレージバッファに置く．
+//  cull() ではコンピュートシェーダ (cull.comp) が視錐台の外の物体を除いて
+//  DrawElementsIndirectCommand とモデルビュー変換行列を書き出し，
+//  draw() では glMultiDrawElementsIndirect 一回で見える物体を全部描く．
+//  ARB_indirect_parameters があれば見える物体のコマンドだけを詰めて
+//  glMultiDrawElementsIndirectCountARB で描く．
+//  毎フレームの CPU の処理は物体の数によらない．描画スレッドからだけ使う
+//
+//  描画には indirect.vert を使う．モデルビュー変換行列の 3行は location 4～6 の
+//  インスタンスごとの属性になり，コマンドの baseInstance が物体の番号を指す
+class IndirectRenderer {
+public:
+	// OpenGL 4.3 相当の機能（コンピュートシェーダ，シェーダストレージバッファ，間接描画）があるか
+	static bool isSupported() {
+		return GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object
+			&& GLEW_ARB_multi_draw_indirect);
+	}
+
+	// コンストラクタ
+	//  capacity: 物体の数の上限
+	IndirectRenderer(GLsizei capacity)
+		: capacity(capacity), compact(GLEW_ARB_indirect_parameters != GL_FALSE)
+		, program(loadComputeProgram("cull.comp")), meshChanged(false), dirtyBegin(0), dirtyEnd(0)
+	{
+		viewLoc = glGetUniformLocation(program, "view");
+		projectionLoc = glGetUniformLocation(program, "projection");
+		countLoc = glGetUniformLocation(program, "count");
+		compactLoc = glGetUniformLocation(program, "compact");
+		instance.reserve(capacity);
+
+		// 頂点属性は Object と同じ配置にする
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glGenBuffers(1, &vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Object::Vertex), static_cast<Object::Vertex *>(0)->position);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Object::Vertex), static_cast<Object::Vertex *>(0)->normal);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Object::Vertex), static_cast<Object::Vertex *>(0)->texcoord);
+		glEnableVertexAttribArray(2);
+		glGenBuffers(1, &ibo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+
+		// コンピュートシェーダが書き出すモデルビュー変換行列を物体ごとの属性にする
+		glGenBuffers(1, &modelview);
+		glBindBuffer(GL_ARRAY_BUFFER, modelview);
+		glBufferData(GL_ARRAY_BUFFER, size_t(capacity) * sizeof(GLfloat) * 12, NULL, GL_DYNAMIC_COPY);
+		for (GLuint i = 0; i < 3; i++) {
+			glVertexAttribPointer(4 + i, 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 12, static_cast<GLfloat *>(0) + i * 4);
+			glVertexAttribDivisor(4 + i, 1);
+			glEnableVertexAttribArray(4 + i);
+		}
+		glBindVertexArray(0);
+
+		// 物体，形状，間接描画のコマンド，描画するコマンドの数
+		glGenBuffers(1, &instances);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, instances);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, size_t(capacity) * sizeof(Instance), NULL, GL_DYNAMIC_DRAW);
+		glGenBuffers(1, &meshes);
+		glGenBuffers(1, &commands);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, commands);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, size_t(capacity) * sizeof(Command), NULL, GL_DYNAMIC_COPY);
+		glGenBuffers(1, &parameters);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, parameters);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	// デストラクタ
+	virtual ~IndirectRenderer() {
+		glDeleteProgram(program);
+		glDeleteVertexArrays(1, &vao);
+		const GLuint buffer[] = { vbo, ibo, modelview, instances, meshes, commands, parameters };
+		glDeleteBuffers(sizeof buffer / sizeof buffer[0], buffer);
+	}
+
+	// コンピュートシェーダが使えるか
+	bool isValid() const { return program != 0; }
+
+	// 形状を追加して番号を返す
+	//  vertexcount: 頂点の数
+	//  vertex: 頂点属性を格納した配列
+	//  indexcount: 頂点のインデックスの要素数（0 なら頂点を順に三角形にする）
+	//  index: 頂点のインデックスを格納した配列
+	int addMesh(GLsizei vertexcount, const Object::Vertex *vertex,
+		GLsizei indexcount = 0, const GLuint *index = NULL) {
+		Mesh m = { GLuint(indexcount > 0 ? indexcount : vertexcount), GLuint(this->index.size()),
+			GLint(this->vertex.size()), 0 };
+		mesh.push_back(m);
+		this->vertex.insert(this->vertex.end(), vertex, vertex + vertexcount);
+		if (indexcount > 0) this->index.insert(this->index.end(), index, index + indexcount);
+		else for (GLsizei i = 0; i < vertexcount; i++) this->index.push_back(i);
+
+		// 境界ボックスは物体に写す
+		Bounds b = {};
+		for (GLsizei i = 0; i < vertexcount; i++) {
+			for (int k = 0; k < 3; k++) {
+				const GLfloat p(vertex[i].position[k]);
+				if (i == 0 || p < b.lo[k]) b.lo[k] = p;
+				if (i == 0 || p > b.hi[k]) b.hi[k] = p;
+			}
+		}
+		bounds.push_back(b);
+		meshChanged = true;
+		return static_cast<int>(mesh.size() - 1);
+	}
+
+	// 物体を追加して番号を返す（上限を超えたら -1）
+	//  mesh: 形状の番号
+	//  transform: 形状に適用する変換
+	int add(int mesh, const Affine &transform) {
+		if (static_cast<GLsizei>(instance.size()) >= capacity) {
+			std::fprintf(stderr, "Too many objects for indirect rendering: %d\n", capacity);
+			return -1;
+		}
+		Instance o;
+		const Bounds &b(bounds[mesh]);
+		std::copy(b.lo, b.lo + 3, o.lo);
+		std::copy(b.hi, b.hi + 3, o.hi);
+		o.mesh = mesh;
+		o.pad = 0;
+		instance.push_back(o);
+		const int i(static_cast<int>(instance.size() - 1));
+		setTransform(i, transform);
+		return i;
+	}
+
+	// 物体の変換を変える（次の cull() で転送する）
+	//  i: 物体の番号
+	//  transform: 形状に適用する変換
+	void setTransform(int i, const Affine &transform) {
+		const GLfloat *const m(transform.data());
+		for (int r = 0; r < 3; r++) {
+			GLfloat *const row(instance[i].row[r]);
+			row[0] = m[r];
+			row[1] = m[3 + r];
+			row[2] = m[6 + r];
+			row[3] = m[9 + r];
+		}
+		if (dirtyBegin == dirtyEnd) dirtyBegin = i, dirtyEnd = i + 1;
+		else dirtyBegin = std::min<size_t>(dirtyBegin, i), dirtyEnd = std::max<size_t>(dirtyEnd, i + 1);
+	}
+
+	// 見える物体を選んで間接描画のコマンドを作る
+	//  projection: 投影変換行列
+	//  view: 全ての物体に共通のモデルビュー変換行列
+	void cull(const Matrix &projection, const Affine &view) {
+		if (!isValid() || instance.empty()) return;
+
+		// 追加や変更のあった分を転送する
+		upload();
+
+		// 詰めて書き出すときはコマンドの数を 0 に戻しておく
+		const GLuint zero(0);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, parameters);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof zero, &zero);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		const GLuint buffer[] = { instances, meshes, commands, parameters, modelview };
+		for (GLuint i = 0; i < sizeof buffer / sizeof buffer[0]; i++) {
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, buffer[i]);
+		}
+
+		const GLuint count(static_cast<GLuint>(instance.size()));
+		glUseProgram(program);
+		glUniformMatrix4x3fv(viewLoc, 1, GL_FALSE, view.data());
+		glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, projection.data());
+		glUniform1ui(countLoc, count);
+		glUniform1i(compactLoc, compact);
+		glDispatchCompute((count + groupSize - 1) / groupSize, 1, 1);
+
+		// 書き出したコマンドと頂点属性を描画で読めるようにする
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	}
+
+	// cull() で作ったコマンドで描く
+	//  indirect.vert を使うシェーダプログラムと投影変換行列は呼び出し側で設定しておく
+	void draw() const {
+		if (!isValid() || instance.empty()) return;
+		const GLsizei count(static_cast<GLsizei>(instance.size()));
+		glBindVertexArray(vao);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands);
+		if (compact) {
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, parameters);
+			glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, 0, 0, count, 0);
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+		}
+		else {
+			// 見えない物体のコマンドは instanceCount が 0 になっている
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, count, 0);
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	// 物体の数を返す
+	GLsizei getObjectCount() const { return static_cast<GLsizei>(instance.size()); }
+
+	// 見える物体のコマンドだけを詰めて描くか
+	bool isCompact() const { return compact; }
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	IndirectRenderer(const IndirectRenderer &r);
+
+	// 代入によるコピー禁止
+	IndirectRenderer &operator=(const IndirectRenderer &r);
+
+	// コンピュートシェーダのワークグループの大きさ（cull.comp の local_size_x）
+	static const GLuint groupSize = 256;
+
+	// 物体（cull.comp の Instance と同じ std430 の配置）
+	struct Instance {
+		// 形状に適用する変換行列の 3行
+		GLfloat row[3][4];
+		// 形状の境界ボックスの最小点と形状の番号
+		GLfloat lo[3];
+		GLuint mesh;
+		// 形状の境界ボックスの最大点
+		GLfloat hi[3];
+		GLuint pad;
+	};
+
+	// 形状（cull.comp の Mesh と同じ配置）
+	struct Mesh {
+		GLuint count, firstIndex;
+		GLint baseVertex;
+		GLuint pad;
+	};
+
+	// 間接描画のコマンド（DrawElementsIndirectCommand）
+	struct Command {
+		GLuint count, instanceCount, firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// 形状の境界ボックス
+	struct Bounds {
+		GLfloat lo[3], hi[3];
+	};
+
+	// 物体の数の上限
+	const GLsizei capacity;
+
+	// 見える物体のコマンドだけを詰めて描くか
+	const bool compact;
+
+	// カリングを行うプログラムオブジェクトと uniform 変数の場所
+	const GLuint program;
+	GLint viewLoc, projectionLoc, countLoc, compactLoc;
+
+	// 頂点配列オブジェクトと頂点バッファ，インデックスバッファ，モデルビュー変換行列のバッファ
+	GLuint vao, vbo, ibo, modelview;
+
+	// 物体，形状，間接描画のコマンド，描画するコマンドの数のバッファ
+	GLuint instances, meshes, commands, parameters;
+
+	// 全ての形状の頂点とインデックス
+	std::vector<Object::Vertex> vertex;
+	std::vector<GLuint> index;
+
+	// 形状と形状の境界ボックス
+	std::vector<Mesh> mesh;
+	std::vector<Bounds> bounds;
+
+	// 物体
+	std::vector<Instance> instance;
+
+	// 形状を追加したか
+	bool meshChanged;
+
+	// 転送していない物体の範囲
+	size_t dirtyBegin, dirtyEnd;
+
+	// 追加や変更のあった形状と物体をバッファに転送する
+	void upload() {
+		if (meshChanged) {
+			// 頂点配列オブジェクトの結合を変えないようにコピー用のターゲットで転送する
+			glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+			glBufferData(GL_COPY_WRITE_BUFFER, vertex.size() * sizeof(Object::Vertex), vertex.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, ibo);
+			glBufferData(GL_COPY_WRITE_BUFFER, index.size() * sizeof(GLuint), index.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshes);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, mesh.size() * sizeof(Mesh), mesh.data(), GL_STATIC_DRAW);
+			meshChanged = false;
+		}
+		if (dirtyBegin < dirtyEnd) {
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, instances);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, dirtyBegin * sizeof(Instance),
+				(dirtyEnd - dirtyBegin) * sizeof(Instance), instance.data() + dirtyBegin);
+			dirtyBegin = dirtyEnd = 0;
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+};
@@ -0,0 +1,297 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include "WorkStealingDeque.h"
+
+// ワークスチーリングによるジョブの実行
+//  各ワーカー（と呼び出し元のスレッド）が自分の両端キューを持ち，
+//  空になったら他のキューからジョブを盗む．
+//  wait() で待っている間は呼び出し元のスレッドもジョブを実行する．
+//  依存するカウンタが 0 でないジョブはキューに入れずに待たせておき，0 になったときに入れる．
+//  ワーカー以外でジョブを登録するスレッドは同時に一つまでとする
+class JobSystem {
+public:
+	// 完了を待つためのカウンタ（実行中のジョブの数）
+	typedef std::atomic<int> Counter;
+
+	// ジョブの処理
+	//  data: 登録時に渡したポインタ, begin, end: 処理する範囲
+	typedef void (*Function)(void *data, size_t begin, size_t end);
+
+	// コンストラクタ
+	//  workers: ワーカースレッドの数（負ならハードウェアのスレッド数 - 1）
+	JobSystem(int workers = -1)
+		: quit(false), queued(0), sleeping(0), nextVictim(0), parked(NULL), parkedCount(0)
+	{
+		if (workers < 0) {
+			const int n(static_cast<int>(std::thread::hardware_concurrency()));
+			workers = n > 1 ? n - 1 : 0;
+		}
+
+		// 0 番は呼び出し元のスレッドが使う
+		for (int i = 0; i <= workers; i++) {
+			queues.push_back(std::unique_ptr<Queue>(new Queue));
+		}
+		for (int i = 1; i <= workers; i++) {
+			threads.push_back(std::thread(&JobSystem::worker, this, i));
+		}
+	}
+
+	// デストラクタ
+	virtual ~JobSystem() {
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (std::thread &t : threads) t.join();
+	}
+
+	// ジョブを登録する
+	//  function: ジョブの処理
+	//  data: function に渡すポインタ
+	//  begin, end: function に渡す範囲
+	//  counter: 完了時に減らすカウンタ
+	//  dependency: このカウンタが 0 になるまで実行しない（NULL なら無条件）
+	void run(Function function, void *data, size_t begin, size_t end,
+		Counter &counter, Counter *dependency = NULL) {
+		counter.fetch_add(1, std::memory_order_relaxed);
+
+		Queue &queue(*queues[current()]);
+		Job *const job(&queue.pool[queue.next++ & (poolSize - 1)]);
+		job->function = function;
+		job->data = data;
+		job->begin = begin;
+		job->end = end;
+		job->counter = &counter;
+		job->dependency = dependency;
+		job->next = NULL;
+
+		// 依存するジョブが終わっていなければ終わるまで待たせる
+		if (dependency != NULL && park(job)) return;
+		submit(job);
+	}
+
+	// カウンタが 0 になるまで他のジョブを実行しながら待つ
+	void wait(const Counter &counter) {
+		while (counter.load(std::memory_order_acquire) > 0) {
+			if (!execute()) std::this_thread::yield();
+		}
+	}
+
+	// [0, count) を grain 個ずつに分けて並列に処理し，完了を待つ
+	//  body: body(begin, end) として呼び出す関数オブジェクト
+	template <typename F>
+	void parallel_for(size_t count, size_t grain, const F &body) {
+		if (count == 0) return;
+
+		// 未完了のジョブが置き場からあふれないように分割数を抑える
+		grain = std::max<size_t>(grain, (count + poolSize / 2 - 1) / (poolSize / 2));
+
+		// 一つにしか分けられなければこのスレッドで処理する
+		if (count <= grain) {
+			body(0, count);
+			return;
+		}
+
+		Counter counter(0);
+		for (size_t begin = 0; begin < count; begin += grain) {
+			run(&invoke<F>, const_cast<F *>(&body), begin, std::min(begin + grain, count), counter);
+		}
+		wait(counter);
+	}
+
+	// ワーカースレッドの数を返す
+	unsigned int getWorkerCount() const {
+		return static_cast<unsigned int>(threads.size());
+	}
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	JobSystem(const JobSystem &j);
+
+	// 代入によるコピー禁止
+	JobSystem &operator=(const JobSystem &j);
+
+	// ジョブ
+	struct Job {
+		Function function;
+		void *data;
+		size_t begin, end;
+		Counter *counter;
+		Counter *dependency;
+		Job *next;
+	};
+
+	// 一つのスレッドが同時に登録できるジョブの数
+	//  ジョブは使い回すので，これを超えて未完了のジョブを溜めてはいけない
+	static const size_t poolSize = 4096;
+
+	// スレッドごとのジョブの両端キューと置き場
+	struct Queue {
+		WorkStealingDeque<Job *, poolSize> deque;
+		Job pool[poolSize];
+		size_t next;
+		Queue() : next(0) {}
+	};
+
+	// スレッドごとのキュー
+	std::vector<std::unique_ptr<Queue>> queues;
+
+	// ワーカースレッド
+	std::vector<std::thread> threads;
+
+	// 終了要求
+	bool quit;
+
+	// キューに入っているジョブの数と眠っているワーカーの数
+	std::atomic<int> queued;
+	std::atomic<int> sleeping;
+
+	// 次に盗みに行くキュー
+	std::atomic<unsigned int> nextVictim;
+
+	// ジョブがないときに眠るための排他制御
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+
+	// 依存するカウンタが 0 になるのを待っているジョブのリストとその数
+	Job *parked;
+	std::atomic<int> parkedCount;
+	std::mutex parkedMutex;
+
+	// スレッドがワーカーとして属するジョブシステムとそのキューの番号
+	struct Worker {
+		const JobSystem *owner;
+		unsigned int index;
+	};
+
+	// このスレッドのワーカーとしての情報
+	static Worker &self() {
+		static thread_local Worker w = { NULL, 0 };
+		return w;
+	}
+
+	// このスレッドのキューの番号（このジョブシステムのワーカーでなければ呼び出し元の 0 番）
+	unsigned int current() const {
+		const Worker &w(self());
+		return w.owner == this ? w.index : 0;
+	}
+
+	// parallel_for の関数オブジェクトを呼び出す
+	template <typename F>
+	static void invoke(void *data, size_t begin, size_t end) {
+		(*static_cast<const F *>(data))(begin, end);
+	}
+
+	// ジョブをこのスレッドのキューに入れる（依存するジョブは終わっていること）
+	void submit(Job *job) {
+		if (!queues[current()]->deque.push(job)) {
+			// 満杯ならこの場で実行する
+			finish(job);
+			return;
+		}
+		// 眠りにつこうとしているワーカーと行き違わないように順序一貫で操作する
+		queued.fetch_add(1);
+		if (sleeping.load() > 0) {
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			wake.notify_one();
+		}
+	}
+
+	// ジョブを一つ取り出して実行する
+	//  実行できるジョブがなければ false を返す
+	bool execute() {
+		const unsigned int self(current());
+		Job *job(queues[self]->deque.pop());
+
+		// 自分のキューが空なら他のキューから盗む
+		for (size_t i = 0; job == nullptr && i < queues.size(); i++) {
+			const unsigned int victim(nextVictim.fetch_add(1, std::memory_order_relaxed) % queues.size());
+			if (victim != self) job = queues[victim]->deque.steal();
+		}
+		if (job == nullptr) return false;
+		queued.fetch_sub(1, std::memory_order_relaxed);
+
+		finish(job);
+		return true;
+	}
+
+	// ジョブを実行してカウンタを減らす
+	void finish(Job *job) {
+		job->function(job->data, job->begin, job->end);
+
+		// カウンタが 0 になったらそれを待っていたジョブをキューに入れる
+		//  park() と行き違わないようにカウンタと待っているジョブの数は順序一貫で操作する
+		Counter *const counter(job->counter);
+		if (counter->fetch_sub(1) == 1 && parkedCount.load() > 0) release(counter);
+	}
+
+	// 依存するカウンタが 0 でなければジョブを待たせる
+	//  待たせたら true を返す
+	bool park(Job *job) {
+		std::lock_guard<std::mutex> lock(parkedMutex);
+		parkedCount.fetch_add(1);
+		if (job->dependency->load() == 0) {
+			parkedCount.fetch_sub(1);
+			return false;
+		}
+		job->next = parked;
+		parked = job;
+		return true;
+	}
+
+	// カウンタが 0 になるのを待っていたジョブをキューに入れる
+	void release(const Counter *counter) {
+		// リストから外すところまでを排他制御の中で行い，キューに入れるのは外で行う
+		//  （キューが満杯でこの場で実行したジョブがまた release() を呼ぶことがある）
+		Job *ready(NULL);
+		{
+			std::lock_guard<std::mutex> lock(parkedMutex);
+			for (Job **p = &parked; *p != NULL;) {
+				Job *const job(*p);
+				if (job->dependency == counter) {
+					*p = job->next;
+					job->next = ready;
+					ready = job;
+					parkedCount.fetch_sub(1);
+				}
+				else p = &job->next;
+			}
+		}
+		while (ready != NULL) {
+			Job *const job(ready);
+			ready = job->next;
+			submit(job);
+		}
+	}
+
+	// ワーカースレッドの処理
+	void worker(int index) {
+		self().owner = this;
+		self().index = index;
+		for (;;) {
+			if (execute()) continue;
+
+			// しばらく探してもなければ眠る
+			int spin(0);
+			while (spin < 64 && !execute()) {
+				std::this_thread::yield();
+				++spin;
+			}
+			if (spin < 64) continue;
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			++sleeping;
+			wake.wait(lock, [this] { return quit || queued.load(std::memory_order_acquire) > 0; });
+			--sleeping;
+			if (quit) return;
+		}
+	}
+};
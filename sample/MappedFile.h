@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#if defined(_WIN32)
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+// 読み出し専用にメモリにマップしたファイル
+//  読み込みを待たずに必要な部分だけをページ単位で参照できる
+class MappedFile {
+public:
+	// コンストラクタ
+	//  name: ファイル名（開けなければ data() が NULL になる）
+	MappedFile(const char *name) : address(NULL), length(0) {
+#if defined(_WIN32)
+		mapping = NULL;
+		file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+		if (file == INVALID_HANDLE_VALUE) return;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) return;
+		address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (address != NULL) length = static_cast<size_t>(size.QuadPart);
+#else
+		const int fd(open(name, O_RDONLY));
+		if (fd < 0) return;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			void *const p(mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+			if (p != MAP_FAILED) {
+				address = p;
+				length = static_cast<size_t>(st.st_size);
+			}
+		}
+		close(fd);
+#endif
+	}
+
+	// デストラクタ
+	virtual ~MappedFile() {
+#if defined(_WIN32)
+		if (address != NULL) UnmapViewOfFile(address);
+		if (mapping != NULL) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+		if (address != NULL) munmap(address, length);
+#endif
+	}
+
+	// ファイルの内容の先頭を返す（開けなかったら NULL）
+	const unsigned char *data() const {
+		return static_cast<const unsigned char *>(address);
+	}
+
+	// ファイルの大きさを返す
+	size_t size() const {
+		return length;
+	}
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	MappedFile(const MappedFile &f);
+
+	// 代入によるコピー禁止
+	MappedFile &operator=(const MappedFile &f);
+
+	// マップした先頭
+	void *address;
+
+	// ファイルの大きさ
+	size_t length;
+
+#if defined(_WIN32)
+	// ファイルとマッピングのハンドル
+	HANDLE file, mapping;
+#endif
+};
@@ -200,7 +200,7 @@ public:
 		rv.matrix[9] = sz / s;
 
 		// t軸を正規化して配列変数に格納
-		const GLfloat t(sqrt(tx * tx + ty * ty * tz * tz));
+		const GLfloat t(sqrt(tx * tx + ty * ty + tz * tz));
 		rv.matrix[2] = tx / t;
 		rv.matrix[6] = ty / t;
 		rv.matrix[10] = tz / t;
@@ -287,6 +287,43 @@ public:
 		m[8] = matrix[0] * matrix[5] - matrix[1] * matrix[4];
 	}
 
+	// 逆行列を求める（正則でなければ単位行列を返す）
+	Matrix inverse() const {
+		// 部分ピボット選択付きの掃き出し法
+		GLfloat a[16];
+		std::copy(matrix, matrix + 16, a);
+		Matrix t(identity());
+		for (int c = 0; c < 4; c++) {
+			int p(c);
+			for (int r = c + 1; r < 4; r++) {
+				if (std::fabs(a[c * 4 + r]) > std::fabs(a[c * 4 + p])) p = r;
+			}
+			if (a[c * 4 + p] == 0.0f) return identity();
+
+			// 行 c と行 p を入れ替える
+			for (int j = 0; j < 4; j++) {
+				std::swap(a[j * 4 + c], a[j * 4 + p]);
+				std::swap(t.matrix[j * 4 + c], t.matrix[j * 4 + p]);
+			}
+
+			// 行 c を正規化して他の行から消去する
+			const GLfloat d(1.0f / a[c * 4 + c]);
+			for (int j = 0; j < 4; j++) {
+				a[j * 4 + c] *= d;
+				t.matrix[j * 4 + c] *= d;
+			}
+			for (int r = 0; r < 4; r++) {
+				if (r == c) continue;
+				const GLfloat f(a[c * 4 + r]);
+				for (int j = 0; j < 4; j++) {
+					a[j * 4 + r] -= f * a[j * 4 + c];
+					t.matrix[j * 4 + r] -= f * t.matrix[j * 4 + c];
+				}
+			}
+		}
+		return t;
+	}
+
 private:
 	// 変換行列の要素
 	GLfloat matrix[16];
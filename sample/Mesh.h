@@ -0,0 +1,183 @@
+#pragma once
+#include <cmath>
+#include <vector>
+#include "Object.h"
+#include "JobSystem.h"
+#include "StripShapeIndex.h"
+
+// 手続き的に作る図形の頂点とインデックス
+//  曲面を (columns + 1) x (rows + 1) 個の頂点の格子で近似し，行ごとの三角形ストリップを
+//  StripShapeIndex::restart で区切って並べる．三角形の並びに比べてインデックスはおよそ 1/3 になる．
+//  ジョブシステムを渡せば格子の行ごとに並列に作る．三角形はどれも外から見て反時計回りにする
+class Mesh {
+public:
+	// 球
+	//  slices: 経度方向の分割数
+	//  stacks: 緯度方向の分割数
+	//  jobs: 並列に作るときのジョブシステム
+	//  原点中心の半径 1 の球を作る
+	static Mesh sphere(int slices, int stacks, JobSystem *jobs = NULL) {
+		Mesh mesh;
+		mesh.surface(slices, stacks, [](GLfloat u, GLfloat v, Object::Vertex &p) {
+			const GLfloat t(2.0f * pi * u), f(pi * (v - 0.5f));
+			const GLfloat n[] = { std::cos(f) * std::sin(t), std::sin(f), std::cos(f) * std::cos(t) };
+			set(p, n, n);
+		}, jobs);
+		return mesh;
+	}
+
+	// トーラス
+	//  slices: 中心の円周方向の分割数
+	//  sides: 管の断面の円周方向の分割数
+	//  thickness: 管の半径
+	//  jobs: 並列に作るときのジョブシステム
+	//  y 軸を中心に xz 平面上で回した外径 1 のトーラスを作る
+	static Mesh torus(int slices, int sides, GLfloat thickness = 0.3f, JobSystem *jobs = NULL) {
+		Mesh mesh;
+		const GLfloat radius(1.0f - thickness);
+		mesh.surface(slices, sides, [=](GLfloat u, GLfloat v, Object::Vertex &p) {
+			const GLfloat t(2.0f * pi * u), f(2.0f * pi * v);
+			const GLfloat n[] = { std::cos(f) * std::sin(t), std::sin(f), std::cos(f) * std::cos(t) };
+			const GLfloat r(radius + thickness * std::cos(f));
+			const GLfloat position[] = { r * std::sin(t), thickness * n[1], r * std::cos(t) };
+			set(p, position, n);
+		}, jobs);
+		return mesh;
+	}
+
+	// 円柱
+	//  slices: 円周方向の分割数
+	//  stacks: 高さ方向の分割数
+	//  jobs: 並列に作るときのジョブシステム
+	//  y 軸を中心にした半径 1, 高さ 2 の円柱を上下の蓋も含めて作る
+	static Mesh cylinder(int slices, int stacks, JobSystem *jobs = NULL) {
+		Mesh mesh;
+
+		// 側面
+		mesh.surface(slices, stacks, [](GLfloat u, GLfloat v, Object::Vertex &p) {
+			const GLfloat t(2.0f * pi * u);
+			const GLfloat position[] = { std::sin(t), 2.0f * v - 1.0f, std::cos(t) };
+			const GLfloat n[] = { position[0], 0.0f, position[2] };
+			set(p, position, n);
+		}, jobs);
+
+		// 下の蓋（中心から外へ）と上の蓋（外から中心へ）
+		for (int k = 0; k < 2; k++) {
+			mesh.surface(slices, 1, [k](GLfloat u, GLfloat v, Object::Vertex &p) {
+				const GLfloat t(2.0f * pi * u), r(k == 0 ? v : 1.0f - v);
+				const GLfloat position[] = { r * std::sin(t), k == 0 ? -1.0f : 1.0f, r * std::cos(t) };
+				const GLfloat n[] = { 0.0f, position[1], 0.0f };
+				set(p, position, n);
+			}, jobs);
+		}
+		return mesh;
+	}
+
+	// 格子状に分割した平面
+	//  columns: x 方向の分割数
+	//  rows: z 方向の分割数
+	//  jobs: 並列に作るときのジョブシステム
+	//  y = 0 の平面上の [-1, 1] x [-1, 1] を上向きに作る
+	static Mesh grid(int columns, int rows, JobSystem *jobs = NULL) {
+		Mesh mesh;
+		mesh.surface(columns, rows, [](GLfloat u, GLfloat v, Object::Vertex &p) {
+			const GLfloat position[] = { 2.0f * u - 1.0f, 0.0f, 1.0f - 2.0f * v };
+			const GLfloat n[] = { 0.0f, 1.0f, 0.0f };
+			set(p, position, n);
+		}, jobs);
+		return mesh;
+	}
+
+	// 頂点の数を返す
+	GLsizei getVertexCount() const { return static_cast<GLsizei>(vertex.size()); }
+
+	// 頂点属性を返す
+	const Object::Vertex *getVertex() const { return vertex.data(); }
+
+	// ストリップのインデックスの要素数を返す
+	GLsizei getIndexCount() const { return static_cast<GLsizei>(index.size()); }
+
+	// ストリップのインデックスを返す
+	const GLuint *getIndex() const { return index.data(); }
+
+	// ストリップを三角形ごとのインデックスに展開して返す
+	//  Bvh や OcclusionCuller など三角形の並びを受け取るものに渡す
+	std::vector<GLuint> getTriangles() const {
+		std::vector<GLuint> triangles;
+		size_t start(0);
+		for (size_t i = 0; i < index.size(); i++) {
+			if (index[i] == StripShapeIndex::restart) {
+				start = i + 1;
+				continue;
+			}
+			if (i < start + 2) continue;
+
+			// ストリップの奇数番目の三角形は向きを揃えるために入れ替える
+			const bool odd(((i - start) & 1) != 0);
+			triangles.push_back(index[odd ? i - 1 : i - 2]);
+			triangles.push_back(index[odd ? i - 2 : i - 1]);
+			triangles.push_back(index[i]);
+		}
+		return triangles;
+	}
+
+private:
+
+	// 円周率
+	static constexpr GLfloat pi = 3.14159265358979f;
+
+	// 格子の行ごとに並列に処理するときのまとまり
+	static const size_t grain = 8;
+
+	// 頂点属性
+	std::vector<Object::Vertex> vertex;
+
+	// 行ごとのストリップのインデックス
+	std::vector<GLuint> index;
+
+	// 頂点の位置と法線を設定する
+	static void set(Object::Vertex &p, const GLfloat *position, const GLfloat *normal) {
+		for (int k = 0; k < 3; k++) {
+			p.position[k] = position[k];
+			p.normal[k] = normal[k];
+		}
+	}
+
+	// (columns + 1) x (rows + 1) 個の頂点の格子を作って行ごとのストリップを追加する
+	//  f: f(u, v, p) で [0, 1] x [0, 1] の点 (u, v) の頂点 p の位置と法線を求める関数オブジェクト
+	//     (u, v) が反時計回りに見える側を表にする．テクスチャ座標は (u, v) にする
+	//  jobs: 並列に作るときのジョブシステム
+	template <typename F>
+	void surface(int columns, int rows, const F &f, JobSystem *jobs) {
+		const GLuint base(static_cast<GLuint>(vertex.size()));
+		const size_t first(index.size());
+		const GLuint width(columns + 1);
+		const size_t stride(2 * width + 1);
+		vertex.resize(base + width * (rows + 1));
+		index.resize(first + stride * rows);
+
+		// 各行の頂点と，その行から次の行へのストリップを作る
+		const auto body([&](size_t begin, size_t end) {
+			for (size_t j = begin; j < end; j++) {
+				const GLuint row(base + static_cast<GLuint>(j) * width);
+				const GLfloat v(static_cast<GLfloat>(j) / rows);
+				for (int i = 0; i <= columns; i++) {
+					Object::Vertex &p(vertex[row + i]);
+					p.texcoord[0] = static_cast<GLfloat>(i) / columns;
+					p.texcoord[1] = v;
+					f(p.texcoord[0], v, p);
+				}
+				if (j == static_cast<size_t>(rows)) continue;
+
+				GLuint *q(&index[first + j * stride]);
+				for (GLuint i = 0; i < width; i++) {
+					*q++ = row + width + i;
+					*q++ = row + i;
+				}
+				*q = StripShapeIndex::restart;
+			}
+		});
+		if (jobs != NULL && static_cast<size_t>(rows) + 1 > grain) jobs->parallel_for(rows + 1, grain, body);
+		else body(0, rows + 1);
+	}
+};
@@ -0,0 +1,167 @@
+#pragma once
+#include <algorithm>
+#include <GL/glew.h>
+#include "Matrix.h"
+#include "Affine.h"
+
+// 一度の描画で複数のビューに描く（画面の分割やステレオ）
+//  point.vert は gl_InstanceID 番目のビューの view と projection を使うので，
+//  図形をビューの数だけインスタンス描画すれば一度の描画で全部のビューに描ける．
+//  multiview.geom は三角形をそのビューに振り分ける．ARB_viewport_array (OpenGL 4.1) があれば
+//  ビューポート配列で分割した画面の領域に直接描き (gl_ViewportIndex)，なければ 2D 配列テクスチャの
+//  ビューごとのレイヤに描いて (gl_Layer) end() で画面の領域に転送する．
+//  インスタンス描画しないものは最初のビューに描く．描画スレッドからだけ使う
+class MultiView {
+public:
+	// ビューの数の上限（point.vert の配列の大きさ）
+	static constexpr int maxViews = 4;
+
+	// コンストラクタ
+	//  count: ビューの数（2 なら左右，3, 4 なら 2 x 2 に分割する．1 から maxViews までに収める）
+	MultiView(int count)
+		: views(std::min(std::max(count, 1), maxViews)), columns(views > 1 ? 2 : 1), rows(views > 2 ? 2 : 1)
+		, layered(!GLEW_VERSION_4_1 && !GLEW_ARB_viewport_array)
+		, fbo(0), reader(0), color(0), depth(0), width(0), height(0), target(0)
+	{
+		for (int i = 0; i < maxViews; i++) setView(i, Affine::identity(), Matrix::identity());
+		std::fill(viewport, viewport + 4, 0);
+	}
+
+	// デストラクタ
+	virtual ~MultiView() {
+		release();
+	}
+
+	// ビューの数を返す
+	int getViewCount() const { return views; }
+
+	// レイヤに描いて転送するか
+	bool isLayered() const { return layered; }
+
+	// 分割した領域の縦横比を返す
+	//  aspect: 画面全体の縦横比
+	GLfloat getAspect(GLfloat aspect) const { return aspect * rows / columns; }
+
+	// ビューの変換を設定する
+	//  i: ビューの番号
+	//  view: 図形のモデルビュー変換の後に適用するビューの変換（最初のビューは恒等変換にする）
+	//  projection: ビューの投影変換行列
+	void setView(int i, const Affine &view, const Matrix &projection) {
+		std::copy(view.data(), view.data() + 12, this->view + i * 12);
+		std::copy(projection.data(), projection.data() + 16, this->projection + i * 16);
+	}
+
+	// ビューごとに描く準備をする
+	//  使用中のプログラムの uniform 変数にビューの変換を設定し，現在のビューポートを分割する
+	//  viewLoc, projectionLoc, layeredLoc: point.vert の view, projection と multiview.geom の layered の場所
+	void begin(GLint viewLoc, GLint projectionLoc, GLint layeredLoc) {
+		glUniformMatrix4x3fv(viewLoc, views, GL_FALSE, view);
+		glUniformMatrix4fv(projectionLoc, views, GL_FALSE, projection);
+		glUniform1i(layeredLoc, layered);
+
+		// 分割する前のビューポート
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		const GLsizei w(viewport[2] / columns), h(viewport[3] / rows);
+
+		if (!layered) {
+			for (int i = 0; i < views; i++) {
+				glViewportIndexedf(i, static_cast<GLfloat>(viewport[0] + i % columns * w),
+					static_cast<GLfloat>(viewport[1] + (rows - 1 - i / columns) * h),
+					static_cast<GLfloat>(w), static_cast<GLfloat>(h));
+			}
+			return;
+		}
+
+		// 描き終わったら元のフレームバッファに転送する
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+		if (w != width || h != height) allocate(w, h);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+		glViewport(0, 0, w, h);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	// ビューごとに描き終えてビューポートを戻す
+	void end() {
+		if (layered) {
+			// レイヤを分割した領域に転送する
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, reader);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+			for (int i = 0; i < views; i++) {
+				glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color, 0, i);
+				const GLint x(viewport[0] + i % columns * width), y(viewport[1] + (rows - 1 - i / columns) * height);
+				glBlitFramebuffer(0, 0, width, height, x, y, x + width, y + height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			}
+			glBindFramebuffer(GL_FRAMEBUFFER, target);
+		}
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	MultiView(const MultiView &m);
+
+	// 代入によるコピー禁止
+	MultiView &operator=(const MultiView &m);
+
+	// ビューの数と画面の分割数
+	const int views, columns, rows;
+
+	// レイヤに描いて転送するか
+	const bool layered;
+
+	// ビューごとの変換行列
+	GLfloat view[maxViews * 12], projection[maxViews * 16];
+
+	// 分割する前のビューポート
+	GLint viewport[4];
+
+	// レイヤに描くフレームバッファオブジェクトと転送元にするフレームバッファオブジェクト
+	GLuint fbo, reader;
+
+	// カラーバッファとデプスバッファの 2D 配列テクスチャ
+	GLuint color, depth;
+
+	// レイヤの大きさ
+	GLsizei width, height;
+
+	// 転送先のフレームバッファオブジェクト
+	GLint target;
+
+	// レイヤを作り直す
+	void allocate(GLsizei w, GLsizei h) {
+		release();
+		width = w;
+		height = h;
+
+		glGenTextures(1, &color);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, color);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, w, h, views, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glGenTextures(1, &depth);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, depth);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, w, h, views, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		// 全部のレイヤを結合して gl_Layer で選ぶ
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color, 0);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0);
+		glGenFramebuffers(1, &reader);
+		glBindFramebuffer(GL_FRAMEBUFFER, target);
+	}
+
+	// レイヤを削除する
+	void release() {
+		if (fbo == 0) return;
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteFramebuffers(1, &reader);
+		glDeleteTextures(1, &color);
+		glDeleteTextures(1, &depth);
+		fbo = reader = color = depth = 0;
+	}
+};
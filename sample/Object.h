@@ -4,11 +4,15 @@
 class Object {
 public:
 	// 頂点属性
+	//  テクスチャを貼らない図形もテクスチャ座標を持つ．すべての図形の頂点の形式を一つにして
+	//  同じシェーダと頂点配列の設定で描くためで，1頂点が 24 バイトから 32 バイトに増える
 	struct Vertex {
 		// 位置
 		GLfloat position[3];
 		// 法線
 		GLfloat normal[3];
+		// テクスチャ座標
+		GLfloat texcoord[2];
 	};
 
 	// コンストラクタ
@@ -34,6 +38,8 @@ public:
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), static_cast<Vertex *>(0)->normal);
 		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), static_cast<Vertex *>(0)->texcoord);
+		glEnableVertexAttribArray(2);
 
 		// インデックスの頂点バッファオブジェクト
 		glGenBuffers(1, &ibo);
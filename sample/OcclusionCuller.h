@@ -0,0 +1,266 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <GL/glew.h>
+#include "Matrix.h"
+#include "Object.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define OCCLUSION_USE_SSE2 1
+#endif
+
+// CPU の粗いデプスバッファと階層 Z による遮蔽カリング
+//  遮蔽物に指定したメッシュだけを低解像度でラスタライズし，
+//  描画前に物体の境界ボックスが完全に隠れているかを調べる
+class OcclusionCuller {
+public:
+	// コンストラクタ
+	//  width: デプスバッファの幅（4の倍数に切り上げる）
+	//  height: デプスバッファの高さ
+	OcclusionCuller(int width = 256, int height = 128)
+		: tested(0), occluded(0)
+	{
+		width = (std::max(width, 4) + 3) & ~3;
+		height = std::max(height, 1);
+
+		// 1x1 になるまで半分ずつ縮小した階層を用意する
+		for (;;) {
+			levelSize.push_back(width);
+			levelSize.push_back(height);
+			levels.push_back(std::vector<GLfloat>(width * height, 1.0f));
+			if (width == 1 && height == 1) break;
+			width = (width + 1) / 2;
+			height = (height + 1) / 2;
+		}
+	}
+
+	// フレームの開始時にデプスバッファと計数を初期化する
+	void clear() {
+		std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+		tested = occluded = 0;
+	}
+
+	// 遮蔽物の三角形をデプスバッファに描く
+	//  mvp: 投影変換行列 * モデルビュー変換行列
+	//  count: 頂点（index があればインデックス）の数
+	//  vertex: 頂点属性を格納した配列
+	//  index: 三角形の頂点のインデックスを格納した配列
+	void addOccluder(const Matrix &mvp, GLsizei count, const Object::Vertex *vertex,
+		const GLuint *index = NULL) {
+		for (GLsizei i = 0; i + 2 < count; i += 3) {
+			GLfloat p[3][3];
+			bool clipped(false);
+
+			for (int k = 0; k < 3; k++) {
+				const GLuint n(index != NULL ? index[i + k] : i + k);
+				GLfloat c[4];
+				transform(mvp, vertex[n].position, c);
+
+				// 前方クリッピング面をまたぐ三角形は描かない（遮蔽が減るだけなので安全）
+				if (c[3] <= nearW) {
+					clipped = true;
+					break;
+				}
+				toScreen(c, p[k]);
+			}
+			if (!clipped) rasterize(p[0], p[1], p[2]);
+		}
+	}
+
+	// デプスバッファから階層 Z を作る（各画素は下の階層の 2x2 の最大値）
+	void buildHierarchy() {
+		for (size_t l = 1; l < levels.size(); l++) {
+			const int sw(levelSize[l * 2 - 2]), sh(levelSize[l * 2 - 1]);
+			const int w(levelSize[l * 2]), h(levelSize[l * 2 + 1]);
+			const std::vector<GLfloat> &src(levels[l - 1]);
+			std::vector<GLfloat> &dst(levels[l]);
+
+			for (int y = 0; y < h; y++) {
+				const int y0(y * 2), y1(std::min(y * 2 + 1, sh - 1));
+				for (int x = 0; x < w; x++) {
+					const int x0(x * 2), x1(std::min(x * 2 + 1, sw - 1));
+					dst[y * w + x] = std::max(
+						std::max(src[y0 * sw + x0], src[y0 * sw + x1]),
+						std::max(src[y1 * sw + x0], src[y1 * sw + x1]));
+				}
+			}
+		}
+	}
+
+	// 境界ボックスが見える可能性があるかを調べる
+	//  mvp: 投影変換行列 * モデルビュー変換行列
+	//  bmin, bmax: 物体座標系での境界ボックスの最小点と最大点
+	bool isVisible(const Matrix &mvp, const GLfloat *bmin, const GLfloat *bmax) {
+		++tested;
+
+		GLfloat lo[3] = { 1e30f, 1e30f, 1e30f };
+		GLfloat hi[3] = { -1e30f, -1e30f, -1e30f };
+		for (int k = 0; k < 8; k++) {
+			const GLfloat v[3] = {
+				(k & 1) ? bmax[0] : bmin[0],
+				(k & 2) ? bmax[1] : bmin[1],
+				(k & 4) ? bmax[2] : bmin[2]
+			};
+			GLfloat c[4], p[3];
+			transform(mvp, v, c);
+
+			// 視点の近くにあるものは隠れていないとみなす
+			if (c[3] <= nearW) return true;
+			toScreen(c, p);
+			for (int i = 0; i < 3; i++) {
+				lo[i] = std::min(lo[i], p[i]);
+				hi[i] = std::max(hi[i], p[i]);
+			}
+		}
+
+		// 画面の外にはみ出す部分はデプスバッファと比べられない
+		//  前方クリッピング面の近くでは int に収まらない座標になるので整数にする前に調べる
+		const int w(levelSize[0]), h(levelSize[1]);
+		if (!(lo[0] >= 0.0f && lo[1] >= 0.0f && hi[0] < w && hi[1] < h)) return true;
+		int x0(static_cast<int>(lo[0])), y0(static_cast<int>(lo[1]));
+		int x1(static_cast<int>(hi[0])), y1(static_cast<int>(hi[1]));
+
+		// 矩形が 2x2 画素程度に収まる階層を選ぶ
+		size_t l(0);
+		while (l + 1 < levels.size() && (x1 - x0 > 1 || y1 - y0 > 1)) {
+			x0 >>= 1; y0 >>= 1; x1 >>= 1; y1 >>= 1;
+			++l;
+		}
+
+		// 矩形内の最も遠い遮蔽物より手前にあれば見える
+		const int lw(levelSize[l * 2]);
+		const std::vector<GLfloat> &depth(levels[l]);
+		for (int y = y0; y <= y1; y++) {
+			for (int x = x0; x <= x1; x++) {
+				if (lo[2] <= depth[y * lw + x]) return true;
+			}
+		}
+
+		++occluded;
+		return false;
+	}
+
+	// このフレームで調べた物体の数を返す
+	int getTestedCount() const { return tested; }
+
+	// このフレームで隠れていると判定した物体の数を返す
+	int getOccludedCount() const { return occluded; }
+
+private:
+	// これより w が小さい頂点は前方クリッピング面の手前とみなす
+	static constexpr GLfloat nearW = 1e-5f;
+
+	// 各階層のデプスバッファ
+	std::vector<std::vector<GLfloat>> levels;
+
+	// 各階層の幅と高さ
+	std::vector<int> levelSize;
+
+	// このフレームで調べた物体の数（isVisible() は並列に呼んでよい）
+	std::atomic<int> tested;
+
+	// このフレームで隠れていると判定した物体の数
+	std::atomic<int> occluded;
+
+	// 位置 v をクリッピング座標系 c に変換する
+	static void transform(const Matrix &m, const GLfloat *v, GLfloat *c) {
+		const GLfloat *const a(m.data());
+		for (int i = 0; i < 4; i++) {
+			c[i] = a[i] * v[0] + a[4 + i] * v[1] + a[8 + i] * v[2] + a[12 + i];
+		}
+	}
+
+	// クリッピング座標系 c をデプスバッファの画素の座標と [0, 1] の深度 p に変換する
+	void toScreen(const GLfloat *c, GLfloat *p) const {
+		const GLfloat iw(1.0f / c[3]);
+		p[0] = (c[0] * iw * 0.5f + 0.5f) * levelSize[0];
+		p[1] = (c[1] * iw * 0.5f + 0.5f) * levelSize[1];
+		p[2] = c[2] * iw * 0.5f + 0.5f;
+	}
+
+	// 画素の座標を [0, limit] に収めて整数にする
+	static int toPixel(GLfloat v, int limit) {
+		return v > 0.0f ? static_cast<int>(std::min(v, static_cast<GLfloat>(limit))) : 0;
+	}
+
+	// 三角形を最下層のデプスバッファに描く
+	void rasterize(const GLfloat *a, const GLfloat *b, const GLfloat *c) {
+		// 裏向きや面積のない三角形は描かない
+		const GLfloat area((b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]));
+		if (area <= 0.0f) return;
+
+		// 画面内に収まる外接矩形（画面に収めてから整数にする）
+		const int w(levelSize[0]), h(levelSize[1]);
+		const GLfloat xmin(std::min(std::min(a[0], b[0]), c[0])), xmax(std::max(std::max(a[0], b[0]), c[0]));
+		const GLfloat ymin(std::min(std::min(a[1], b[1]), c[1])), ymax(std::max(std::max(a[1], b[1]), c[1]));
+		if (!(xmax >= 0.0f && ymax >= 0.0f && xmin < w && ymin < h)) return;
+		const int x0(toPixel(xmin, w - 1) & ~3), x1(toPixel(xmax, w - 1));
+		const int y0(toPixel(ymin, h - 1)), y1(toPixel(ymax, h - 1));
+
+		// 辺関数 e = ex * x + ey * y + e0（内側で正）
+		const GLfloat ex[3] = { a[1] - b[1], b[1] - c[1], c[1] - a[1] };
+		const GLfloat ey[3] = { b[0] - a[0], c[0] - b[0], a[0] - c[0] };
+		const GLfloat e0[3] = {
+			-ex[0] * a[0] - ey[0] * a[1],
+			-ex[1] * b[0] - ey[1] * b[1],
+			-ex[2] * c[0] - ey[2] * c[1]
+		};
+
+		// 深度の平面 z = zx * x + zy * y + z0（辺関数が重心座標になる）
+		const GLfloat ia(1.0f / area);
+		const GLfloat zx((ex[1] * a[2] + ex[2] * b[2] + ex[0] * c[2]) * ia);
+		const GLfloat zy((ey[1] * a[2] + ey[2] * b[2] + ey[0] * c[2]) * ia);
+		const GLfloat z0((e0[1] * a[2] + e0[2] * b[2] + e0[0] * c[2]) * ia);
+
+		std::vector<GLfloat> &depth(levels[0]);
+
+#if defined(OCCLUSION_USE_SSE2)
+		// 横に並んだ 4画素をまとめて処理する
+		const __m128 zero(_mm_setzero_ps());
+		const __m128 step(_mm_set1_ps(4.0f));
+		const __m128 vex0(_mm_set1_ps(ex[0])), vex1(_mm_set1_ps(ex[1])), vex2(_mm_set1_ps(ex[2]));
+		const __m128 vzx(_mm_set1_ps(zx));
+		for (int y = y0; y <= y1; y++) {
+			const GLfloat py(static_cast<GLfloat>(y) + 0.5f);
+			const __m128 px(_mm_add_ps(_mm_set1_ps(static_cast<GLfloat>(x0)),
+				_mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f)));
+			__m128 w0(_mm_add_ps(_mm_mul_ps(vex0, px), _mm_set1_ps(ey[0] * py + e0[0])));
+			__m128 w1(_mm_add_ps(_mm_mul_ps(vex1, px), _mm_set1_ps(ey[1] * py + e0[1])));
+			__m128 w2(_mm_add_ps(_mm_mul_ps(vex2, px), _mm_set1_ps(ey[2] * py + e0[2])));
+			__m128 z(_mm_add_ps(_mm_mul_ps(vzx, px), _mm_set1_ps(zy * py + z0)));
+			const __m128 dw0(_mm_mul_ps(vex0, step)), dw1(_mm_mul_ps(vex1, step)), dw2(_mm_mul_ps(vex2, step));
+			const __m128 dz(_mm_mul_ps(vzx, step));
+
+			GLfloat *row(&depth[y * w]);
+			for (int x = x0; x <= x1; x += 4) {
+				const __m128 inside(_mm_and_ps(_mm_cmpgt_ps(w0, zero),
+					_mm_and_ps(_mm_cmpgt_ps(w1, zero), _mm_cmpgt_ps(w2, zero))));
+				if (_mm_movemask_ps(inside) != 0) {
+					const __m128 old(_mm_loadu_ps(row + x));
+					const __m128 nearer(_mm_min_ps(old, z));
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+				}
+				w0 = _mm_add_ps(w0, dw0);
+				w1 = _mm_add_ps(w1, dw1);
+				w2 = _mm_add_ps(w2, dw2);
+				z = _mm_add_ps(z, dz);
+			}
+		}
+#else
+		for (int y = y0; y <= y1; y++) {
+			const GLfloat py(static_cast<GLfloat>(y) + 0.5f);
+			GLfloat *row(&depth[y * w]);
+			for (int x = x0; x <= x1; x++) {
+				const GLfloat px(static_cast<GLfloat>(x) + 0.5f);
+				if (ex[0] * px + ey[0] * py + e0[0] > 0.0f
+					&& ex[1] * px + ey[1] * py + e0[1] > 0.0f
+					&& ex[2] * px + ey[2] * py + e0[2] > 0.0f) {
+					row[x] = std::min(row[x], zx * px + zy * py + z0);
+				}
+			}
+		}
+#endif
+	}
+};
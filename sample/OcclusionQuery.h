@@ -0,0 +1,65 @@
+#pragma once
+#include <GL/glew.h>
+
+// オクルージョンクエリによる条件付き描画
+//  CPU の遮蔽カリングで残った物体を GPU 側でさらに間引くときに使う．
+//  結果が出ていなければ待たずに描くので描画の待ち合わせは起きない
+class OcclusionQuery {
+public:
+	// コンストラクタ
+	OcclusionQuery() : issued(false) {
+		glGenQueries(1, &query);
+	}
+
+	// デストラクタ
+	virtual ~OcclusionQuery() {
+		glDeleteQueries(1, &query);
+	}
+
+	// 代わりの図形（境界ボックスなど）の描画の前に呼ぶ
+	void begin() {
+		glBeginQuery(GL_SAMPLES_PASSED, query);
+		issued = true;
+	}
+
+	// 代わりの図形の描画の後に呼ぶ
+	void end() const {
+		glEndQuery(GL_SAMPLES_PASSED);
+	}
+
+	// この後の描画をクエリの結果が 0 でないときだけ行う
+	void beginConditional() const {
+		glBeginConditionalRender(query, GL_QUERY_NO_WAIT);
+	}
+
+	// 条件付き描画を終了する
+	void endConditional() const {
+		glEndConditionalRender();
+	}
+
+	// 前に発行したクエリの結果を待たずに取り出す
+	//  samples: 深度テストを通ったサンプル数の格納先
+	//  戻り値: 結果が出ていれば true
+	bool getResult(GLuint &samples) const {
+		if (!issued) return false;
+		GLuint available(GL_FALSE);
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available == GL_FALSE) return false;
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT, &samples);
+		return true;
+	}
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	OcclusionQuery(const OcclusionQuery &o);
+
+	// 代入によるコピー禁止
+	OcclusionQuery &operator=(const OcclusionQuery &o);
+
+	// クエリオブジェクト名
+	GLuint query;
+
+	// 一度でもクエリを発行したか
+	bool issued;
+};
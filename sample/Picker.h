@@ -0,0 +1,98 @@
+#pragma once
+#include <cfloat>
+#include <vector>
+#include <GL/glew.h>
+#include "Matrix.h"
+#include "Affine.h"
+#include "Bvh.h"
+
+// マウスカーソルの下にある図形を求める
+//  図形ごとに BVH とその座標系から投影変換前の座標系への変換を登録しておき，
+//  カーソルの位置を投影変換の逆変換で光線に戻して各図形の座標系で BVH をたどる
+class Picker {
+public:
+	// 選ばれた図形
+	struct Hit {
+		// 図形の番号
+		int instance;
+		// 三角形の番号
+		GLuint triangle;
+		// 光線のパラメータ（始点は前方面，1 で後方面）
+		GLfloat t;
+	};
+
+	// 図形を加えてその番号を返す
+	//  bvh: 図形の BVH
+	//  transform: 図形の座標系から投影変換前の座標系への変換
+	int add(const Bvh *bvh, const Affine &transform = Affine::identity()) {
+		const Instance instance = { bvh, transform.inverse() };
+		instances.push_back(instance);
+		return static_cast<int>(instances.size()) - 1;
+	}
+
+	// 図形の変換を変更する
+	void setTransform(int instance, const Affine &transform) {
+		instances[instance].inverse = transform.inverse();
+	}
+
+	// 正規化デバイス座標系の点を通る視線を求める
+	//  projection: 投影変換行列
+	//  ndc: 正規化デバイス座標系の x, y
+	//  origin: 前方面上の始点
+	//  direction: 前方面から後方面までのベクトル
+	static void unproject(const Matrix &projection, const GLfloat *ndc, GLfloat *origin, GLfloat *direction) {
+		const Matrix inverse(projection.inverse());
+		const GLfloat *const m(inverse.data());
+		GLfloat p[2][3];
+		for (int k = 0; k < 2; k++) {
+			const GLfloat z(k == 0 ? -1.0f : 1.0f);
+			GLfloat q[4];
+			for (int i = 0; i < 4; i++) q[i] = m[i] * ndc[0] + m[4 + i] * ndc[1] + m[8 + i] * z + m[12 + i];
+			for (int i = 0; i < 3; i++) p[k][i] = q[i] / q[3];
+		}
+		for (int i = 0; i < 3; i++) {
+			origin[i] = p[0][i];
+			direction[i] = p[1][i] - p[0][i];
+		}
+	}
+
+	// カーソルの下で最も手前にある図形を求める
+	//  projection: 投影変換行列
+	//  ndc: カーソルの正規化デバイス座標系の位置
+	//  hit: 選ばれた図形
+	//  何もなければ false を返す
+	bool pick(const Matrix &projection, const GLfloat *ndc, Hit &hit) const {
+		GLfloat origin[3], direction[3];
+		unproject(projection, ndc, origin, direction);
+
+		// 方向は正規化しないので t はどの図形の座標系でも同じ点を指す
+		Bvh::Hit h = { 1.0f, 0, 0.0f, 0.0f };
+		hit.instance = -1;
+		for (size_t i = 0; i < instances.size(); i++) {
+			const GLfloat *const m(instances[i].inverse.data());
+			GLfloat o[3], d[3];
+			for (int r = 0; r < 3; r++) {
+				o[r] = m[r] * origin[0] + m[3 + r] * origin[1] + m[6 + r] * origin[2] + m[9 + r];
+				d[r] = m[r] * direction[0] + m[3 + r] * direction[1] + m[6 + r] * direction[2];
+			}
+			if (instances[i].bvh->intersect(o, d, h)) {
+				hit.instance = static_cast<int>(i);
+				hit.triangle = h.triangle;
+				hit.t = h.t;
+			}
+		}
+		return hit.instance >= 0;
+	}
+
+private:
+	// 登録した図形
+	struct Instance {
+		// BVH
+		const Bvh *bvh;
+		// 投影変換前の座標系から図形の座標系への変換
+		Affine inverse;
+	};
+
+	// 登録した図形
+	std::vector<Instance> instances;
+};
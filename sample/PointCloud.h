@@ -0,0 +1,605 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <GL/glew.h>
+#include "Matrix.h"
+#include "MappedFile.h"
+#include "GlTrace.h"
+
+// 八分木で詳細度を変えて描く点群
+//  build() で点群を入れ子の八分木（各ノードが格子で間引いた点を持つ）のファイルにしておく．
+//  描画時は画面上の大きさの大きいノードから点数の予算の範囲で選び，
+//  ファイルをメモリにマップしてバックグラウンドのスレッドで読み込んだノードを
+//  一つの頂点バッファの決まった大きさのスロットに置く．置き場がなければ長く使っていないものを追い出す
+//
+//  ファイルの形式（リトルエンディアン）
+//   0: "PCO1", 4: ノード数, 8: 点の数, 16: ノード表の位置, 24: ノードあたりの点の数の上限,
+//   28: 間引きの格子の数, 32: 境界の最小点 (float x 3), 44: 境界の一辺の長さ (float)
+//   64 以降: ノードごとに連続して並べた点
+//   ノード表: ノードごとに最小点 (float x 3), 一辺の長さ, 最初の点 (uint64_t), 点の数, 子の番号 (int32_t x 8, なければ -1)
+class PointCloud {
+public:
+	// 点
+	struct Point {
+		// 位置
+		GLfloat position[3];
+		// 色
+		GLubyte color[4];
+	};
+
+	// 点を並べたファイルから八分木のファイルを作る
+	//  input: Point を並べたファイル
+	//  output: 出力する八分木のファイル
+	//  blockPoints: ノードあたりの点の数の上限
+	//  grid: ノードの中で点を間引く格子の一辺の数
+	static bool build(const char *input, const char *output, uint32_t blockPoints = 16384, uint32_t grid = 64) {
+		const MappedFile file(input);
+		const Point *const point(reinterpret_cast<const Point *>(file.data()));
+		const size_t count(file.size() / sizeof(Point));
+		if (point == NULL || count == 0 || count > UINT32_MAX) {
+			std::fprintf(stderr, "Can't read points: %s\n", input);
+			return false;
+		}
+		if (blockPoints == 0 || blockPoints > 1u << 24 || grid == 0 || grid > 1024) {
+			std::fprintf(stderr, "Bad octree parameters: blockPoints %u, grid %u\n", blockPoints, grid);
+			return false;
+		}
+
+		Builder builder(point, count, blockPoints, grid);
+		return builder.write(output);
+	}
+
+	// コンストラクタ
+	//  name: 八分木のファイル名
+	//  budget: 1フレームに描く点の数の上限
+	//  capacity: 頂点バッファに置けるノードの数
+	//  threads: 読み込みに使うスレッドの数
+	PointCloud(const char *name, GLsizei budget = 2000000, int capacity = 512, int threads = 2)
+		: file(name), nodes(), blockPoints(0), grid(1), budget(budget), capacity(capacity), vao(0), vbo(0)
+		, frame(0), selectedPoints(0), stop(false), jobHead(0), jobTail(0), doneHead(0), doneTail(0)
+	{
+		// ヘッダとノード表を確かめる
+		const unsigned char *const p(file.data());
+		if (p == NULL || file.size() < headerSize || std::memcmp(p, "PCO1", 4) != 0) {
+			std::fprintf(stderr, "Can't load point cloud: %s\n", name);
+			return;
+		}
+		uint32_t count;
+		uint64_t points, table;
+		std::memcpy(&count, p + 4, 4);
+		std::memcpy(&points, p + 8, 8);
+		std::memcpy(&table, p + 16, 8);
+		std::memcpy(&blockPoints, p + 24, 4);
+		std::memcpy(&grid, p + 28, 4);
+		if (count == 0 || blockPoints == 0 || points > (file.size() - headerSize) / sizeof(Point)
+			|| table < headerSize + points * sizeof(Point) || table > file.size()
+			|| uint64_t(count) > (file.size() - table) / recordSize) {
+			std::fprintf(stderr, "Broken point cloud: %s\n", name);
+			blockPoints = 0;
+			return;
+		}
+		nodes.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			Node &n(nodes[i]);
+			const unsigned char *const r(p + table + size_t(i) * recordSize);
+			std::memcpy(n.bmin, r, 12);
+			std::memcpy(&n.size, r + 12, 4);
+			std::memcpy(&n.first, r + 16, 8);
+			std::memcpy(&n.count, r + 24, 4);
+			std::memcpy(n.child, r + 28, 32);
+
+			// 点はファイルの点の範囲に，子は自分より後ろのノードになければならない（循環させない）
+			bool broken(n.count > blockPoints || n.first > points || n.count > points - n.first);
+			for (int c = 0; c < 8; c++) {
+				if (n.child[c] >= 0 && (n.child[c] <= static_cast<int32_t>(i) || uint32_t(n.child[c]) >= count)) broken = true;
+			}
+			if (broken) {
+				std::fprintf(stderr, "Broken point cloud: %s\n", name);
+				blockPoints = 0;
+				return;
+			}
+		}
+		slots.assign(capacity, -1);
+		selected.reserve(count);
+		heap.reserve(count);
+
+		// 頂点バッファはノード capacity 個分だけ確保する
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glGenBuffers(1, &vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, size_t(capacity) * blockPoints * sizeof(Point), NULL, GL_DYNAMIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Point), static_cast<Point *>(0)->position);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Point), static_cast<Point *>(0)->color);
+		glEnableVertexAttribArray(3);
+
+		// 読み込みに使う作業領域はスレッドあたり 4つ
+		staging.resize(threads * 4);
+		for (Staging &s : staging) s.point.resize(blockPoints);
+		for (size_t i = staging.size(); i-- > 0;) freeStaging.push_back(static_cast<int>(i));
+		jobs.resize(staging.size() + 1);
+		done.resize(staging.size() + 1);
+
+		for (int i = 0; i < threads; i++) workers.emplace_back(&PointCloud::work, this);
+	}
+
+	// デストラクタ
+	virtual ~PointCloud() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_all();
+		for (std::thread &t : workers) t.join();
+
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &vbo);
+	}
+
+	// 読み込めたか
+	bool isValid() const { return blockPoints > 0; }
+
+	// 描くノードを選び，読み込みと転送を進める（描画スレッドで毎フレーム呼ぶ）
+	//  projectionView: 点群の座標系からクリッピング座標系への変換行列
+	//  eye: 点群の座標系での視点の位置
+	//  fovy: 透視投影の画角
+	//  viewportHeight: ビューポートの高さ（画素）
+	//  uploads: このフレームで転送するノードの数の上限
+	void update(const Matrix &projectionView, const GLfloat *eye, GLfloat fovy, GLsizei viewportHeight,
+		int uploads = 8) {
+		if (!isValid()) return;
+		++frame;
+
+		// 読み込み終わったノードを転送する
+		upload(uploads);
+
+		// 視錐台の 6平面を求める
+		GLfloat plane[6][4];
+		const GLfloat *const m(projectionView.data());
+		for (int p = 0; p < 6; p++) {
+			const int row(p / 2);
+			const GLfloat sign(p % 2 == 0 ? 1.0f : -1.0f);
+			for (int j = 0; j < 4; j++) plane[p][j] = m[j * 4 + 3] + sign * m[j * 4 + row];
+		}
+
+		// 距離 1 での長さ 1 が画面上で何画素になるか
+		const GLfloat k(viewportHeight * 0.5f / std::tan(fovy * 0.5f));
+
+		// 画面上で大きいノードから予算の範囲で選ぶ（子は親が読み込まれてから調べる）
+		selected.clear();
+		heap.clear();
+		selectedPoints = 0;
+		push(0, eye, k, plane);
+		bool requested(false);
+		while (!heap.empty()) {
+			std::pop_heap(heap.begin(), heap.end());
+			const Candidate candidate(heap.back());
+			const int i(candidate.node);
+			heap.pop_back();
+
+			Node &n(nodes[i]);
+			if (selectedPoints + n.count > static_cast<size_t>(budget)) break;
+			n.used = frame;
+			selected.push_back(i);
+			selectedPoints += n.count;
+
+			if (n.state == RESIDENT) {
+				// 間引いた格子の間隔が 1画素より大きければ子を調べる
+				if (candidate.priority < grid) continue;
+				for (int c = 0; c < 8; c++) {
+					if (n.child[c] >= 0) push(n.child[c], eye, k, plane);
+				}
+			}
+			else if (n.state == EMPTY && !freeStaging.empty()) {
+				// 近いものから順に選ばれるので見つけた順に読み込みを依頼する
+				const Job job = { i, freeStaging.back() };
+				freeStaging.pop_back();
+				n.state = REQUESTED;
+				std::lock_guard<std::mutex> lock(mutex);
+				jobs[jobTail] = job;
+				jobTail = (jobTail + 1) % jobs.size();
+				requested = true;
+			}
+		}
+		if (requested) wake.notify_all();
+	}
+
+	// 選んだノードのうち読み込み済みのものを描く
+	void draw() const {
+		if (!isValid()) return;
+		glBindVertexArray(vao);
+		for (const int i : selected) {
+			const Node &n(nodes[i]);
+			if (n.state == RESIDENT) GlTrace::drawArrays(GL_POINTS, n.slot * blockPoints, n.count);
+		}
+	}
+
+	// 境界の最小点と一辺の長さを返す
+	const GLfloat *getBoundsMin() const { return nodes[0].bmin; }
+	GLfloat getSize() const { return nodes[0].size; }
+
+	// 選んだノードの数と点の数を返す
+	int getSelectedCount() const { return static_cast<int>(selected.size()); }
+	size_t getSelectedPoints() const { return selectedPoints; }
+
+	// 頂点バッファに置かれているノードの数を返す
+	int getResidentCount() const {
+		return static_cast<int>(std::count_if(slots.begin(), slots.end(), [](int s) { return s >= 0; }));
+	}
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	PointCloud(const PointCloud &p);
+
+	// 代入によるコピー禁止
+	PointCloud &operator=(const PointCloud &p);
+
+	// ヘッダとノード表の一つ分の大きさ
+	static const size_t headerSize = 64;
+	static const size_t recordSize = 64;
+
+	// ノードの状態
+	enum State { EMPTY, REQUESTED, RESIDENT };
+
+	// ノード
+	struct Node {
+		// 境界の最小点と一辺の長さ
+		GLfloat bmin[3], size;
+		// 最初の点と点の数
+		uint64_t first;
+		uint32_t count;
+		// 子の番号
+		int32_t child[8];
+		// 状態
+		State state;
+		// 頂点バッファのスロット
+		int slot;
+		// 最後に選ばれたフレーム
+		unsigned int used;
+
+		Node() : state(EMPTY), slot(-1), used(0) {}
+	};
+
+	// 選ぶ候補
+	struct Candidate {
+		// 画面上の大きさ
+		GLfloat priority;
+		// ノードの番号
+		int node;
+
+		bool operator<(const Candidate &c) const { return priority < c.priority; }
+	};
+
+	// 読み込みの作業領域
+	struct Staging {
+		// 読み込んだノード
+		int node;
+		// 点
+		std::vector<Point> point;
+	};
+
+	// 読み込みの依頼
+	struct Job {
+		// ノードの番号
+		int node;
+		// 作業領域の番号
+		int staging;
+	};
+
+	// 八分木のファイル
+	MappedFile file;
+
+	// ノード
+	std::vector<Node> nodes;
+
+	// ノードあたりの点の数の上限
+	uint32_t blockPoints;
+
+	// 間引きの格子の一辺の数
+	uint32_t grid;
+
+	// 1フレームに描く点の数の上限
+	const GLsizei budget;
+
+	// 頂点バッファに置けるノードの数
+	const int capacity;
+
+	// 頂点配列オブジェクトと頂点バッファオブジェクト
+	GLuint vao, vbo;
+
+	// 頂点バッファのスロットに置かれているノード（空きなら -1）
+	std::vector<int> slots;
+
+	// このフレームで選んだノードと候補
+	std::vector<int> selected;
+	std::vector<Candidate> heap;
+
+	// フレームの番号
+	unsigned int frame;
+
+	// 選んだ点の数
+	size_t selectedPoints;
+
+	// 読み込みの作業領域
+	std::vector<Staging> staging;
+
+	// 空いている作業領域（描画スレッドだけが使う）
+	std::vector<int> freeStaging;
+
+	// 読み込みの依頼と読み込み終わった作業領域の待ち行列
+	std::vector<Job> jobs;
+	std::vector<int> done;
+
+	// 読み込みのスレッド
+	std::vector<std::thread> workers;
+
+	// 待ち行列の排他制御
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stop;
+	size_t jobHead, jobTail, doneHead, doneTail;
+
+	// 視錐台にかかっているノードを画面上の大きさを優先度にして候補に加える
+	void push(int i, const GLfloat *eye, GLfloat k, const GLfloat (*plane)[4]) {
+		const Node &n(nodes[i]);
+		GLfloat d2(0.0f);
+		for (int p = 0; p < 6; p++) {
+			const GLfloat *const q(plane[p]);
+			GLfloat s(q[3]);
+			for (int j = 0; j < 3; j++) s += q[j] * (q[j] > 0.0f ? n.bmin[j] + n.size : n.bmin[j]);
+			if (s < 0.0f) return;
+		}
+		for (int j = 0; j < 3; j++) {
+			const GLfloat d(eye[j] - (n.bmin[j] + 0.5f * n.size));
+			d2 += d * d;
+		}
+		const Candidate c = { n.size * k / std::max(std::sqrt(d2), 1e-3f), i };
+		heap.push_back(c);
+		std::push_heap(heap.begin(), heap.end());
+	}
+
+	// 読み込み終わったノードを頂点バッファに転送する
+	void upload(int uploads) {
+		for (int u = 0; u < uploads; u++) {
+			int s;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (doneHead == doneTail) return;
+				s = done[doneHead];
+				doneHead = (doneHead + 1) % done.size();
+			}
+			const Staging &t(staging[s]);
+			Node &n(nodes[t.node]);
+
+			// 空きスロットがなければ前のフレームで選ばれなかった最も古いノードを追い出す
+			int slot(static_cast<int>(std::find(slots.begin(), slots.end(), -1) - slots.begin()));
+			if (slot == capacity) {
+				int victim(-1);
+				for (int i = 0; i < capacity; i++) {
+					const Node &v(nodes[slots[i]]);
+					if (v.used + 1 < frame && (victim < 0 || v.used < nodes[slots[victim]].used)) victim = i;
+				}
+				if (victim >= 0) {
+					nodes[slots[victim]].state = EMPTY;
+					nodes[slots[victim]].slot = -1;
+					slots[victim] = -1;
+					slot = victim;
+				}
+			}
+
+			if (slot < capacity) {
+				glBindBuffer(GL_ARRAY_BUFFER, vbo);
+				glBufferSubData(GL_ARRAY_BUFFER, size_t(slot) * blockPoints * sizeof(Point),
+					n.count * sizeof(Point), t.point.data());
+				slots[slot] = t.node;
+				n.slot = slot;
+				n.state = RESIDENT;
+			}
+			else {
+				// 置き場がなければ次に選ばれたときに読み直す
+				n.state = EMPTY;
+			}
+			freeStaging.push_back(s);
+		}
+	}
+
+	// 読み込みのスレッド（マップしたファイルからノードの点を写す）
+	void work() {
+		for (;;) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]() { return stop || jobHead != jobTail; });
+				if (stop) return;
+				job = jobs[jobHead];
+				jobHead = (jobHead + 1) % jobs.size();
+			}
+
+			Staging &t(staging[job.staging]);
+			const Node &n(nodes[job.node]);
+			t.node = job.node;
+			std::memcpy(t.point.data(), file.data() + headerSize + n.first * sizeof(Point), n.count * sizeof(Point));
+
+			std::lock_guard<std::mutex> lock(mutex);
+			done[doneTail] = job.staging;
+			doneTail = (doneTail + 1) % done.size();
+		}
+	}
+
+	// 八分木の作成
+	class Builder {
+	public:
+		// コンストラクタ
+		Builder(const Point *point, size_t count, uint32_t blockPoints, uint32_t grid)
+			: point(point), blockPoints(blockPoints), grid(grid), index(count)
+			, stamp(size_t(grid) * grid * grid, 0), written(0), fp(NULL)
+		{
+			for (size_t i = 0; i < count; i++) index[i] = static_cast<uint32_t>(i);
+
+			// 格子のセルごとに最初の点を残すので，入力の順（スキャンの順など）に偏らないよう混ぜておく
+			std::shuffle(index.begin(), index.end(), std::mt19937(1));
+
+			// 全体を囲む立方体を求める
+			GLfloat bmax[3];
+			for (int j = 0; j < 3; j++) bmin[j] = bmax[j] = point[0].position[j];
+			for (size_t i = 1; i < count; i++) {
+				for (int j = 0; j < 3; j++) {
+					bmin[j] = std::min(bmin[j], point[i].position[j]);
+					bmax[j] = std::max(bmax[j], point[i].position[j]);
+				}
+			}
+			size = std::max(std::max(bmax[0] - bmin[0], bmax[1] - bmin[1]), bmax[2] - bmin[2]);
+			size = size > 0.0f ? size * 1.0001f : 1.0f;
+			buffer.reserve(blockPoints);
+		}
+
+		// 八分木を作ってファイルに書き出す
+		bool write(const char *name) {
+			fp = std::fopen(name, "wb");
+			if (fp == NULL) {
+				std::fprintf(stderr, "Can't create point cloud: %s\n", name);
+				return false;
+			}
+			unsigned char header[headerSize] = {};
+			bool ok(std::fwrite(header, headerSize, 1, fp) == 1);
+
+			// 点を書き出してからノード表を書き出す
+			ok = ok && node(bmin, size, 0, index.size(), 0) >= 0;
+			const uint64_t table(headerSize + written * sizeof(Point));
+			for (size_t i = 0; i < records.size() && ok; i++) {
+				unsigned char r[recordSize] = {};
+				const Record &n(records[i]);
+				std::memcpy(r, n.bmin, 12);
+				std::memcpy(r + 12, &n.size, 4);
+				std::memcpy(r + 16, &n.first, 8);
+				std::memcpy(r + 24, &n.count, 4);
+				std::memcpy(r + 28, n.child, 32);
+				ok = std::fwrite(r, recordSize, 1, fp) == 1;
+			}
+
+			const uint32_t count(static_cast<uint32_t>(records.size()));
+			std::memcpy(header, "PCO1", 4);
+			std::memcpy(header + 4, &count, 4);
+			std::memcpy(header + 8, &written, 8);
+			std::memcpy(header + 16, &table, 8);
+			std::memcpy(header + 24, &blockPoints, 4);
+			std::memcpy(header + 28, &grid, 4);
+			std::memcpy(header + 32, bmin, 12);
+			std::memcpy(header + 44, &size, 4);
+			ok = ok && std::fseek(fp, 0, SEEK_SET) == 0 && std::fwrite(header, headerSize, 1, fp) == 1;
+
+			std::fprintf(stderr, "%s: %u nodes, %llu points\n", name, count, static_cast<unsigned long long>(written));
+			return std::fclose(fp) == 0 && ok;
+		}
+
+	private:
+		// ノード表の一つ分
+		struct Record {
+			GLfloat bmin[3], size;
+			uint64_t first;
+			uint32_t count;
+			int32_t child[8];
+		};
+
+		// 入力の点
+		const Point *const point;
+
+		// ノードあたりの点の数の上限と間引きの格子の数
+		const uint32_t blockPoints, grid;
+
+		// 点の番号（ノードごとに区切って並べ替える）
+		std::vector<uint32_t> index;
+
+		// 間引きの格子の各セルに最後に点を置いたノードの番号 + 1
+		std::vector<uint32_t> stamp;
+
+		// 書き出す点
+		std::vector<Point> buffer;
+
+		// ノードの記録の並び
+		std::vector<Record> records;
+
+		// 全体を囲む立方体
+		GLfloat bmin[3], size;
+
+		// 書き出した点の数
+		uint64_t written;
+
+		// 出力先
+		FILE *fp;
+
+		// index[begin, end) の点で一つのノードを作り，その番号を返す（書き出せなければ -1）
+		int node(const GLfloat *lo, GLfloat s, size_t begin, size_t end, int depth) {
+			const int self(static_cast<int>(records.size()));
+			Record r;
+			std::copy(lo, lo + 3, r.bmin);
+			r.size = s;
+			r.first = written;
+			std::fill(r.child, r.child + 8, -1);
+			records.push_back(r);
+
+			// 上限以下なら全部をこのノードに置く（深すぎるときは重なった点なので残りを捨てる）
+			size_t middle(std::min(end, begin + blockPoints));
+			if (end - begin > blockPoints && depth < 24) {
+				// 格子のセルごとに最初の点だけをこのノードに置く
+				middle = begin;
+				const uint32_t id(static_cast<uint32_t>(self) + 1);
+				for (size_t i = begin; i < end && middle - begin < blockPoints; i++) {
+					const GLfloat *const p(point[index[i]].position);
+					size_t cell(0);
+					for (int j = 0; j < 3; j++) {
+						const uint32_t c(static_cast<uint32_t>((p[j] - lo[j]) / s * grid));
+						cell = cell * grid + std::min(c, grid - 1);
+					}
+					if (stamp[cell] != id) {
+						stamp[cell] = id;
+						std::swap(index[middle++], index[i]);
+					}
+				}
+			}
+
+			buffer.clear();
+			for (size_t i = begin; i < middle; i++) buffer.push_back(point[index[i]]);
+			if (std::fwrite(buffer.data(), sizeof(Point), buffer.size(), fp) != buffer.size()) return -1;
+			written += buffer.size();
+			records[self].count = static_cast<uint32_t>(buffer.size());
+			if (middle == end || depth >= 24) return self;
+
+			// 残りを 8つの子に分ける
+			const GLfloat h(s * 0.5f);
+			const GLfloat center[3] = { lo[0] + h, lo[1] + h, lo[2] + h };
+			size_t bound[9] = { middle };
+			bound[8] = end;
+			uint32_t *const first(index.data());
+			const auto split([&](size_t b, size_t e, int axis) {
+				return static_cast<size_t>(std::partition(first + b, first + e,
+					[&](uint32_t i) { return point[i].position[axis] < center[axis]; }) - first);
+			});
+			bound[4] = split(middle, end, 0);
+			bound[2] = split(middle, bound[4], 1);
+			bound[6] = split(bound[4], end, 1);
+			for (int c = 0; c < 8; c += 2) bound[c + 1] = split(bound[c], bound[c + 2], 2);
+
+			for (int c = 0; c < 8; c++) {
+				if (bound[c] == bound[c + 1]) continue;
+				const GLfloat child[3] = {
+					c & 4 ? center[0] : lo[0], c & 2 ? center[1] : lo[1], c & 1 ? center[2] : lo[2]
+				};
+				const int n(node(child, h, bound[c], bound[c + 1], depth + 1));
+				if (n < 0) return -1;
+				records[self].child[c] = n;
+			}
+			return self;
+		}
+	};
+};
@@ -0,0 +1,120 @@
+#pragma once
+#include <cstdint>
+#include <new>
+#include <memory>
+#include <vector>
+#include <utility>
+
+// 型 T のオブジェクトをまとめて確保しておくプール
+//  オブジェクトは世代付きのハンドルで参照するので，
+//  削除した後のハンドルを使っても別のオブジェクトを指すことはない
+//  T: オブジェクトの型
+//  SlabSize: 一度に確保するオブジェクトの数
+template <typename T, uint32_t SlabSize = 64>
+class Pool {
+public:
+	// ハンドル（generation が 0 なら無効）
+	struct Handle {
+		uint32_t index;
+		uint32_t generation;
+	};
+
+	// コンストラクタ
+	Pool() : freeList(none), live(0) {}
+
+	// デストラクタ（残っているオブジェクトを削除する）
+	virtual ~Pool() {
+		for (uint32_t i = 0; i < slabs.size() * SlabSize; i++) {
+			Slot &s(slot(i));
+			if (s.alive) reinterpret_cast<T *>(&s.storage)->~T();
+		}
+	}
+
+	// オブジェクトを作成する
+	//  args: T のコンストラクタの引数
+	template <typename... Args>
+	Handle create(Args&&... args) {
+		// 空きがなければ新しい塊を確保する
+		if (freeList == none) {
+			const uint32_t base(static_cast<uint32_t>(slabs.size()) * SlabSize);
+			slabs.push_back(std::unique_ptr<Slot[]>(new Slot[SlabSize]));
+			for (uint32_t i = SlabSize; i-- > 0;) {
+				slabs.back()[i].next = freeList;
+				freeList = base + i;
+			}
+		}
+
+		const uint32_t index(freeList);
+		Slot &s(slot(index));
+		new(&s.storage) T(std::forward<Args>(args)...);
+		freeList = s.next;
+		s.alive = true;
+		++live;
+
+		const Handle handle = { index, s.generation };
+		return handle;
+	}
+
+	// オブジェクトを削除する（無効なハンドルなら何もしない）
+	void destroy(Handle handle) {
+		if (get(handle) == NULL) return;
+
+		Slot &s(slot(handle.index));
+		reinterpret_cast<T *>(&s.storage)->~T();
+		s.alive = false;
+
+		// 古いハンドルを無効にする（0 は使わない）
+		if (++s.generation == 0) s.generation = 1;
+		s.next = freeList;
+		freeList = handle.index;
+		--live;
+	}
+
+	// ハンドルの指すオブジェクトを返す（無効なら NULL）
+	T *get(Handle handle) const {
+		if (handle.generation == 0 || handle.index >= slabs.size() * SlabSize) return NULL;
+		Slot &s(slot(handle.index));
+		return s.alive && s.generation == handle.generation
+			? reinterpret_cast<T *>(&s.storage) : NULL;
+	}
+
+	// 生きているオブジェクトの数を返す
+	uint32_t size() const { return live; }
+
+	// 確保した塊の数を返す
+	size_t getSlabCount() const { return slabs.size(); }
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	Pool(const Pool &p);
+
+	// 代入によるコピー禁止
+	Pool &operator=(const Pool &p);
+
+	// 空きリストの終端
+	static const uint32_t none = 0xffffffffu;
+
+	// オブジェクトの置き場
+	struct Slot {
+		alignas(T) unsigned char storage[sizeof(T)];
+		uint32_t generation;
+		uint32_t next;
+		bool alive;
+		Slot() : generation(1), next(none), alive(false) {}
+	};
+
+	// 番号から置き場を求める
+	Slot &slot(uint32_t index) const {
+		return slabs[index / SlabSize][index % SlabSize];
+	}
+
+	// 置き場の塊
+	std::vector<std::unique_ptr<Slot[]>> slabs;
+
+	// 空いている置き場のリストの先頭
+	uint32_t freeList;
+
+	// 生きているオブジェクトの数
+	uint32_t live;
+};
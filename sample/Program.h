@@ -0,0 +1,215 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <GL/glew.h>
+
+// シェーダのソースファイルを読み込む
+//  name: シェーダのソースファイル名
+//  buffer: 読み込んだソースファイルのテキスト
+inline bool readShaderSource(const char *name, std::vector<GLchar> &buffer) {
+	// ファイル名がNULLだった
+	if (name == NULL) {
+		return false;
+	}
+
+	// ソースファイルを開く
+	std::ifstream file(name, std::ios::binary);
+	if (file.fail()) {
+		// 開けなかった
+		std::cerr << "Error: Can't open source file: " << name << std::endl;
+		return false;
+	}
+
+	// ファイルの末尾に移動し現在位置（＝ファイルサイズ）を得る
+	file.seekg(0L, std::ios::end);
+	GLsizei length = static_cast<GLsizei>(file.tellg());
+
+	// ファイルサイズのメモリを確保
+	buffer.resize(length + 1);
+
+	// ファイルを先頭から読み込む
+	file.seekg(0L, std::ios::beg);
+	file.read(buffer.data(), length);
+	buffer[length] = '\0';
+
+	if (file.fail()) {
+		// 読み込めなかった
+		std::cerr << "Error: Could not read source file:" << name << std::endl;
+		file.close();
+		return false;
+	}
+
+	// 読み込み成功
+	file.close();
+	return true;
+}
+
+// シェーダオブジェクトのコンパイル結果を表示する
+//  shader: シェーダオブジェクト名
+//  str: コンパイルエラーが発生した場所を示す文字列
+inline GLboolean printShaderInfoLog(GLuint shader, const char *str) {
+	// コンパイル結果を取得する
+	GLint status;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (status == GL_FALSE) {
+		std::cerr << "Compile Error in " << str << std::endl;
+	}
+
+	// シェーダのコンパイル時のログの長さを取得する
+	GLsizei bufSize;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &bufSize);
+
+	if (bufSize > 1) {
+		// シェーダのコンパイル時のログの内容を取得する
+		std::vector<GLchar> infoLog(bufSize);
+		GLsizei length;
+		glGetShaderInfoLog(shader, bufSize, &length, &infoLog[0]);
+		std::cerr << &infoLog[0] << std::endl;
+	}
+	return static_cast<GLboolean>(status);
+}
+
+// プログラムオブジェクトのリンク結果を表示する
+//  program: プログラムオブジェクト名
+inline GLboolean printProgramInfoLog(GLuint program) {
+	// リンク結果を取得する
+	GLint status;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE) {
+		std::cerr << "Link Error." << std::endl;
+	}
+
+	// シェーダのリンク時のログの長さを取得する
+	GLsizei bufSize;
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &bufSize);
+	if (bufSize > 1) {
+		// シェーダのリンク時のログの内容を取得する
+		std::vector<GLchar> infoLog(bufSize);
+		GLsizei length;
+		glGetProgramInfoLog(program, bufSize, &length, &infoLog[0]);
+		std::cerr << &infoLog[0] << std::endl;
+	}
+	return static_cast<GLboolean>(status);
+}
+
+// プログラムオブジェクトを作成する
+//  vsrc: バーテックスシェーダのソースファイル名
+//  fsrc: フラグメントシェーダのソースファイル名
+//  gsrc: ジオメトリシェーダのソースファイル名（使わなければ NULL）
+inline GLuint createProgram(const char *vsrc, const char *fsrc, const char *gsrc = NULL) {
+
+	// 空のプログラムオブジェクトを作成する
+	const GLuint program(glCreateProgram());
+
+	if (vsrc != NULL) {
+		// バーテックスシェーダのシェーダオブジェクトを作成する
+		const GLuint vobj(glCreateShader(GL_VERTEX_SHADER));
+		glShaderSource(vobj, 1, &vsrc, NULL);
+		glCompileShader(vobj);
+
+		// バーテックスシェーダのシェーダオブジェクトをプログラムオブジェクトに組み込む
+		if (printShaderInfoLog(vobj, "vertex shader")) {
+			glAttachShader(program, vobj);
+		}
+		glDeleteShader(vobj);
+	}
+
+	if (gsrc != NULL) {
+		// ジオメトリシェーダのシェーダオブジェクトを作成する
+		const GLuint gobj(glCreateShader(GL_GEOMETRY_SHADER));
+		glShaderSource(gobj, 1, &gsrc, NULL);
+		glCompileShader(gobj);
+
+		// ジオメトリシェーダのシェーダオブジェクトをプログラムオブジェクトに組み込む
+		if (printShaderInfoLog(gobj, "geometry shader")) {
+			glAttachShader(program, gobj);
+		}
+		glDeleteShader(gobj);
+	}
+
+	if (fsrc != NULL) {
+		// フラグメントシェーダのシェーダオブジェクトを作成する
+		const GLuint fobj(glCreateShader(GL_FRAGMENT_SHADER));
+		glShaderSource(fobj, 1, &fsrc, NULL);
+		glCompileShader(fobj);
+
+		// フラグメントシェーダのシェーダオブジェクトをプログラムオブジェクトに組み込む
+		if (printShaderInfoLog(fobj, "fragment shader")) {
+			glAttachShader(program, fobj);
+		}
+		glDeleteShader(fobj);
+	}
+
+	// プログラムオブジェクトをリンクする
+	glBindAttribLocation(program, 0, "position");
+	glBindAttribLocation(program, 1, "normal");
+	glBindAttribLocation(program, 2, "texcoord");
+	glBindAttribLocation(program, 3, "color");
+	glBindFragDataLocation(program, 0, "fragment");
+	glLinkProgram(program);
+
+	// 作成したプログラムオブジェクトを返す
+	if (printProgramInfoLog(program)) {
+		return program;
+	}
+
+	// プログラムオブジェクトが作成できなければ 0 を返す
+	glDeleteProgram(program);
+	return 0;
+}
+
+// シェーダのソースファイルを読み込んでプログラムオブジェクトを作成する
+//  vert: バーテックスシェーダのソースファイル名
+//  frag: フラグメントシェーダのソースファイル名
+//  geom: ジオメトリシェーダのソースファイル名（使わなければ NULL）
+inline GLuint loadProgram(const char *vert, const char *frag, const char *geom = NULL) {
+	// シェーダのソースファイルを読み込む
+	std::vector<GLchar> vsrc;
+	const bool vstat(readShaderSource(vert, vsrc));
+	std::vector<GLchar> fsrc;
+	const bool fstat(readShaderSource(frag, fsrc));
+	std::vector<GLchar> gsrc;
+	const bool gstat(geom == NULL || readShaderSource(geom, gsrc));
+
+	return vstat && fstat && gstat
+		? createProgram(vsrc.data(), fsrc.data(), geom == NULL ? NULL : gsrc.data()) : 0;
+}
+
+// コンピュートシェーダだけのプログラムオブジェクトを作成する
+//  csrc: コンピュートシェーダのソースプログラムの文字列
+inline GLuint createComputeProgram(const char *csrc) {
+	// 空のプログラムオブジェクトを作成する
+	const GLuint program(glCreateProgram());
+
+	// コンピュートシェーダのシェーダオブジェクトを作成する
+	const GLuint cobj(glCreateShader(GL_COMPUTE_SHADER));
+	glShaderSource(cobj, 1, &csrc, NULL);
+	glCompileShader(cobj);
+
+	// コンピュートシェーダのシェーダオブジェクトをプログラムオブジェクトに組み込む
+	if (printShaderInfoLog(cobj, "compute shader")) {
+		glAttachShader(program, cobj);
+	}
+	glDeleteShader(cobj);
+
+	// プログラムオブジェクトをリンクする
+	glLinkProgram(program);
+
+	// 作成したプログラムオブジェクトを返す
+	if (printProgramInfoLog(program)) {
+		return program;
+	}
+
+	// プログラムオブジェクトが作成できなければ 0 を返す
+	glDeleteProgram(program);
+	return 0;
+}
+
+// シェーダのソースファイルを読み込んでコンピュートシェーダのプログラムオブジェクトを作成する
+//  comp: コンピュートシェーダのソースファイル名
+inline GLuint loadComputeProgram(const char *comp) {
+	// シェーダのソースファイルを読み込む
+	std::vector<GLchar> csrc;
+	return readShaderSource(comp, csrc) ? createComputeProgram(csrc.data()) : 0;
+}
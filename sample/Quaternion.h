@@ -0,0 +1,118 @@
+#pragma once
+#include <cmath>
+#include <GL/glew.h>
+
+// 四元数（回転の表現）
+class Quaternion {
+public:
+	// コンストラクタ（恒等回転）
+	Quaternion() : w(1.0f), x(0.0f), y(0.0f), z(0.0f) {}
+
+	// 要素を指定して初期化するコンストラクタ
+	Quaternion(GLfloat w, GLfloat x, GLfloat y, GLfloat z)
+		: w(w), x(x), y(y), z(z) {}
+
+	// (x, y, z)を軸に theta回転する四元数を作成する
+	static Quaternion rotate(GLfloat theta, GLfloat x, GLfloat y, GLfloat z) {
+		const GLfloat d(sqrt(x * x + y * y + z * z));
+		if (d == 0.0f) return Quaternion();
+
+		// sin と cos は半角について一度ずつしか求めない
+		const GLfloat h(theta * 0.5f);
+		const GLfloat s(sin(h) / d);
+		return Quaternion(cos(h), x * s, y * s, z * s);
+	}
+
+	// 乗算（q * r は r の後に q を適用する回転）
+	Quaternion operator*(const Quaternion &r) const {
+		return Quaternion(
+			w * r.w - x * r.x - y * r.y - z * r.z,
+			w * r.x + x * r.w + y * r.z - z * r.y,
+			w * r.y - x * r.z + y * r.w + z * r.x,
+			w * r.z + x * r.y - y * r.x + z * r.w);
+	}
+
+	// 加算
+	Quaternion operator+(const Quaternion &r) const {
+		return Quaternion(w + r.w, x + r.x, y + r.y, z + r.z);
+	}
+
+	// スカラー倍
+	Quaternion operator*(GLfloat s) const {
+		return Quaternion(w * s, x * s, y * s, z * s);
+	}
+
+	// 内積
+	GLfloat dot(const Quaternion &r) const {
+		return w * r.w + x * r.x + y * r.y + z * r.z;
+	}
+
+	// 共役（単位四元数なら逆回転）
+	Quaternion conjugate() const {
+		return Quaternion(w, -x, -y, -z);
+	}
+
+	// 正規化する
+	Quaternion normalize() const {
+		const GLfloat d(sqrt(dot(*this)));
+		return d > 0.0f ? *this * (1.0f / d) : Quaternion();
+	}
+
+	// ベクトル v を回転する
+	//  v: 3要素の配列, r: 結果の格納先
+	void apply(const GLfloat *v, GLfloat *r) const {
+		// t = 2 (q.xyz × v)
+		const GLfloat tx(2.0f * (y * v[2] - z * v[1]));
+		const GLfloat ty(2.0f * (z * v[0] - x * v[2]));
+		const GLfloat tz(2.0f * (x * v[1] - y * v[0]));
+
+		// r = v + w t + q.xyz × t
+		r[0] = v[0] + w * tx + (y * tz - z * ty);
+		r[1] = v[1] + w * ty + (z * tx - x * tz);
+		r[2] = v[2] + w * tz + (x * ty - y * tx);
+	}
+
+	// 回転行列（3x3 列優先）を求める
+	//  m: 9要素の配列
+	void getMatrix(GLfloat *m) const {
+		const GLfloat xx(x * x), yy(y * y), zz(z * z);
+		const GLfloat xy(x * y), yz(y * z), zx(z * x);
+		const GLfloat wx(w * x), wy(w * y), wz(w * z);
+
+		m[0] = 1.0f - 2.0f * (yy + zz);
+		m[1] = 2.0f * (xy + wz);
+		m[2] = 2.0f * (zx - wy);
+		m[3] = 2.0f * (xy - wz);
+		m[4] = 1.0f - 2.0f * (zz + xx);
+		m[5] = 2.0f * (yz + wx);
+		m[6] = 2.0f * (zx + wy);
+		m[7] = 2.0f * (yz - wx);
+		m[8] = 1.0f - 2.0f * (xx + yy);
+	}
+
+	// 正規化線形補間
+	//  t: 0 で a, 1 で b
+	static Quaternion nlerp(const Quaternion &a, const Quaternion &b, GLfloat t) {
+		// 短い方の弧を通るように符号を揃える
+		const GLfloat s(a.dot(b) < 0.0f ? -t : t);
+		return (a * (1.0f - t) + b * s).normalize();
+	}
+
+	// 球面線形補間
+	//  t: 0 で a, 1 で b
+	static Quaternion slerp(const Quaternion &a, const Quaternion &b, GLfloat t) {
+		GLfloat c(a.dot(b));
+		const GLfloat sign(c < 0.0f ? -1.0f : 1.0f);
+		c *= sign;
+
+		// ほとんど同じ向きなら sin で割れないので nlerp で代用する
+		if (c > 0.9995f) return nlerp(a, b, t);
+
+		const GLfloat theta(acos(c));
+		const GLfloat s(1.0f / sin(theta));
+		return a * (sin((1.0f - t) * theta) * s) + b * (sin(t * theta) * s * sign);
+	}
+
+	// 要素
+	GLfloat w, x, y, z;
+};
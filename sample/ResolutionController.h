@@ -0,0 +1,58 @@
+#pragma once
+#include <cmath>
+#include <algorithm>
+#include <GL/glew.h>
+
+// 計測したフレーム時間から描画解像度の倍率を決める
+class ResolutionController {
+public:
+	// コンストラクタ
+	//  budget: 目標とする 1フレームの GPU 時間（秒）
+	//  minScale, maxScale: 解像度の倍率の範囲
+	ResolutionController(double budget = 0.9 / 60.0, GLfloat minScale = 0.5f, GLfloat maxScale = 1.0f)
+		: budget(budget), minScale(minScale), maxScale(maxScale)
+		, scale(maxScale), smoothed(-1.0)
+	{
+	}
+
+	// 計測したフレーム時間を与えて倍率を更新する
+	//  time: GPU の処理時間（秒）
+	void update(double time) {
+		if (time <= 0.0) return;
+
+		// 急な変化に数フレームで追従するように強めに平滑化する
+		smoothed = smoothed < 0.0 ? time : smoothed + 0.3 * (time - smoothed);
+
+		// 処理時間は画素数（倍率の二乗）にほぼ比例する
+		const double ratio(budget / smoothed);
+
+		// 目標の前後 5% 以内なら変えない（振動を防ぐ）
+		if (ratio > 0.95 && ratio < 1.05) return;
+
+		// 一度に変える量は制限する
+		const double step(std::min(std::max(std::sqrt(ratio), 0.85), 1.1));
+		scale = std::min(std::max(static_cast<GLfloat>(scale * step), minScale), maxScale);
+	}
+
+	// 目標のフレーム時間を設定する
+	void setBudget(double time) { budget = time; }
+
+	// 現在の倍率を返す
+	GLfloat getScale() const { return scale; }
+
+	// 平滑化したフレーム時間を返す
+	double getFrameTime() const { return smoothed; }
+
+private:
+	// 目標のフレーム時間
+	double budget;
+
+	// 倍率の範囲
+	const GLfloat minScale, maxScale;
+
+	// 現在の倍率
+	GLfloat scale;
+
+	// 平滑化したフレーム時間
+	double smoothed;
+};
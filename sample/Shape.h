@@ -1,6 +1,8 @@
 #pragma once
-#include <memory>
+#include <algorithm>
 #include "Object.h"
+#include "Pool.h"
+#include "GlTrace.h"
 
 
 class Shape {
@@ -14,31 +16,70 @@ public:
 	//  index: 頂点のインデックスを格納した配列
 	Shape(GLint size, GLsizei vertexcount, const Object::Vertex *vertex,
 		GLsizei indexcount = 0, const GLuint *index = NULL)
-		: object(new Object(size, vertexcount, vertex, indexcount, index))
-		, vertexcount(vertexcount)
+		: vertexcount(vertexcount)
+		, object(objects().create(size, vertexcount, vertex, indexcount, index))
 	{
+		// 境界ボックスを求める
+		std::fill(bmin, bmin + 3, 0.0f);
+		std::fill(bmax, bmax + 3, 0.0f);
+		for (GLsizei i = 0; i < vertexcount; i++) {
+			for (GLint k = 0; k < size && k < 3; k++) {
+				const GLfloat p(vertex[i].position[k]);
+				if (i == 0 || p < bmin[k]) bmin[k] = p;
+				if (i == 0 || p > bmax[k]) bmax[k] = p;
+			}
+		}
+	}
+
+	// デストラクタ
+	virtual ~Shape() {
+		// 図形データを削除する
+		objects().destroy(object);
 	}
 
 	// 描画
-	void draw() const {
+	//  instances: 同じ図形を描く回数（マルチビューではビューの数）
+	void draw(GLsizei instances = 1) const {
 		// 頂点配列オブジェクトを結合する
-		object->bind();
+		objects().get(object)->bind();
 		// 描画を実行する
-		execute();
+		execute(instances);
 	}
 
 	// 描画の実行
-	virtual void execute() const {
+	//  instances: 同じ図形を描く回数
+	virtual void execute(GLsizei instances) const {
 		// 折れ線で描画する
-		glDrawArrays(GL_LINE_LOOP, 0, vertexcount);
+		GlTrace::drawArrays(GL_LINE_LOOP, 0, vertexcount, instances);
 	}
 
+	// 境界ボックスの最小点を返す
+	const GLfloat *getBoundsMin() const { return bmin; }
+
+	// 境界ボックスの最大点を返す
+	const GLfloat *getBoundsMax() const { return bmax; }
+
 protected:
 	// 描画に使う頂点の数
 	const GLsizei vertexcount;
 
 private:
+	// コピーコンストラクタによるコピー禁止
+	Shape(const Shape &s);
+
+	// 代入によるコピー禁止
+	Shape &operator=(const Shape &s);
+
+	// 図形データのプール
+	static Pool<Object> &objects() {
+		static Pool<Object> pool;
+		return pool;
+	}
+
 	// 図形データ
-	std::shared_ptr<const Object> object;
+	const Pool<Object>::Handle object;
+
+	// 境界ボックスの最小点と最大点
+	GLfloat bmin[3], bmax[3];
 
 };
\ No newline at end of file
@@ -23,8 +23,8 @@ public:
 	}
 
 	// 描画の実行
-	virtual void execute() const {
+	virtual void execute(GLsizei instances) const {
 		// 線分群で描画する
-		glDrawElements(GL_LINES, indexcount, GL_UNSIGNED_INT, 0);
+		GlTrace::drawElements(GL_LINES, indexcount, GL_UNSIGNED_INT, 0, instances);
 	}
 };
\ No newline at end of file
@@ -16,8 +16,8 @@ public:
 	}
 
 	// 描画の実行
-	virtual void execute() const {
+	virtual void execute(GLsizei instances) const {
 		// 三角形で描画する
-		glDrawArrays(GL_TRIANGLES, 0, vertexcount);
+		GlTrace::drawArrays(GL_TRIANGLES, 0, vertexcount, instances);
 	}
 };
\ No newline at end of file
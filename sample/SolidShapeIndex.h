@@ -19,8 +19,8 @@ public:
 	}
 
 	// 描画の実行
-	virtual void execute() const {
+	virtual void execute(GLsizei instances) const {
 		// 三角形で描画する
-		glDrawElements(GL_TRIANGLES, indexcount, GL_UNSIGNED_INT, 0);
+		GlTrace::drawElements(GL_TRIANGLES, indexcount, GL_UNSIGNED_INT, 0, instances);
 	}
 };
\ No newline at end of file
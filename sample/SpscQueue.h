@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// 単一の書き込みスレッドと単一の読み出しスレッドの間のロックフリーな待ち行列
+//  T: 要素の型
+//  Size: 容量（2のべき乗）
+template <typename T, size_t Size>
+class SpscQueue {
+	static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+public:
+	// コンストラクタ
+	SpscQueue() : head(0), tail(0) {}
+
+	// 要素を追加する（書き込みスレッドから呼ぶ）
+	//  満杯なら false を返す
+	bool push(const T &value) {
+		const size_t t(tail.load(std::memory_order_relaxed));
+		if (t - head.load(std::memory_order_acquire) == Size) return false;
+		buffer[t & (Size - 1)] = value;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// 要素を取り出す（読み出しスレッドから呼ぶ）
+	//  空なら false を返す
+	bool pop(T &value) {
+		const size_t h(head.load(std::memory_order_relaxed));
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		value = buffer[h & (Size - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// 溜まっている要素の数を返す（どちらのスレッドからも呼べるが目安）
+	size_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+private:
+	// 要素
+	T buffer[Size];
+
+	// 読み出し位置と書き込み位置（別のキャッシュラインに置く）
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+};
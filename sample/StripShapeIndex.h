@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ShapeIndex.h"
+
+// インデックスを使った三角形ストリップによる描画
+//  restart のインデックスで区切った複数のストリップを一度に描く
+
+class StripShapeIndex : public ShapeIndex {
+public:
+	// ストリップを区切るインデックス
+	static const GLuint restart = 0xffffffff;
+
+	// コンストラクタ
+	//  size: 頂点の位置の次元
+	//  vertexcount: 頂点の数
+	//  vertex: 頂点属性を格納した配列
+	//  indexcount: 頂点のインデックスの要素数
+	//  index: 頂点のインデックスを格納した配列（ストリップの間に restart を置く）
+	StripShapeIndex(GLint size, GLsizei vertexcount, const Object::Vertex *vertex,
+		GLsizei indexcount = 0, const GLuint *index = NULL)
+		: ShapeIndex(size, vertexcount, vertex, indexcount, index) {
+
+	}
+
+	// 描画の実行
+	virtual void execute(GLsizei instances) const {
+		// 三角形ストリップで描画する
+		GlTrace::primitiveRestart(true, restart);
+		GlTrace::drawElements(GL_TRIANGLE_STRIP, indexcount, GL_UNSIGNED_INT, 0, instances);
+		GlTrace::primitiveRestart(false);
+	}
+};
@@ -0,0 +1,647 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <GL/glew.h>
+#include "Object.h"
+#include "Matrix.h"
+#include "MappedFile.h"
+
+// 高さの標本を格子状に並べた地形（ジオミップマップ）
+//  地形は chunk x chunk の格子のチャンクに分けたタイルファイルから読み込む．
+//  チャンクの頂点は一つの頂点バッファの決まった数のスロットに置き，
+//  レベルと隣接するチャンクとのつなぎ目の組み合わせごとのインデックスを全チャンクで共有する．
+//  レベルは視点からの距離と透視投影の画角から画面上の誤差が許容値以下になるように選び，
+//  隣接するチャンクのレベルの差は 1 以下にする．
+//  チャンクはバックグラウンドのスレッドで読み込み，描画スレッドで転送する
+//
+//  タイルファイルの形式（リトルエンディアン）
+//   0: "TRN1", 4: chunk, 8: 横のチャンク数, 12: 奥行きのチャンク数（uint32_t）
+//   16: 標本の間隔, 20: 高さの単位（float）, 24: 予約
+//   32 以降: チャンクごとに (chunk + 3)^2 個の uint16_t の高さ
+//    （周りに隣のチャンクの標本を 1 つずつ余分に持ち，境界の法線を隣と揃える．地形の端では端の標本を繰り返す）
+class Terrain {
+public:
+	// 高さの標本からタイルファイルを作る
+	//  name: 出力するファイル名
+	//  height: 高さの標本（width x depth）
+	//  width, depth: 標本の数（chunk の倍数 + 1 に切り詰める）
+	//  chunk: チャンクの格子の数（2 のべき乗で 128 以下）
+	//  spacing: 標本の間隔
+	//  scale: 高さの単位
+	static bool build(const char *name, const uint16_t *height, int width, int depth,
+		int chunk, GLfloat spacing, GLfloat scale) {
+		const uint32_t cx(chunk > 0 ? (width - 1) / chunk : 0), cz(chunk > 0 ? (depth - 1) / chunk : 0);
+		if (cx == 0 || cz == 0 || chunk < 2 || chunk > 128 || (chunk & (chunk - 1)) != 0) {
+			std::fprintf(stderr, "Bad terrain size: %d x %d samples, chunk %d\n", width, depth, chunk);
+			return false;
+		}
+
+		FILE *const fp(std::fopen(name, "wb"));
+		if (fp == NULL) {
+			std::fprintf(stderr, "Can't create terrain: %s\n", name);
+			return false;
+		}
+
+		unsigned char header[headerSize] = { 'T', 'R', 'N', '1' };
+		const uint32_t c(chunk);
+		std::memcpy(header + 4, &c, 4);
+		std::memcpy(header + 8, &cx, 4);
+		std::memcpy(header + 12, &cz, 4);
+		std::memcpy(header + 16, &spacing, 4);
+		std::memcpy(header + 20, &scale, 4);
+		bool ok(std::fwrite(header, headerSize, 1, fp) == 1);
+
+		const int row(chunk + 3);
+		std::vector<uint16_t> tile(row * row);
+		for (uint32_t z = 0; z < cz && ok; z++) {
+			for (uint32_t x = 0; x < cx && ok; x++) {
+				for (int j = 0; j < row; j++) {
+					const int sz(std::min(std::max(static_cast<int>(z) * chunk + j - 1, 0), depth - 1));
+					for (int i = 0; i < row; i++) {
+						const int sx(std::min(std::max(static_cast<int>(x) * chunk + i - 1, 0), width - 1));
+						tile[j * row + i] = height[size_t(sz) * width + sx];
+					}
+				}
+				ok = std::fwrite(tile.data(), sizeof(uint16_t), tile.size(), fp) == tile.size();
+			}
+		}
+
+		return std::fclose(fp) == 0 && ok;
+	}
+
+	// コンストラクタ
+	//  name: タイルファイル名
+	//  capacity: 頂点バッファに置けるチャンクの数
+	//  threads: 読み込みに使うスレッドの数
+	//  tolerance: 画面上で許す誤差（画素）
+	Terrain(const char *name, int capacity = 256, int threads = 2, GLfloat tolerance = 2.0f)
+		: file(name), chunk(0), countX(0), countZ(0), spacing(1.0f), scale(1.0f), levels(0)
+		, capacity(capacity), tolerance(tolerance), vao(0), vbo(0), ibo(0)
+		, frame(0), drawn(0), stop(false), jobHead(0), jobTail(0), doneHead(0), doneTail(0)
+	{
+		// ヘッダを確かめる
+		const unsigned char *const p(file.data());
+		if (p == NULL || file.size() < headerSize || std::memcmp(p, "TRN1", 4) != 0) {
+			std::fprintf(stderr, "Can't load terrain: %s\n", name);
+			return;
+		}
+		uint32_t c, cx, cz;
+		std::memcpy(&c, p + 4, 4);
+		std::memcpy(&cx, p + 8, 4);
+		std::memcpy(&cz, p + 12, 4);
+		std::memcpy(&spacing, p + 16, 4);
+		std::memcpy(&scale, p + 20, 4);
+		if (c < 2 || c > 128 || (c & (c - 1)) != 0
+			|| file.size() < headerSize + size_t(cx) * cz * (c + 3) * (c + 3) * sizeof(uint16_t)) {
+			std::fprintf(stderr, "Broken terrain: %s\n", name);
+			return;
+		}
+		chunk = c;
+		countX = cx;
+		countZ = cz;
+		levels = 1;
+		while ((chunk >> levels) > 0 && levels < maxLevels) ++levels;
+
+		chunks.resize(countX * countZ);
+		candidates.reserve(chunks.size());
+		nearest.reserve(chunks.size());
+		slots.assign(capacity, -1);
+
+		// 頂点バッファはチャンク capacity 個分だけ確保する
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glGenBuffers(1, &vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, capacity * vertexCount() * sizeof(Object::Vertex), NULL, GL_DYNAMIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Object::Vertex), static_cast<Object::Vertex *>(0)->position);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Object::Vertex), static_cast<Object::Vertex *>(0)->normal);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Object::Vertex), static_cast<Object::Vertex *>(0)->texcoord);
+		glEnableVertexAttribArray(2);
+
+		// 全チャンクで共有するインデックスを作る
+		buildIndex();
+
+		// 読み込みに使う作業領域はスレッドあたり 2つ
+		staging.resize(threads * 2);
+		for (Staging &s : staging) s.vertex.resize(vertexCount());
+		for (size_t i = staging.size(); i-- > 0;) freeStaging.push_back(static_cast<int>(i));
+		jobs.resize(staging.size() + 1);
+		done.resize(staging.size() + 1);
+
+		for (int i = 0; i < threads; i++) workers.emplace_back(&Terrain::work, this);
+	}
+
+	// デストラクタ
+	virtual ~Terrain() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_all();
+		for (std::thread &t : workers) t.join();
+
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &vbo);
+		glDeleteBuffers(1, &ibo);
+	}
+
+	// 読み込めたか
+	bool isValid() const { return chunk > 0; }
+
+	// 各チャンクのレベルを選び，読み込みと転送を進める（描画スレッドで毎フレーム呼ぶ）
+	//  eye: 地形の座標系での視点の位置
+	//  fovy: 透視投影の画角
+	//  zFar: 透視投影の後方面までの距離（地形の座標系）
+	//  viewportHeight: ビューポートの高さ（画素）
+	//  uploads: このフレームで転送するチャンクの数の上限
+	void update(const GLfloat *eye, GLfloat fovy, GLfloat zFar, GLsizei viewportHeight, int uploads = 4) {
+		if (!isValid()) return;
+		++frame;
+
+		// 読み込み終わったチャンクを転送する
+		upload(uploads);
+
+		// 距離 1 での誤差 1 が画面上で何画素になるか
+		const GLfloat k(viewportHeight * 0.5f / std::tan(fovy * 0.5f));
+
+		// 後方面より近いチャンクのうち水平方向に近いものから頂点バッファに置ける数だけを必要とする
+		//  （全部を必要とすると追い出せるチャンクがなくなり，読み込んでは捨てることを繰り返す）
+		nearest.clear();
+		for (int i = 0; i < static_cast<int>(chunks.size()); i++) {
+			Chunk &c(chunks[i]);
+			c.distance = distance(i, eye);
+			c.wanted = false;
+			if (c.distance < zFar) nearest.push_back(i);
+		}
+		if (nearest.size() > static_cast<size_t>(capacity)) {
+			const GLfloat size(chunk * spacing);
+			for (int i : nearest) {
+				const GLfloat x0((i % countX) * size), z0((i / countX) * size);
+				const GLfloat dx(std::max(std::max(x0 - eye[0], eye[0] - x0 - size), 0.0f));
+				const GLfloat dz(std::max(std::max(z0 - eye[2], eye[2] - z0 - size), 0.0f));
+				chunks[i].planar = dx * dx + dz * dz;
+			}
+			std::nth_element(nearest.begin(), nearest.begin() + capacity, nearest.end(),
+				[this](int a, int b) { return chunks[a].planar < chunks[b].planar || (chunks[a].planar == chunks[b].planar && a < b); });
+			nearest.resize(capacity);
+		}
+		for (int i : nearest) chunks[i].wanted = true;
+
+		// 必要なチャンクが読み込まれていれば誤差からレベルを選ぶ
+		candidates.clear();
+		for (int i = 0; i < static_cast<int>(chunks.size()); i++) {
+			Chunk &c(chunks[i]);
+			if (!c.wanted) continue;
+			c.used = frame;
+
+			if (c.state == RESIDENT) {
+				c.level = 0;
+				while (c.level + 1 < levels && c.error[c.level + 1] * k <= tolerance * std::max(c.distance, 1e-3f)) {
+					++c.level;
+				}
+			}
+			else if (c.state == EMPTY) {
+				candidates.push_back(i);
+			}
+		}
+
+		// 隣接するチャンクとのレベルの差を 1 以下にする
+		for (bool changed(true); changed;) {
+			changed = false;
+			for (int i = 0; i < static_cast<int>(chunks.size()); i++) {
+				Chunk &c(chunks[i]);
+				if (c.state != RESIDENT || !c.wanted) continue;
+				for (int e = 0; e < 4; e++) {
+					const int n(neighbor(i, e));
+					if (n >= 0 && chunks[n].state == RESIDENT && chunks[n].wanted && c.level > chunks[n].level + 1) {
+						c.level = chunks[n].level + 1;
+						changed = true;
+					}
+				}
+			}
+		}
+
+		// 隣接するチャンクが粗いレベルならその辺を合わせる
+		for (int i = 0; i < static_cast<int>(chunks.size()); i++) {
+			Chunk &c(chunks[i]);
+			c.mask = 0;
+			if (c.state != RESIDENT || !c.wanted) continue;
+			for (int e = 0; e < 4; e++) {
+				const int n(neighbor(i, e));
+				if (n >= 0 && chunks[n].state == RESIDENT && chunks[n].wanted && chunks[n].level > c.level) {
+					c.mask |= 1 << e;
+				}
+			}
+		}
+
+		// 近いチャンクから読み込みを依頼する
+		std::sort(candidates.begin(), candidates.end(),
+			[this](int a, int b) { return chunks[a].distance < chunks[b].distance; });
+		bool requested(false);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (size_t i = 0; i < candidates.size() && !freeStaging.empty(); i++) {
+				const Job job = { candidates[i], freeStaging.back() };
+				freeStaging.pop_back();
+				chunks[job.chunk].state = REQUESTED;
+				jobs[jobTail] = job;
+				jobTail = (jobTail + 1) % jobs.size();
+				requested = true;
+			}
+		}
+		if (requested) wake.notify_all();
+	}
+
+	// 見えるチャンクを描画する
+	//  projectionView: 地形の座標系からクリッピング座標系への変換行列
+	void draw(const Matrix &projectionView) {
+		drawn = 0;
+		if (!isValid()) return;
+
+		// 視錐台の 6平面を求める
+		GLfloat plane[6][4];
+		const GLfloat *const m(projectionView.data());
+		for (int p = 0; p < 6; p++) {
+			const int row(p / 2);
+			const GLfloat sign(p % 2 == 0 ? 1.0f : -1.0f);
+			for (int j = 0; j < 4; j++) plane[p][j] = m[j * 4 + 3] + sign * m[j * 4 + row];
+		}
+
+		glBindVertexArray(vao);
+		for (const Chunk &c : chunks) {
+			if (c.state != RESIDENT || !c.wanted || !inside(plane, c.bmin, c.bmax)) continue;
+			const Range &r(ranges[c.level * 16 + c.mask]);
+			glDrawElementsBaseVertex(GL_TRIANGLES, r.count, GL_UNSIGNED_SHORT,
+				static_cast<GLushort *>(0) + r.first, c.slot * vertexCount());
+			++drawn;
+		}
+	}
+
+	// 地形の横と奥行きの大きさを返す
+	GLfloat getWidth() const { return countX * chunk * spacing; }
+	GLfloat getDepth() const { return countZ * chunk * spacing; }
+
+	// 前回の draw() で描いたチャンクの数を返す
+	int getDrawnCount() const { return drawn; }
+
+	// 頂点バッファに置かれているチャンクの数を返す
+	int getResidentCount() const {
+		return static_cast<int>(std::count_if(slots.begin(), slots.end(), [](int s) { return s >= 0; }));
+	}
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	Terrain(const Terrain &t);
+
+	// 代入によるコピー禁止
+	Terrain &operator=(const Terrain &t);
+
+	// タイルファイルのヘッダの大きさ
+	static const size_t headerSize = 32;
+
+	// レベルの数の上限
+	static const int maxLevels = 9;
+
+	// チャンクの状態
+	enum State { EMPTY, REQUESTED, RESIDENT };
+
+	// チャンク
+	struct Chunk {
+		// 状態
+		State state;
+		// 頂点バッファのスロット
+		int slot;
+		// 描画するレベル
+		int level;
+		// 粗いレベルに合わせる辺（-x, +x, -z, +z の順のビット）
+		int mask;
+		// 後方面より近く，頂点バッファに置く対象か
+		bool wanted;
+		// 最後に必要とされたフレーム
+		unsigned int used;
+		// 視点からの距離
+		GLfloat distance;
+		// 視点からの水平方向の距離の 2乗（置く対象を選ぶときだけ求める）
+		GLfloat planar;
+		// 境界ボックス
+		GLfloat bmin[3], bmax[3];
+		// 各レベルで省いた標本の高さの誤差の最大値
+		GLfloat error[maxLevels];
+
+		Chunk() : state(EMPTY), slot(-1), level(0), mask(0), wanted(false), used(0), distance(0.0f), planar(0.0f) {}
+	};
+
+	// 読み込みの作業領域
+	struct Staging {
+		// 読み込んだチャンク
+		int chunk;
+		// 頂点属性
+		std::vector<Object::Vertex> vertex;
+		// 高さの範囲
+		GLfloat ymin, ymax;
+		// 各レベルの誤差
+		GLfloat error[maxLevels];
+	};
+
+	// 読み込みの依頼
+	struct Job {
+		// チャンクの番号
+		int chunk;
+		// 作業領域の番号
+		int staging;
+	};
+
+	// インデックスの範囲
+	struct Range {
+		GLsizei first, count;
+	};
+
+	// タイルファイル
+	MappedFile file;
+
+	// チャンクの格子の数
+	int chunk;
+
+	// 横と奥行きのチャンクの数
+	int countX, countZ;
+
+	// 標本の間隔と高さの単位
+	GLfloat spacing, scale;
+
+	// レベルの数
+	int levels;
+
+	// 頂点バッファに置けるチャンクの数
+	const int capacity;
+
+	// 画面上で許す誤差
+	const GLfloat tolerance;
+
+	// 頂点配列オブジェクト，頂点バッファオブジェクト，インデックスのバッファオブジェクト
+	GLuint vao, vbo, ibo;
+
+	// レベルとつなぎ目の組み合わせごとのインデックスの範囲
+	std::vector<Range> ranges;
+
+	// チャンク
+	std::vector<Chunk> chunks;
+
+	// 頂点バッファのスロットに置かれているチャンク（空きなら -1）
+	std::vector<int> slots;
+
+	// 読み込みを依頼するチャンク
+	std::vector<int> candidates;
+
+	// 後方面より近いチャンク
+	std::vector<int> nearest;
+
+	// フレームの番号
+	unsigned int frame;
+
+	// 描いたチャンクの数
+	int drawn;
+
+	// 読み込みの作業領域
+	std::vector<Staging> staging;
+
+	// 空いている作業領域（描画スレッドだけが使う）
+	std::vector<int> freeStaging;
+
+	// 読み込みの依頼と読み込み終わった作業領域の待ち行列
+	std::vector<Job> jobs;
+	std::vector<int> done;
+
+	// 読み込みのスレッド
+	std::vector<std::thread> workers;
+
+	// 待ち行列の排他制御
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stop;
+	size_t jobHead, jobTail, doneHead, doneTail;
+
+	// チャンクあたりの頂点の数
+	int vertexCount() const { return (chunk + 1) * (chunk + 1); }
+
+	// 辺 e (-x, +x, -z, +z) で隣接するチャンクの番号（なければ -1）
+	int neighbor(int i, int e) const {
+		const int x(i % countX), z(i / countX);
+		switch (e) {
+		case 0: return x > 0 ? i - 1 : -1;
+		case 1: return x + 1 < countX ? i + 1 : -1;
+		case 2: return z > 0 ? i - countX : -1;
+		default: return z + 1 < countZ ? i + countX : -1;
+		}
+	}
+
+	// 視点からチャンクまでの距離（読み込む前は高さを無視する）
+	GLfloat distance(int i, const GLfloat *eye) const {
+		const Chunk &c(chunks[i]);
+		const GLfloat size(chunk * spacing);
+		const GLfloat x0((i % countX) * size), z0((i / countX) * size);
+		const GLfloat dx(std::max(std::max(x0 - eye[0], eye[0] - x0 - size), 0.0f));
+		const GLfloat dz(std::max(std::max(z0 - eye[2], eye[2] - z0 - size), 0.0f));
+		const GLfloat dy(c.state == RESIDENT ? std::max(std::max(c.bmin[1] - eye[1], eye[1] - c.bmax[1]), 0.0f) : 0.0f);
+		return std::sqrt(dx * dx + dy * dy + dz * dz);
+	}
+
+	// 境界ボックスが視錐台の 6平面の内側にかかっているか
+	static bool inside(const GLfloat (*plane)[4], const GLfloat *bmin, const GLfloat *bmax) {
+		for (int p = 0; p < 6; p++) {
+			const GLfloat *const q(plane[p]);
+			const GLfloat x(q[0] > 0.0f ? bmax[0] : bmin[0]);
+			const GLfloat y(q[1] > 0.0f ? bmax[1] : bmin[1]);
+			const GLfloat z(q[2] > 0.0f ? bmax[2] : bmin[2]);
+			if (q[0] * x + q[1] * y + q[2] * z + q[3] < 0.0f) return false;
+		}
+		return true;
+	}
+
+	// レベルとつなぎ目の組み合わせごとのインデックスを作る
+	//  粗い隣に合わせる辺では奇数番目の頂点を一つ前の頂点に寄せて縮退させる
+	void buildIndex() {
+		std::vector<GLushort> index;
+		const int row(chunk + 1);
+		for (int l = 0; l < levels; l++) {
+			const int n(chunk >> l), s(1 << l);
+			for (int mask = 0; mask < 16; mask++) {
+				const Range range = { static_cast<GLsizei>(index.size()), 0 };
+				ranges.push_back(range);
+
+				// 格子点 (i, j) の頂点番号
+				const auto vertex([=](int i, int j) {
+					if ((mask & 1) && i == 0 && j % 2 == 1 && j < n) --j;
+					if ((mask & 2) && i == n && j % 2 == 1 && j < n) --j;
+					if ((mask & 4) && j == 0 && i % 2 == 1 && i < n) --i;
+					if ((mask & 8) && j == n && i % 2 == 1 && i < n) --i;
+					return static_cast<GLushort>(j * s * row + i * s);
+				});
+
+				// 縮退していない三角形だけを加える
+				const auto triangle([&](GLushort a, GLushort b, GLushort c) {
+					if (a == b || b == c || c == a) return;
+					index.push_back(a);
+					index.push_back(b);
+					index.push_back(c);
+				});
+
+				for (int j = 0; j < n; j++) {
+					for (int i = 0; i < n; i++) {
+						const GLushort a(vertex(i, j)), b(vertex(i + 1, j));
+						const GLushort c(vertex(i + 1, j + 1)), d(vertex(i, j + 1));
+						triangle(a, d, c);
+						triangle(a, c, b);
+					}
+				}
+				ranges.back().count = static_cast<GLsizei>(index.size()) - ranges.back().first;
+			}
+		}
+
+		glGenBuffers(1, &ibo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, index.size() * sizeof(GLushort), index.data(), GL_STATIC_DRAW);
+	}
+
+	// 読み込み終わったチャンクを頂点バッファに転送する
+	void upload(int uploads) {
+		for (int u = 0; u < uploads; u++) {
+			int s;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (doneHead == doneTail) return;
+				s = done[doneHead];
+				doneHead = (doneHead + 1) % done.size();
+			}
+			Staging &t(staging[s]);
+			Chunk &c(chunks[t.chunk]);
+
+			// 空きスロットがなければ今必要でない最も古いチャンクを追い出す
+			int slot(static_cast<int>(std::find(slots.begin(), slots.end(), -1) - slots.begin()));
+			if (slot == capacity) {
+				int victim(-1);
+				for (int i = 0; i < capacity; i++) {
+					const Chunk &v(chunks[slots[i]]);
+					if (!v.wanted && (victim < 0 || v.used < chunks[slots[victim]].used)) victim = i;
+				}
+				if (victim >= 0) {
+					chunks[slots[victim]].state = EMPTY;
+					chunks[slots[victim]].slot = -1;
+					slots[victim] = -1;
+					slot = victim;
+				}
+			}
+
+			if (slot < capacity) {
+				glBindBuffer(GL_ARRAY_BUFFER, vbo);
+				glBufferSubData(GL_ARRAY_BUFFER, slot * vertexCount() * sizeof(Object::Vertex),
+					vertexCount() * sizeof(Object::Vertex), t.vertex.data());
+				slots[slot] = t.chunk;
+				c.slot = slot;
+				c.state = RESIDENT;
+				c.level = levels - 1;
+				c.mask = 0;
+				const GLfloat size(chunk * spacing);
+				c.bmin[0] = (t.chunk % countX) * size;
+				c.bmin[1] = t.ymin;
+				c.bmin[2] = (t.chunk / countX) * size;
+				c.bmax[0] = c.bmin[0] + size;
+				c.bmax[1] = t.ymax;
+				c.bmax[2] = c.bmin[2] + size;
+				std::copy(t.error, t.error + maxLevels, c.error);
+			}
+			else {
+				// 置き場がなければ次に必要になったときに読み直す
+				c.state = EMPTY;
+			}
+			freeStaging.push_back(s);
+		}
+	}
+
+	// 読み込みのスレッド
+	void work() {
+		for (;;) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]() { return stop || jobHead != jobTail; });
+				if (stop) return;
+				job = jobs[jobHead];
+				jobHead = (jobHead + 1) % jobs.size();
+			}
+
+			load(job.chunk, staging[job.staging]);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			done[doneTail] = job.staging;
+			doneTail = (doneTail + 1) % done.size();
+		}
+	}
+
+	// チャンクの高さを読み込んで頂点属性と各レベルの誤差を求める
+	void load(int i, Staging &t) const {
+		const int row(chunk + 1), stride(chunk + 3);
+		const unsigned char *const tile(file.data() + headerSize + size_t(i) * stride * stride * sizeof(uint16_t));
+
+		// 格子点 (x, z) の高さ（-1 と chunk + 1 は隣のチャンクの標本）
+		const auto height([=](int x, int z) {
+			uint16_t h;
+			std::memcpy(&h, tile + ((z + 1) * stride + x + 1) * sizeof(uint16_t), sizeof h);
+			return h * scale;
+		});
+
+		const GLfloat x0((i % countX) * chunk * spacing), z0((i / countX) * chunk * spacing);
+		t.chunk = i;
+		t.ymin = t.ymax = height(0, 0);
+		for (int z = 0; z < row; z++) {
+			for (int x = 0; x < row; x++) {
+				Object::Vertex &v(t.vertex[z * row + x]);
+				const GLfloat y(height(x, z));
+				v.position[0] = x0 + x * spacing;
+				v.position[1] = y;
+				v.position[2] = z0 + z * spacing;
+
+				// 中心差分で法線を求める（境界では隣のチャンクの標本を使う）
+				const GLfloat nx(height(x - 1, z) - height(x + 1, z));
+				const GLfloat nz(height(x, z - 1) - height(x, z + 1));
+				const GLfloat ny(2.0f * spacing);
+				const GLfloat r(1.0f / std::sqrt(nx * nx + ny * ny + nz * nz));
+				v.normal[0] = nx * r;
+				v.normal[1] = ny * r;
+				v.normal[2] = nz * r;
+
+				v.texcoord[0] = v.position[0] / getWidth();
+				v.texcoord[1] = v.position[2] / getDepth();
+
+				t.ymin = std::min(t.ymin, y);
+				t.ymax = std::max(t.ymax, y);
+			}
+		}
+
+		// 各レベルで省いた標本と粗い格子で補間した高さの差の最大値（細かいレベルの誤差も含める）
+		t.error[0] = 0.0f;
+		for (int l = 1; l < maxLevels; l++) {
+			GLfloat e(t.error[l - 1]);
+			const int s(1 << l);
+			for (int z = 0; z < row && l < levels; z++) {
+				for (int x = 0; x < row; x++) {
+					const int gx(std::min(x / s * s, chunk - s)), gz(std::min(z / s * s, chunk - s));
+					const GLfloat fx(GLfloat(x - gx) / s), fz(GLfloat(z - gz) / s);
+					const GLfloat h((height(gx, gz) * (1.0f - fx) + height(gx + s, gz) * fx) * (1.0f - fz)
+						+ (height(gx, gz + s) * (1.0f - fx) + height(gx + s, gz + s) * fx) * fz);
+					e = std::max(e, std::fabs(height(x, z) - h));
+				}
+			}
+			t.error[l] = e;
+		}
+	}
+};
@@ -0,0 +1,384 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <GL/glew.h>
+#include "MappedFile.h"
+#include "Pool.h"
+
+// ブロック圧縮テクスチャ (KTX2 / DDS) の読み込みとミップマップの段階的な転送
+//  ファイルはメモリにマップし，展開せずにそのまま GPU に転送する．
+//  ミップマップは小さいレベルから順に update() ごとに予算の範囲で転送し，
+//  GL_TEXTURE_BASE_LEVEL を転送済みの最も詳細なレベルに合わせて使えるようにする．
+//  常駐量が上限を超えるときは長く使っていないテクスチャの詳細なレベルから捨てる
+class TextureManager {
+	// テクスチャ
+	struct Texture;
+
+public:
+	// テクスチャのハンドル
+	typedef Pool<Texture>::Handle Handle;
+
+	// コンストラクタ
+	//  budget: 1フレームに転送する量の上限（バイト）
+	//  capacity: 常駐させる量の上限（バイト）
+	TextureManager(size_t budget = 4 << 20, size_t capacity = 256 << 20)
+		: budget(budget), capacity(capacity), resident(0), uploaded(0), frame(0)
+	{
+	}
+
+	// テクスチャファイルを開く（ミップマップは update() で転送する）
+	//  name: ファイル名（.ktx2 または .dds）
+	//  開けなければ無効なハンドルを返す
+	Handle load(const char *name) {
+		const Handle handle(textures.create(name));
+		Texture *const texture(textures.get(handle));
+		if (texture->format == 0) {
+			std::fprintf(stderr, "Can't load texture: %s\n", name);
+			textures.destroy(handle);
+			const Handle invalid = { 0, 0 };
+			return invalid;
+		}
+		texture->used = frame;
+		handles.push_back(handle);
+		return handle;
+	}
+
+	// テクスチャを削除する
+	void release(Handle handle) {
+		Texture *const texture(textures.get(handle));
+		if (texture == NULL) return;
+		resident -= texture->residentBytes();
+		for (size_t i = 0; i < handles.size(); i++) {
+			if (handles[i].index == handle.index && handles[i].generation == handle.generation) {
+				handles[i] = handles.back();
+				handles.pop_back();
+				break;
+			}
+		}
+		textures.destroy(handle);
+	}
+
+	// テクスチャを結合する（転送済みのレベルがなければ false）
+	//  unit: テクスチャユニットの番号
+	bool bind(Handle handle, GLuint unit = 0) {
+		Texture *const texture(textures.get(handle));
+		if (texture == NULL) return false;
+		texture->used = frame;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, texture->name);
+		return texture->base < texture->levels;
+	}
+
+	// 1フレーム分のミップマップを転送する（フレームごとに呼ぶ）
+	void update() {
+		++frame;
+		size_t sent(0);
+
+		for (;;) {
+			// 最近使ったテクスチャのうち次に転送するレベルが最も小さいものを選ぶ
+			Texture *next(NULL);
+			for (const Handle &h : handles) {
+				Texture *const t(textures.get(h));
+				if (t->base == 0 || frame - t->used > 2) continue;
+				if (next == NULL || t->levelSize(t->base - 1) < next->levelSize(next->base - 1)) next = t;
+			}
+			if (next == NULL) break;
+
+			const size_t size(next->levelSize(next->base - 1));
+			if (sent > 0 && sent + size > budget) break;
+
+			// 常駐量の上限を超えるなら使っていないテクスチャのレベルを捨てる
+			while (resident + size > capacity && evict(next)) {}
+			if (resident + size > capacity) break;
+
+			next->upload(next->base - 1);
+			resident += size;
+			sent += size;
+		}
+		uploaded += sent;
+	}
+
+	// 常駐している量（バイト）を返す
+	size_t getResidentBytes() const { return resident; }
+
+	// これまでに転送した量（バイト）を返す
+	size_t getUploadedBytes() const { return uploaded; }
+
+	// 無圧縮の RGBA8 で同じミップマップを持った場合の量（バイト）を返す
+	size_t getUncompressedBytes() const {
+		size_t total(0);
+		for (const Handle &h : handles) {
+			const Texture *const t(textures.get(h));
+			for (GLint l = t->base; l < t->levels; l++) {
+				total += static_cast<size_t>(t->levelWidth(l)) * t->levelHeight(l) * 4;
+			}
+		}
+		return total;
+	}
+
+private:
+
+	// コピーコンストラクタによるコピー禁止
+	TextureManager(const TextureManager &m);
+
+	// 代入によるコピー禁止
+	TextureManager &operator=(const TextureManager &m);
+
+	// テクスチャ
+	struct Texture {
+		// マップしたファイル
+		MappedFile file;
+		// テクスチャ名
+		GLuint name;
+		// 圧縮形式（0 なら読み込み失敗）
+		GLenum format;
+		// 4x4 画素のブロックのバイト数
+		GLsizei block;
+		// 最も詳細なレベルの大きさ
+		GLsizei width, height;
+		// ミップマップのレベル数
+		GLint levels;
+		// 転送済みの最も詳細なレベル（levels なら未転送）
+		GLint base;
+		// 最後に使ったフレーム
+		unsigned int used;
+		// 各レベルのファイル内の位置
+		std::vector<size_t> offset;
+
+		// コンストラクタ
+		Texture(const char *filename)
+			: file(filename), name(0), format(0), block(0), width(0), height(0)
+			, levels(0), base(0), used(0)
+		{
+			if (!parseKtx2() && !parseDds()) {
+				format = 0;
+				return;
+			}
+
+			// 転送するまではどのレベルも持たない
+			base = levels;
+			glGenTextures(1, &name);
+			glBindTexture(GL_TEXTURE_2D, name);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+				levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+		}
+
+		// デストラクタ
+		~Texture() {
+			if (name != 0) glDeleteTextures(1, &name);
+		}
+
+		// レベル l の幅と高さ
+		GLsizei levelWidth(GLint l) const { return width >> l > 0 ? width >> l : 1; }
+		GLsizei levelHeight(GLint l) const { return height >> l > 0 ? height >> l : 1; }
+
+		// レベル l のバイト数
+		size_t levelSize(GLint l) const {
+			return static_cast<size_t>((levelWidth(l) + 3) / 4) * ((levelHeight(l) + 3) / 4) * block;
+		}
+
+		// 常駐しているバイト数
+		size_t residentBytes() const {
+			size_t total(0);
+			for (GLint l = base; l < levels; l++) total += levelSize(l);
+			return total;
+		}
+
+		// レベル l を転送して使えるようにする
+		void upload(GLint l) {
+			glBindTexture(GL_TEXTURE_2D, name);
+			glCompressedTexImage2D(GL_TEXTURE_2D, l, format, levelWidth(l), levelHeight(l), 0,
+				static_cast<GLsizei>(levelSize(l)), file.data() + offset[l]);
+			base = l;
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base);
+		}
+
+		// 最も詳細なレベルを捨てる
+		void drop() {
+			glBindTexture(GL_TEXTURE_2D, name);
+			glCompressedTexImage2D(GL_TEXTURE_2D, base, format, 0, 0, 0, 0, NULL);
+			++base;
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base);
+		}
+
+		// リトルエンディアンの値を読む
+		uint32_t read32(size_t at) const {
+			const unsigned char *const p(file.data() + at);
+			return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+		}
+		uint64_t read64(size_t at) const {
+			return read32(at) | (static_cast<uint64_t>(read32(at + 4)) << 32);
+		}
+
+		// KTX2 のヘッダを解釈する
+		bool parseKtx2() {
+			static const unsigned char id[12] = {
+				0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'
+			};
+			if (file.size() < 80 || std::memcmp(file.data(), id, 12) != 0) return false;
+
+			// 超圧縮や 3D・配列・キューブマップのテクスチャは扱わない
+			if (read32(44) != 0 || read32(28) != 0 || read32(32) > 1 || read32(36) != 1) return false;
+			if (!ktx2Format(read32(12))) return false;
+
+			width = read32(20);
+			height = read32(24);
+			return countLevels(read32(40)) && levelIndex(80);
+		}
+
+		// DDS のヘッダを解釈する
+		bool parseDds() {
+			if (file.size() < 128 || std::memcmp(file.data(), "DDS ", 4) != 0) return false;
+
+			size_t data(128);
+			const uint32_t fourcc(read32(84));
+			if (fourcc == code("DX10")) {
+				if (file.size() < 148 || !dxgiFormat(read32(128))) return false;
+				data = 148;
+			}
+			else if (!ddsFormat(fourcc)) {
+				return false;
+			}
+
+			height = read32(12);
+			width = read32(16);
+			if (!countLevels(read32(28))) return false;
+
+			// レベルは詳細なものから順に並んでいる
+			offset.resize(levels);
+			for (GLint l = 0; l < levels; l++) {
+				offset[l] = data;
+				data += levelSize(l);
+			}
+			return data <= file.size();
+		}
+
+		// レベルの数を設定する（0 は 1 とみなす）
+		//  基本の大きさから 1x1 までの数より多ければ壊れたファイルとして扱う
+		bool countLevels(uint32_t count) {
+			if (width <= 0 || height <= 0) return false;
+			uint32_t limit(1);
+			for (GLsizei s = std::max(width, height); s > 1; s >>= 1) ++limit;
+			if (count > limit) return false;
+			levels = std::max<GLint>(static_cast<GLint>(count), 1);
+			return true;
+		}
+
+		// KTX2 のレベルの索引を読む
+		bool levelIndex(size_t at) {
+			if (file.size() < at + levels * 24) return false;
+			offset.resize(levels);
+			for (GLint l = 0; l < levels; l++) {
+				offset[l] = static_cast<size_t>(read64(at + l * 24));
+				if (read64(at + l * 24 + 8) < levelSize(l) || offset[l] + levelSize(l) > file.size()) return false;
+			}
+			return true;
+		}
+
+		// 4文字のコード
+		static uint32_t code(const char *c) {
+			return c[0] | (c[1] << 8) | (c[2] << 16) | (static_cast<uint32_t>(c[3]) << 24);
+		}
+
+		// 形式とブロックの大きさを設定する
+		bool set(GLenum f, GLsizei b) {
+			format = f;
+			block = b;
+			return true;
+		}
+
+		// KTX2 の VkFormat に対応する形式
+		bool ktx2Format(uint32_t vk) {
+			switch (vk) {
+			case 131: return set(GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 8);
+			case 133: return set(GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 8);
+			case 135: return set(GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 16);
+			case 137: return set(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16);
+			case 139: return set(GL_COMPRESSED_RED_RGTC1, 8);
+			case 141: return set(GL_COMPRESSED_RG_RGTC2, 16);
+			case 143: return set(GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, 16);
+			case 144: return set(GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT, 16);
+			case 145: return set(GL_COMPRESSED_RGBA_BPTC_UNORM, 16);
+			case 146: return set(GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, 16);
+			case 147: return set(GL_COMPRESSED_RGB8_ETC2, 8);
+			case 148: return set(GL_COMPRESSED_SRGB8_ETC2, 8);
+			case 149: return set(GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2, 8);
+			case 151: return set(GL_COMPRESSED_RGBA8_ETC2_EAC, 16);
+			case 152: return set(GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC, 16);
+			}
+			return false;
+		}
+
+		// DDS の FourCC に対応する形式
+		bool ddsFormat(uint32_t fourcc) {
+			if (fourcc == code("DXT1")) return set(GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 8);
+			if (fourcc == code("DXT3")) return set(GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 16);
+			if (fourcc == code("DXT5")) return set(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16);
+			if (fourcc == code("ATI1") || fourcc == code("BC4U")) return set(GL_COMPRESSED_RED_RGTC1, 8);
+			if (fourcc == code("ATI2") || fourcc == code("BC5U")) return set(GL_COMPRESSED_RG_RGTC2, 16);
+			return false;
+		}
+
+		// DDS の DXGI_FORMAT に対応する形式
+		bool dxgiFormat(uint32_t dxgi) {
+			switch (dxgi) {
+			case 71: return set(GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 8);
+			case 74: return set(GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 16);
+			case 77: return set(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16);
+			case 80: return set(GL_COMPRESSED_RED_RGTC1, 8);
+			case 83: return set(GL_COMPRESSED_RG_RGTC2, 16);
+			case 95: return set(GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, 16);
+			case 96: return set(GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT, 16);
+			case 98: return set(GL_COMPRESSED_RGBA_BPTC_UNORM, 16);
+			case 99: return set(GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, 16);
+			}
+			return false;
+		}
+	};
+
+	// 1フレームに転送する量の上限
+	const size_t budget;
+
+	// 常駐させる量の上限
+	const size_t capacity;
+
+	// 常駐している量
+	size_t resident;
+
+	// これまでに転送した量
+	size_t uploaded;
+
+	// フレームの番号
+	unsigned int frame;
+
+	// テクスチャの置き場
+	Pool<Texture> textures;
+
+	// 読み込んだテクスチャの一覧
+	std::vector<Handle> handles;
+
+	// keep 以外で最も長く使っていないテクスチャの最も詳細なレベルを捨てる
+	//  捨てられるものがなければ false を返す
+	bool evict(const Texture *keep) {
+		Texture *victim(NULL);
+		for (const Handle &h : handles) {
+			Texture *const t(textures.get(h));
+
+			// 直前に描いたフレームで使ったものと最も粗いレベルしかないものは捨てない
+			//  （bind() の後の update() で frame を進めるので，描いたフレームは frame - 1 になる）
+			if (t == keep || frame - t->used <= 1 || t->base >= t->levels - 1) continue;
+			if (victim == NULL || t->used < victim->used) victim = t;
+		}
+		if (victim == NULL) return false;
+
+		resident -= victim->levelSize(victim->base);
+		victim->drop();
+		return true;
+	}
+};
@@ -1,16 +1,35 @@
 #pragma once
 
 #include <iostream>
+#include <atomic>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include "SpscQueue.h"
 
 // ウィンドウ関連の処理
+//  GLFW のイベントは待ち行列に積み，swapBuffers() で取り出して反映する．
+//  detachContext() の後はイベントの取り出し (pollEvents, waitEvents) をメインスレッド，
+//  描画と swapBuffers() を描画スレッドで行う
 class Window {
 public:
+	// 入力イベント
+	struct Event {
+		// 種類
+		enum Type { RESIZE, SCROLL, KEY, BUTTON, CURSOR } type;
+		// キーやボタンの番号（RESIZE では幅）
+		int code;
+		// 操作（RESIZE では高さ）
+		int action;
+		// ホイールの回転量やカーソルの位置
+		double x, y;
+	};
+
 	// コンストラクタ
 	Window(int width = 640, int height = 480, const char *title = "Hello!")
 		: window(glfwCreateWindow(width, height, title, NULL, NULL))
 		, scale(100.0f), location{0, 0}, arrowKeyCount(0), wheelRotation(0.0)
+		, threaded(false), button(false), cursor{0.0, 0.0}, pointer{0.0f, 0.0f}, arrowKey{false, false, false, false}
+		, dropped(0), maxQueueDepth(0)
 	{
 		if (window == NULL) {
 			// ウィンドウが作成できなかった
@@ -41,11 +60,15 @@ public:
 		// このインスタンスのthisポインタを記録しておく
 		glfwSetWindowUserPointer(window, this);
 
-		// ウィンドウのサイズ変更時に呼び出す処理の登録
+		// キーボード操作時に呼び出す処理の登録
 		glfwSetKeyCallback(window, keyboad);
 
+		// マウスのボタン操作とカーソル移動時に呼び出す処理の登録
+		glfwSetMouseButtonCallback(window, mouse);
+		glfwSetCursorPosCallback(window, cursorPos);
+
 		// 開いたウィンドウの初期設定
-		resize(window, width, height);
+		setSize(width, height);
 	}
 
 	// デストラクタ
@@ -53,9 +76,31 @@ public:
 		glfwDestroyWindow(window);
 	}
 
-	// ウィンドウを閉じるべきかを判定する
+	// ウィンドウを閉じるべきかを判定する（どのスレッドからも呼べる）
 	int shouldClose() const {
-		return glfwWindowShouldClose(window) || glfwGetKey(window, GLFW_KEY_ESCAPE);
+		return glfwWindowShouldClose(window);
+	}
+
+	// 描画を別のスレッドに任せるためにこのスレッドからコンテキストを外す
+	void detachContext() {
+		threaded = true;
+		glfwMakeContextCurrent(NULL);
+	}
+
+	// このスレッドでコンテキストを使う
+	void makeContextCurrent() const {
+		glfwMakeContextCurrent(window);
+	}
+
+	// イベントを取り出して待ち行列に積む（メインスレッドから呼ぶ）
+	void pollEvents() const {
+		glfwPollEvents();
+	}
+
+	// イベントが来るまで待ってから待ち行列に積む（メインスレッドから呼ぶ）
+	//  ウィンドウのドラッグ中などはここで止まるが，描画スレッドは止まらない
+	void waitEvents() const {
+		glfwWaitEvents();
 	}
 
 	// カラーバッファを入れ替えてイベントを取り出す
@@ -63,31 +108,36 @@ public:
 		// カラーバッファを入れ替える
 		glfwSwapBuffers(window);
 
-		// イベントを取り出す
-		glfwPollEvents();
+		// イベントを取り出す（描画スレッドがあればメインスレッドが取り出している）
+		if (!threaded) glfwPollEvents();
+
+		// 溜まっているイベントを反映する
+		Event event;
+		while (queue.pop(event)) {
+			apply(event);
+		}
 
-		if (glfwGetKey(window, GLFW_KEY_LEFT) != GLFW_RELEASE) {
+		if (arrowKey[0]) {
 			location[0] -= 2.0f / size[0];
 		}
-		if (glfwGetKey(window, GLFW_KEY_RIGHT) != GLFW_RELEASE) {
+		if (arrowKey[1]) {
 			location[0] += 2.0f / size[0];
 		}
-		if (glfwGetKey(window, GLFW_KEY_UP) != GLFW_RELEASE) {
+		if (arrowKey[2]) {
 			location[1] += 2.0f / size[1];
 		}
-		if (glfwGetKey(window, GLFW_KEY_DOWN) != GLFW_RELEASE) {
+		if (arrowKey[3]) {
 			location[1] -= 2.0f / size[1];
 		}
 
-		// マウスの左ボタンの状態を調べる
-		if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_1) != GLFW_RELEASE) {
-			// マウスカーソルの位置を取得する
-			double x, y;
-			glfwGetCursorPos(window, &x, &y);
+		// マウスカーソルの正規化デバイス座標系上での位置を求める
+		pointer[0] = static_cast<GLfloat>(cursor[0]) * 2.0f / size[0] - 1.0f;
+		pointer[1] = 1.0f - static_cast<GLfloat>(cursor[1]) * 2.0f / size[1];
 
-			// マウスカーソルの正規化デバイス座標系上での位置を求める
-			location[0] = static_cast<GLfloat>(x) * 2.0f / size[0] - 1.0f;
-			location[1] = 1.0f - static_cast<GLfloat>(y) * 2.0f / size[1];
+		// マウスの左ボタンが押されていれば図形をカーソルの位置に置く
+		if (button) {
+			location[0] = pointer[0];
+			location[1] = pointer[1];
 		}
 	}
 
@@ -99,29 +149,29 @@ public:
 	// 位置を取り出す
 	const GLfloat *getLocation() const { return location; }
 
+	// マウスカーソルの正規化デバイス座標系上での位置を取り出す
+	const GLfloat *getCursor() const { return pointer; }
+
+	// 待ち行列に溜まっているイベントの数を返す
+	size_t getQueueDepth() const { return queue.size(); }
+
+	// 待ち行列に溜まったイベントの数の最大値を返す
+	size_t getMaxQueueDepth() const { return maxQueueDepth; }
+
+	// 待ち行列が満杯で捨てたイベントの数を返す
+	int getDroppedCount() const { return dropped; }
+
 	// ウィンドウのサイズ変更時の処理
 	static void resize(GLFWwindow *const window, int width, int height) {
-		// ウィンドウ全体をビューポートに設定する
-		glViewport(0, 0, width, height);
-
-		// このインスタンスのthisポインタを得る
-		Window *const instance = getInstance(window);
-		if (instance != NULL) {
-			// 開いたウィンドウのサイズを保存する
-			instance->size[0] = static_cast<GLfloat>(width);
-			instance->size[1] = static_cast<GLfloat>(height);
-		}
+		// ビューポートの設定は描画スレッドで行う
+		const Event event = { Event::RESIZE, width, height, 0.0, 0.0 };
+		post(window, event);
 	}
 
 	// マウスホイール操作時の処理
 	static void wheel(GLFWwindow *const window, double x, double y) {
-		// このインスタンスのthisポインタを得る
-		Window *const instance = getInstance(window);
-		if (instance != NULL) {
-			// ワールド座標系に対するデバイス座標系の拡大率を更新する
-			instance->scale += static_cast<GLfloat>(y);
-			instance->wheelRotation += y;
-		}
+		const Event event = { Event::SCROLL, 0, 0, x, y };
+		post(window, event);
 	}
 
 	double getWheelRotation() {
@@ -130,20 +180,25 @@ public:
 
 	// キーボード操作時の処理
 	static void keyboad(GLFWwindow *const window, int key, int scancode, int action, int mods) {
-		// このインスタンスのthisポインタを得る
-		Window *const instance = getInstance(window);
-		if (instance != NULL) {
-			if (key != GLFW_KEY_LEFT && key != GLFW_KEY_RIGHT
-				&& key != GLFW_KEY_UP && key != GLFW_KEY_DOWN) {
-				return;
-			}
-			if (action == GLFW_RELEASE) {
-				instance->arrowKeyCount -= 1;
-			}
-			else if (action == GLFW_PRESS) {
-				instance->arrowKeyCount += 1;
-			}
+		// ESC キーで閉じる
+		if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
+			glfwSetWindowShouldClose(window, GL_TRUE);
 		}
+
+		const Event event = { Event::KEY, key, action, 0.0, 0.0 };
+		post(window, event);
+	}
+
+	// マウスのボタン操作時の処理
+	static void mouse(GLFWwindow *const window, int button, int action, int mods) {
+		const Event event = { Event::BUTTON, button, action, 0.0, 0.0 };
+		post(window, event);
+	}
+
+	// マウスカーソル移動時の処理
+	static void cursorPos(GLFWwindow *const window, double x, double y) {
+		const Event event = { Event::CURSOR, 0, 0, x, y };
+		post(window, event);
 	}
 
 private:
@@ -165,8 +220,101 @@ private:
 	// ホイールの回転量
 	double wheelRotation;
 
+	// 描画を別のスレッドで行っているか
+	bool threaded;
+
+	// マウスの左ボタンが押されているか
+	bool button;
+
+	// マウスカーソルの位置
+	double cursor[2];
+
+	// マウスカーソルの正規化デバイス座標系上での位置
+	GLfloat pointer[2];
+
+	// 左右上下の矢印キーが押されているか
+	bool arrowKey[4];
+
+	// メインスレッドから描画スレッドへのイベントの待ち行列
+	SpscQueue<Event, 1024> queue;
+
+	// 待ち行列が満杯で捨てたイベントの数
+	std::atomic<int> dropped;
+
+	// 待ち行列に溜まったイベントの数の最大値
+	std::atomic<size_t> maxQueueDepth;
+
 	static Window *const getInstance(GLFWwindow *const window) {
 		Window *const instance(static_cast<Window *>(glfwGetWindowUserPointer(window)));
 		return instance;
 	}
-};
\ No newline at end of file
+
+	// イベントを待ち行列に積む
+	static void post(GLFWwindow *const window, const Event &event) {
+		// このインスタンスのthisポインタを得る
+		Window *const instance = getInstance(window);
+		if (instance != NULL) {
+			if (!instance->queue.push(event)) {
+				++instance->dropped;
+			}
+			const size_t depth(instance->queue.size());
+			if (depth > instance->maxQueueDepth) instance->maxQueueDepth = depth;
+		}
+	}
+
+	// ウィンドウのサイズを設定する
+	void setSize(int width, int height) {
+		// ウィンドウ全体をビューポートに設定する
+		glViewport(0, 0, width, height);
+
+		// 開いたウィンドウのサイズを保存する
+		size[0] = static_cast<GLfloat>(width);
+		size[1] = static_cast<GLfloat>(height);
+	}
+
+	// イベントを反映する
+	void apply(const Event &event) {
+		switch (event.type) {
+		case Event::RESIZE:
+			setSize(event.code, event.action);
+			break;
+
+		case Event::SCROLL:
+			// ワールド座標系に対するデバイス座標系の拡大率を更新する
+			scale += static_cast<GLfloat>(event.y);
+			wheelRotation += event.y;
+			break;
+
+		case Event::KEY: {
+			const int key(event.code);
+			if (key != GLFW_KEY_LEFT && key != GLFW_KEY_RIGHT
+				&& key != GLFW_KEY_UP && key != GLFW_KEY_DOWN) {
+				break;
+			}
+			if (event.action == GLFW_RELEASE) {
+				arrowKeyCount -= 1;
+			}
+			else if (event.action == GLFW_PRESS) {
+				arrowKeyCount += 1;
+			}
+			const bool pressed(event.action != GLFW_RELEASE);
+			if (key == GLFW_KEY_LEFT) arrowKey[0] = pressed;
+			if (key == GLFW_KEY_RIGHT) arrowKey[1] = pressed;
+			if (key == GLFW_KEY_UP) arrowKey[2] = pressed;
+			if (key == GLFW_KEY_DOWN) arrowKey[3] = pressed;
+			break;
+		}
+
+		case Event::BUTTON:
+			if (event.code == GLFW_MOUSE_BUTTON_1) {
+				button = event.action != GLFW_RELEASE;
+			}
+			break;
+
+		case Event::CURSOR:
+			cursor[0] = event.x;
+			cursor[1] = event.y;
+			break;
+		}
+	}
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Chase-Lev のワークスチーリング両端キュー
+//  所有スレッドだけが push() と pop() で末尾を操作し，
+//  他のスレッドは steal() で先頭から取り出す
+//  T: 要素の型（ポインタ）
+//  Size: 容量（2のべき乗）
+template <typename T, int64_t Size>
+class WorkStealingDeque {
+	static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+public:
+	// コンストラクタ
+	WorkStealingDeque() : top(0), bottom(0) {
+		for (int64_t i = 0; i < Size; i++) buffer[i].store(nullptr, std::memory_order_relaxed);
+	}
+
+	// 末尾に追加する（所有スレッドから呼ぶ）
+	//  満杯なら false を返す
+	bool push(T value) {
+		const int64_t b(bottom.load(std::memory_order_relaxed));
+		const int64_t t(top.load(std::memory_order_acquire));
+		if (b - t >= Size) return false;
+
+		buffer[b & (Size - 1)].store(value, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// 末尾から取り出す（所有スレッドから呼ぶ）
+	//  空なら nullptr を返す
+	T pop() {
+		const int64_t b(bottom.load(std::memory_order_relaxed) - 1);
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t(top.load(std::memory_order_relaxed));
+
+		if (t > b) {
+			// 空だった
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		T value(buffer[b & (Size - 1)].load(std::memory_order_relaxed));
+		if (t == b) {
+			// 最後の一つは steal() と取り合いになる
+			if (!top.compare_exchange_strong(t, t + 1,
+				std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				value = nullptr;
+			}
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return value;
+	}
+
+	// 先頭から取り出す（どのスレッドからも呼べる）
+	//  空か取り合いに負けたら nullptr を返す
+	T steal() {
+		int64_t t(top.load(std::memory_order_acquire));
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t b(bottom.load(std::memory_order_acquire));
+		if (t >= b) return nullptr;
+
+		T value(buffer[t & (Size - 1)].load(std::memory_order_relaxed));
+		if (!top.compare_exchange_strong(t, t + 1,
+			std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			return nullptr;
+		}
+		return value;
+	}
+
+	// 溜まっている要素の数の目安を返す
+	int64_t size() const {
+		return bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_relaxed);
+	}
+
+private:
+	// 先頭と末尾（別のキャッシュラインに置く）
+	alignas(64) std::atomic<int64_t> top;
+	alignas(64) std::atomic<int64_t> bottom;
+
+	// 要素
+	std::atomic<T> buffer[Size];
+};
@@ -0,0 +1,6 @@
+#version 150 core
+in vec4 Color;
+out vec4 fragment;
+void main() {
+	fragment = Color;
+}
\ No newline at end of file
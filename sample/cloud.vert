@@ -0,0 +1,12 @@
+#version 150 core
+uniform mat4x3 modelview;
+uniform mat4 projection;
+uniform float pointSize;
+in vec4 position;
+in vec4 color;
+out vec4 Color;
+void main() {
+	Color = color;
+	gl_Position = projection * vec4(modelview * position, 1.0);
+	gl_PointSize = pointSize;
+}
\ No newline at end of file
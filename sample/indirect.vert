@@ -0,0 +1,32 @@
+#version 430 core
+uniform mat4 projection;
+const vec4 Lpos = vec4(0.0, 0.0, 5.0, 1.0);
+const vec3 Lamb = vec3(0.2);
+const vec3 Ldiff = vec3(1.0);
+const vec3 Lspec = vec3(1.0);
+const vec3 Kamb = vec3(0.3, 0.3, 0.3);
+const vec3 Kdiff = vec3(0.6, 0.0, 0.0);
+const vec3 Kspec = vec3(0.3, 0.3, 0.3);
+const float Kshi = 30.0;
+layout(location = 0) in vec4 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texcoord;
+layout(location = 4) in vec4 modelview[3];
+out Vertex {
+	vec3 Idiff;
+	vec3 Ispec;
+	vec2 Tex;
+};
+void main() {
+	mat4x3 m = transpose(mat3x4(modelview[0], modelview[1], modelview[2]));
+	vec4 P = vec4(m * position, 1.0);
+	vec3 N = normalize(mat3(m) * normal);
+	vec3 L = normalize((Lpos * P.w - P * Lpos.w).xyz);
+	vec3 Iamb = Kamb * Lamb;
+	Idiff = max(dot(N, L), 0.0) * Kdiff * Ldiff + Iamb;
+	vec3 V = -normalize(P.xyz);
+	vec3 H = normalize(L + V);
+	Ispec = pow(max(dot(N, H), 0.0), Kshi) * Kspec * Lspec;
+	Tex = texcoord;
+	gl_Position = projection * P;
+}
@@ -1,168 +1,63 @@
 #include <cstdlib>
 #include <cstdio>
+#include <cmath>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <vector>
 #include <memory>
+#include <thread>
+#include <chrono>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "Shape.h"
 #include "ShapeIndex.h"
 #include "SolidShape.h"
 #include "SolidShapeIndex.h"
+#include "StripShapeIndex.h"
+#include "Mesh.h"
 #include "Window.h"
 #include "Matrix.h"
+#include "Affine.h"
+#include "Quaternion.h"
+#include "OcclusionCuller.h"
+#include "OcclusionQuery.h"
+#include "FrameCapture.h"
+#include "DynamicResolution.h"
+#include "JobSystem.h"
+#include "FrameArena.h"
+#include "Pool.h"
+#include "HeapCounter.h"
+#include "TextureManager.h"
+#include "Program.h"
+#include "Terrain.h"
+#include "PointCloud.h"
+#include "Picker.h"
+#include "DebugLines.h"
+#include "GlTrace.h"
+#include "IndirectRenderer.h"
+#include "MultiView.h"
 
 using namespace std;
 
-const GLfloat PI = 3.141519653589793238462643383279;
-
-bool readShaderSource(const char *name, vector<GLchar> &buffer) {
-	// ファイル名がNULLだった
-	if (name == NULL) {
-		return false;
-	}
-
-	// ソースファイルを開く
-	ifstream file(name, ios::binary);
-	if (file.fail()) {
-		// 開けなかった
-		cerr << "Error: Can't open source file: " << name << endl;
-		return false;
-	}
-
-	// ファイルの末尾に移動し現在位置（＝ファイルサイズ）を得る
-	file.seekg(0L, ios::end);
-	GLsizei length = static_cast<GLsizei>(file.tellg());
-
-	// ファイルサイズのメモリを確保
-	buffer.resize(length + 1);
-
-	// ファイルを先頭から読み込む
-	file.seekg(0L, ios::beg);
-	file.read(buffer.data(), length);
-	buffer[length] = '\0';
-
-	if (file.fail()) {
-		// 読み込めなかった
-		cerr << "Error: Could not read source file:" << name << endl;
-		file.close();
-		return false;
-	}
-
-	// 読み込み成功
-	file.close();
-	return true;
+// ヒープの確保を数えるために置き換える
+void *operator new(size_t size) {
+	HeapCounter::record(size);
+	void *const p(malloc(size > 0 ? size : 1));
+	if (p == NULL) throw bad_alloc();
+	return p;
 }
-
-// シェーダオブジェクトのコンパイル結果を表示する
-//  shader: シェーダオブジェクト名
-//  str: コンパイルエラーが発生した場所を示す文字列
-GLboolean printShaderInfoLog(GLuint shader, const char *str) {
-	// コンパイル結果を取得する
-	GLint status;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-	if (status == GL_FALSE) {
-		cerr << "Compile Error in " << str << endl;
-	}
-
-	// シェーダのコンパイル時のログの長さを取得する
-	GLsizei bufSize;
-	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &bufSize);
-
-	if (bufSize > 1) {
-		// シェーダのコンパイル時のログの内容を取得する
-		vector<GLchar> infoLog(bufSize);
-		GLsizei length;
-		glGetShaderInfoLog(shader, bufSize, &length, &infoLog[0]);
-		cerr << &infoLog[0] << endl;
-	}
-	return static_cast<GLboolean>(status);
+void *operator new[](size_t size) {
+	return operator new(size);
 }
-
-// プログラムオブジェクトのリンク結果を表示する
-//  program: プログラムオブジェクト名
-GLboolean printProgramInfoLog(GLuint program) {
-	// リンク結果を取得する
-	GLint status;
-	glGetProgramiv(program, GL_LINK_STATUS, &status);
-	if (status == GL_FALSE) {
-		cerr << "Link Error." << endl;
-	}
-
-	// シェーダのリンク時のログの長さを取得する
-	GLsizei bufSize;
-	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &bufSize);
-	if (bufSize > 1) {
-		// シェーダのリンク時のログの内容を取得する
-		vector<GLchar> infoLog(bufSize);
-		GLsizei length;
-		glGetProgramInfoLog(program, bufSize, &length, &infoLog[0]);
-		cerr << &infoLog[0] << endl;
-	}
-	return static_cast<GLboolean>(status);
+void operator delete(void *p) noexcept {
+	free(p);
 }
-
-// プログラムオブジェクトを作成する
-//  vsrc: バーテックスシェーダのソースファイル名
-//  fsrc: フラグメントシェーダのソースファイル名
-GLuint createProgram(const char *vsrc, const char *fsrc) {
-
-	// 空のプログラムオブジェクトを作成する
-	const GLuint program(glCreateProgram());
-
-	if (vsrc != NULL) {
-		// バーテックスシェーダのシェーダオブジェクトを作成する
-		const GLuint vobj(glCreateShader(GL_VERTEX_SHADER));
-		glShaderSource(vobj, 1, &vsrc, NULL);
-		glCompileShader(vobj);
-
-		// バーテックスシェーダのシェーダオブジェクトをプログラムオブジェクトに組み込む
-		if (printShaderInfoLog(vobj, "vertex shader")) {
-			glAttachShader(program, vobj);
-		}
-		glDeleteShader(vobj);
-	}
-
-	if (fsrc != NULL) {
-		// フラグメントシェーダのシェーダオブジェクトを作成する
-		const GLuint fobj(glCreateShader(GL_FRAGMENT_SHADER));
-		glShaderSource(fobj, 1, &fsrc, NULL);
-		glCompileShader(fobj);
-
-		// フラグメントシェーダのシェーダオブジェクトをプログラムオブジェクトに組み込む
-		if (printShaderInfoLog(fobj, "fragment shader")) {
-			glAttachShader(program, fobj);
-		}
-		glDeleteShader(fobj);
-	}
-
-	// プログラムオブジェクトをリンクする
-	glBindAttribLocation(program, 0, "position");
-	glBindAttribLocation(program, 1, "normal");
-	glBindFragDataLocation(program, 0, "fragment");
-	glLinkProgram(program);
-
-	// 作成したプログラムオブジェクトを返す
-	if (printProgramInfoLog(program)) {
-		return program;
-	}
-
-	// プログラムオブジェクトが作成できなければ 0 を返す
-	glDeleteProgram(program);
-	return 0;
+void operator delete[](void *p) noexcept {
+	free(p);
 }
 
-GLuint loadProgram(const char *vert, const char *frag) {
-	// シェーダのソースファイルを読み込む
-	vector<GLchar> vsrc;
-	const bool vstat(readShaderSource(vert, vsrc));
-	vector<GLchar> fsrc;
-	const bool fstat(readShaderSource(frag, fsrc));
-
-	return vstat && fstat ? createProgram(vsrc.data(), fsrc.data()) : 0;
-}
+const GLfloat PI = 3.141519653589793238462643383279;
 
 // 正八面体の頂点の位置
 constexpr Object::Vertex octahedronVertex[] = {
@@ -256,54 +151,138 @@ constexpr GLuint solidCubeIndex[] =
 };
 */
 
-// 面ごとに法線を変えた六面体の頂点属性
+// 面ごとに法線とテクスチャ座標を変えた六面体の頂点属性
 constexpr Object::Vertex solidCubeVertex[] =
 {
 	// 左
-	{ -1.0f, -1.0f, -1.0f, -1.0f, 0.0f, 0.0f },
-	{ -1.0f, -1.0f, 1.0f, -1.0f, 0.0f, 0.0f },
-	{ -1.0f, 1.0f, 1.0f, -1.0f, 0.0f, 0.0f },
-	{ -1.0f, -1.0f, -1.0f, -1.0f, 0.0f, 0.0f },
-	{ -1.0f, 1.0f, 1.0f, -1.0f, 0.0f, 0.0f },
-	{ -1.0f, 1.0f, -1.0f, -1.0f, 0.0f, 0.0f },
+	{ -1.0f, -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+	{ -1.0f, -1.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+	{ -1.0f, 1.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f },
+	{ -1.0f, -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+	{ -1.0f, 1.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f },
+	{ -1.0f, 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f },
 	// 裏
-	{ 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f },
-	{ -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f },
-	{ -1.0f, 1.0f, -1.0f, 0.0f, 0.0f, -1.0f },
-	{ 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f },
-	{ -1.0f, 1.0f, -1.0f, 0.0f, 0.0f, -1.0f },
-	{ 1.0f, 1.0f, -1.0f, 0.0f, 0.0f, -1.0f },
+	{ 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f },
+	{ -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f },
+	{ -1.0f, 1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f },
+	{ 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f },
+	{ -1.0f, 1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f },
+	{ 1.0f, 1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f },
 	// 下
-	{ -1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f },
-	{ 1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f },
-	{ 1.0f, -1.0f, 1.0f, 0.0f, -1.0f, 0.0f },
-	{ -1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f },
-	{ 1.0f, -1.0f, 1.0f, 0.0f, -1.0f, 0.0f },
-	{ -1.0f, -1.0f, 1.0f, 0.0f, -1.0f, 0.0f },
+	{ -1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f },
+	{ 1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f },
+	{ 1.0f, -1.0f, 1.0f, 0.0f, -1.0f, 0.0f, 1.0f, 1.0f },
+	{ -1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f },
+	{ 1.0f, -1.0f, 1.0f, 0.0f, -1.0f, 0.0f, 1.0f, 1.0f },
+	{ -1.0f, -1.0f, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f },
 	// 右
-	{ 1.0f, -1.0f, 1.0f, 1.0f, 0.0f, 0.0f },
-	{ 1.0f, -1.0f, -1.0f, 1.0f, 0.0f, 0.0f },
-	{ 1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 0.0f },
-	{ 1.0f, -1.0f, 1.0f, 1.0f, 0.0f, 0.0f },
-	{ 1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 0.0f },
-	{ 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f },
+	{ 1.0f, -1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+	{ 1.0f, -1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+	{ 1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f },
+	{ 1.0f, -1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+	{ 1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f },
+	{ 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f },
 	// 上
-	{ -1.0f, 1.0f, -1.0f, 0.0f, 1.0f, 0.0f },
-	{ -1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f },
-	{ 1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f },
-	{ -1.0f, 1.0f, -1.0f, 0.0f, 1.0f, 0.0f },
-	{ 1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f },
-	{ 1.0f, 1.0f, -1.0f, 0.0f, 1.0f, 0.0f },
+	{ -1.0f, 1.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f },
+	{ -1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f },
+	{ 1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f },
+	{ -1.0f, 1.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f },
+	{ 1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f },
+	{ 1.0f, 1.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f },
 	// 前
-	{ -1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f },
-	{ 1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f },
-	{ 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f },
-	{ -1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f },
-	{ 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f },
-	{ -1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f }
+	{ -1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f },
+	{ 1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f },
+	{ 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f },
+	{ -1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f },
+	{ 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f },
+	{ -1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f }
 };
 
-int main() {
+// 図形一つ分の描画の情報
+struct DrawPacket {
+	// モデルビュー変換行列
+	Affine modelview;
+	// 法線ベクトルの変換行列
+	GLfloat normalMatrix[9];
+	// 隠れていないか
+	bool visible;
+};
+
+// count 個の図形を一辺 6 の立方体の中に格子状に並べる配置
+vector<Affine> gridPlacement(int count) {
+	const int side(static_cast<int>(ceil(cbrt(static_cast<double>(count)))));
+	const GLfloat spacing(6.0f / side), s(spacing * 0.3f);
+	vector<Affine> placement;
+	placement.reserve(count);
+	for (int i = 0; i < count; i++) {
+		const GLfloat x((i % side + 0.5f) * spacing - 3.0f);
+		const GLfloat y((i / side % side + 0.5f) * spacing - 3.0f);
+		const GLfloat z((i / side / side + 0.5f) * spacing - 3.0f);
+		placement.push_back(Affine::translate(x, y, z) * Affine::scale(s, s, s));
+	}
+	return placement;
+}
+
+// 名前で指定した図形を作る（名前がなければ NULL）
+//  jobs: 頂点を並列に作るジョブシステム
+Mesh *createMesh(const string &name, JobSystem *jobs) {
+	if (name == "sphere") return new Mesh(Mesh::sphere(64, 32, jobs));
+	if (name == "torus") return new Mesh(Mesh::torus(64, 32, 0.3f, jobs));
+	if (name == "cylinder") return new Mesh(Mesh::cylinder(64, 4, jobs));
+	if (name == "grid") return new Mesh(Mesh::grid(64, 64, jobs));
+	if (!name.empty()) cerr << "Unknown mesh: " << name << endl;
+	return NULL;
+}
+
+// 記録の出力形式を出力先の拡張子から決める
+FrameWriter::Format captureFormat(const string &path) {
+	const string::size_type dot(path.rfind('.'));
+	const string ext(dot == string::npos ? "" : path.substr(dot));
+	if (ext == ".y4m") return FrameWriter::Y4M;
+	if (ext == ".png") return FrameWriter::PNG;
+	return FrameWriter::RAW;
+}
+
+// コマンドライン引数
+//  --dynamic: GPU の処理時間に応じて描画解像度を変える
+//  --thread: 描画を専用のスレッドで行う
+//  --texture ファイル名: 図形に貼る圧縮テクスチャ（.ktx2 または .dds）
+//  --terrain ファイル名: 図形の下に描く地形のタイルファイル
+//  --points ファイル名: 図形の周りに描く点群の八分木のファイル
+//  --debug: 図形の境界ボックスと座標軸を線で重ねて描く
+//  --trace ファイル名: 最初のフレームから OpenGL の呼び出しを記録する（tools/GlReplay で再生する）
+//  --trace-frames 数: 記録するフレームの数（省略時は 1）
+//  --objects 数: 図形をこの数だけ格子状に並べる
+//  --indirect: 図形の視錐台カリングと描画の発行を GPU で行う（OpenGL 4.3 がなければ図形ごとに描く）
+//  --mesh 名前: 六面体の代わりに描く図形（sphere, torus, cylinder, grid）を三角形ストリップで作る
+//  --views 数: 画面を分割して図形の周りを回した視点から一度の描画で描き，図形の描画にかかる CPU の時間を報告する
+//  --query: CPU の遮蔽カリングで残った図形を境界ボックスのオクルージョンクエリで GPU でも間引く
+//  1番目: 記録の出力先（.y4m, .png, それ以外は RGBA のまま）
+//  2, 3番目: 記録する画像の幅と高さ
+int main(int argc, char *argv[]) {
+	// オプションとそれ以外の引数を分ける
+	bool dynamic(false), threaded(false), debug(false), gpuDriven(false), queried(false);
+	string texturePath, terrainPath, pointsPath, tracePath, meshName;
+	int traceFrames(1), objects(0), views(0);
+	vector<string> args;
+	for (int i = 1; i < argc; i++) {
+		const string arg(argv[i]);
+		if (arg == "--dynamic") dynamic = true;
+		else if (arg == "--thread") threaded = true;
+		else if (arg == "--debug") debug = true;
+		else if (arg == "--indirect") gpuDriven = true;
+		else if (arg == "--query") queried = true;
+		else if (arg == "--objects" && i + 1 < argc) objects = atoi(argv[++i]);
+		else if (arg == "--views" && i + 1 < argc) views = atoi(argv[++i]);
+		else if (arg == "--mesh" && i + 1 < argc) meshName = argv[++i];
+		else if (arg == "--trace" && i + 1 < argc) tracePath = argv[++i];
+		else if (arg == "--trace-frames" && i + 1 < argc) traceFrames = atoi(argv[++i]);
+		else if (arg == "--texture" && i + 1 < argc) texturePath = argv[++i];
+		else if (arg == "--terrain" && i + 1 < argc) terrainPath = argv[++i];
+		else if (arg == "--points" && i + 1 < argc) pointsPath = argv[++i];
+		else args.push_back(arg);
+	}
+
 	// GLFWを初期化する
 	if (glfwInit() == GL_FALSE) {
 		// 初期化に失敗した
@@ -324,6 +303,11 @@ int main() {
 	// ウィンドウを作成する
 	Window window;
 
+	// 指定されていれば OpenGL の呼び出しを記録する（オブジェクトを作る前に関数を差し替える）
+	unique_ptr<GlTrace> trace(tracePath.empty() ? NULL : new GlTrace(tracePath.c_str()));
+	if (trace && !trace->isValid()) trace.reset();
+	if (trace) trace->capture(traceFrames);
+
 	// 背景色を指定する
 	glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
 
@@ -337,72 +321,489 @@ int main() {
 	glDepthFunc(GL_LESS);
 	glEnable(GL_DEPTH_TEST);
 
-	// プログラムオブジェクトを作成する
-	GLuint program(loadProgram("point.vert", "point.frag"));
+	// 指定されていれば複数のビューに一度に描く（記録は GL 3.2 の呼び出しだけなので一つのビューに描く）
+	if (views > 1 && trace) {
+		cerr << "Can't trace multi-view rendering, drawing a single view instead" << endl;
+		views = 1;
+	}
+	unique_ptr<MultiView> multiview(views > 1 ? new MultiView(views) : NULL);
+
+	// プログラムオブジェクトを作成する（複数のビューに描くときは三角形をビューに振り分ける）
+	GLuint program(multiview ? loadProgram("point.vert", "point.frag", "multiview.geom")
+		: loadProgram("point.vert", "point.frag"));
 
 	// uniform変数の場所を取得する
 	const GLint modelviewLoc(glGetUniformLocation(program, "modelview"));
 	const GLint projectionLoc(glGetUniformLocation(program, "projection"));
 	const GLint normalMatrixLoc(glGetUniformLocation(program, "normalMatrix"));
+	const GLint colorLoc(glGetUniformLocation(program, "color"));
+	const GLint texturedLoc(glGetUniformLocation(program, "textured"));
+	const GLint viewLoc(glGetUniformLocation(program, "view"));
+	const GLint layeredLoc(glGetUniformLocation(program, "layered"));
+
+	// 毎フレームの処理を分担するジョブシステム（図形の頂点を作るのにも使う）
+	JobSystem jobs;
+
+	// 指定されていれば図形を作って三角形ストリップで描く（なければ六面体を三角形で描く）
+	const unique_ptr<const Mesh> mesh(createMesh(meshName, &jobs));
+	const vector<GLuint> triangles(mesh ? mesh->getTriangles() : vector<GLuint>());
+	if (mesh) {
+		cerr << "Mesh: " << mesh->getVertexCount() << " vertices, " << mesh->getIndexCount()
+			<< " strip indices (" << triangles.size() << " as triangles)" << endl;
+	}
+
+	// カリングやピッキングに使う図形の三角形
+	const GLsizei vertexcount(mesh ? mesh->getVertexCount() : 36);
+	const Object::Vertex *const vertex(mesh ? mesh->getVertex() : solidCubeVertex);
+	const GLsizei indexcount(static_cast<GLsizei>(triangles.size()));
+	const GLuint *const index(mesh ? triangles.data() : NULL);
 
 	// 図形データを作成する
-	unique_ptr<const Shape> shape(new SolidShape(3, 36, solidCubeVertex));
+	Pool<SolidShape> shapes;
+	const unique_ptr<const Shape> strip(mesh ? new StripShapeIndex(3, vertexcount, vertex,
+		mesh->getIndexCount(), mesh->getIndex()) : NULL);
+	const Shape *const shape(strip ? strip.get() : shapes.get(shapes.create(3, 36, solidCubeVertex)));
+
+	// 指定されていれば圧縮テクスチャを読み込む
+	TextureManager textures;
+	const TextureManager::Handle texture(texturePath.empty()
+		? TextureManager::Handle() : textures.load(texturePath.c_str()));
+
+	// 指定されていれば地形を読み込む
+	unique_ptr<Terrain> terrain(terrainPath.empty() ? NULL : new Terrain(terrainPath.c_str()));
+	if (terrain && !terrain->isValid()) terrain.reset();
+
+	// 指定されていれば点群を読み込む
+	unique_ptr<PointCloud> cloud(pointsPath.empty() ? NULL : new PointCloud(pointsPath.c_str()));
+	if (cloud && !cloud->isValid()) cloud.reset();
+	const GLuint cloudProgram(cloud ? loadProgram("cloud.vert", "cloud.frag") : 0);
+	const GLint cloudModelviewLoc(cloudProgram ? glGetUniformLocation(cloudProgram, "modelview") : -1);
+	const GLint cloudProjectionLoc(cloudProgram ? glGetUniformLocation(cloudProgram, "projection") : -1);
+	const GLint cloudPointSizeLoc(cloudProgram ? glGetUniformLocation(cloudProgram, "pointSize") : -1);
+	if (cloud) glEnable(GL_PROGRAM_POINT_SIZE);
+
+	// 指定されていればデバッグ用の線分を重ねる（頂点の形式が同じなので点群のシェーダで描く）
+	unique_ptr<DebugLines> lines(debug ? new DebugLines : NULL);
+	const GLuint lineProgram(lines ? (cloudProgram ? cloudProgram : loadProgram("cloud.vert", "cloud.frag")) : 0);
+	const GLint lineModelviewLoc(lineProgram ? glGetUniformLocation(lineProgram, "modelview") : -1);
+	const GLint lineProjectionLoc(lineProgram ? glGetUniformLocation(lineProgram, "projection") : -1);
+
+	// 出力先が指定されていればフレームを記録する
+	unique_ptr<FrameCapture> capture;
+	if (args.size() > 0) {
+		string path(args[0]);
+		const int width(args.size() > 2 ? atoi(args[1].c_str()) : 1920);
+		const int height(args.size() > 2 ? atoi(args[2].c_str()) : 1080);
+		const FrameWriter::Format format(captureFormat(path));
+		if (format == FrameWriter::PNG) path.erase(path.size() - 4);
+		capture.reset(new FrameCapture(width, height, path, format));
+	}
 
-	// タイマーを0にセット
-	glfwSetTime(0.0);
+	// 指定されていれば描画解像度を動的に変える
+	unique_ptr<DynamicResolution> resolution(dynamic ? new DynamicResolution : NULL);
+
+	// 図形の配置（モデルビュー変換に続けて適用する）
+	const vector<Affine> placement(objects > 0 ? gridPlacement(objects)
+		: vector<Affine>({ Affine::identity(), Affine::translate(0.0f, 0.0f, 3.0f) }));
+
+	// 指定されていれば GPU で見える図形を選んでまとめて描く（記録は GL 3.2 の呼び出しだけなので図形ごとに描く）
+	unique_ptr<IndirectRenderer> indirect;
+	if (gpuDriven && trace) {
+		cerr << "Can't trace indirect rendering, drawing each shape instead" << endl;
+	}
+	else if (gpuDriven && multiview) {
+		cerr << "Indirect rendering draws a single view, drawing each shape instead" << endl;
+	}
+	else if (gpuDriven && !IndirectRenderer::isSupported()) {
+		cerr << "Indirect rendering needs OpenGL 4.3, drawing each shape instead" << endl;
+	}
+	else if (gpuDriven) {
+		indirect.reset(new IndirectRenderer(static_cast<GLsizei>(placement.size())));
+		if (indirect->isValid()) {
+			const int id(indirect->addMesh(vertexcount, vertex, indexcount, index));
+			for (const Affine &p : placement) indirect->add(id, p);
+		}
+		else indirect.reset();
+	}
+	const GLuint indirectProgram(indirect ? loadProgram("indirect.vert", "point.frag") : 0);
+	const GLint indirectProjectionLoc(indirectProgram ? glGetUniformLocation(indirectProgram, "projection") : -1);
+	const GLint indirectColorLoc(indirectProgram ? glGetUniformLocation(indirectProgram, "color") : -1);
+	const GLint indirectTexturedLoc(indirectProgram ? glGetUniformLocation(indirectProgram, "textured") : -1);
+
+	// 指定されていれば図形ごとにオクルージョンクエリを用意する（記録は GL 3.2 の描画の呼び出しだけなので使わない）
+	vector<unique_ptr<OcclusionQuery>> queries;
+	if (queried && trace) {
+		cerr << "Can't trace occlusion queries, drawing without them" << endl;
+	}
+	else if (queried && (indirect || multiview)) {
+		cerr << "Occlusion queries need a single view drawn per shape, drawing without them" << endl;
+	}
+	else if (queried) {
+		for (size_t i = 0; i < placement.size(); i++) queries.emplace_back(new OcclusionQuery);
+	}
 
-	// ウィンドウが開いている間繰り返す
-	while (window.shouldClose() == GL_FALSE) {
-		// ウィンドウを消去する
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// クエリの代わりに描く図形の境界ボックス（[-1, 1] の六面体を境界ボックスに合わせる）
+	const Shape *const proxy(queries.empty() ? NULL : shapes.get(shapes.create(3, 36, solidCubeVertex)));
+	const GLfloat *const bmin(shape->getBoundsMin()), *const bmax(shape->getBoundsMax());
+	const Affine bounds(Affine::translate(0.5f * (bmin[0] + bmax[0]), 0.5f * (bmin[1] + bmax[1]), 0.5f * (bmin[2] + bmax[2]))
+		* Affine::scale(0.5f * (bmax[0] - bmin[0]), 0.5f * (bmax[1] - bmin[1]), 0.5f * (bmax[2] - bmin[2])));
 
-		// シェーダプログラムの使用開始
-		glUseProgram(program);
+	// 最後に報告した GPU で隠れていた図形の数
+	int lastQueried(-1);
 
-		// 透視投影変換行列を求める
-		const GLfloat * const size(window.getSize());
-		const GLfloat fovy(window.getScale() * 0.01f);
-		const GLfloat aspect(size[0] / size[1]);
-		const Matrix projection(Matrix::perspective(fovy, aspect, 1.0f, 10.0f));
+	// 毎フレーム使い捨てるデータの置き場（図形の数だけの描画の情報が必ず収まるようにする）
+	FrameArena arena(max<size_t>(1 << 20, placement.size() * sizeof(DrawPacket) + alignof(DrawPacket)));
 
-		// モデル変換行列を求める
-		const GLfloat *const location(window.getLocation());
-		const Matrix r(Matrix::rotate(static_cast<GLfloat>(glfwGetTime()), 0.0f, 1.0f, 0.0f));
-		const Matrix model(Matrix::translate(location[0], location[1], 0.0f) * r);
+	// マウスカーソルの下にある図形を求める BVH（図形の配置ごとに登録する）
+	const Bvh bvh(vertexcount, vertex, indexcount, index, &jobs);
+	Picker picker;
+	for (size_t i = 0; i < placement.size(); i++) picker.add(&bvh);
 
-		// ビュー変換行列を求める
-		const Matrix view(Matrix::lookat(3.0f, 4.0f, 5.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
+	// 最後に報告したカーソルの下の図形
+	int lastPicked(-1);
 
-		// モデルビュー変換行列を求める
-		const Matrix modelview(view * model);
+	// 遮蔽カリングに使う CPU のデプスバッファ
+	OcclusionCuller culler;
 
-		// 法線ベクトルの変換行列の格納先
-		GLfloat normalMatrix[9];
+	// 最後に報告した隠れていた物体の数
+	int lastOccluded(-1);
 
-		// 法線ベクトルの変換行列を求める
-		modelview.getNormalMatrix(normalMatrix);
+	// 最後に報告したテクスチャの転送量
+	size_t lastUploaded(0);
 
-		// uniform変数に値を設定する
-		glUniformMatrix4fv(modelviewLoc, 1, GL_FALSE, modelview.data());
-		glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, projection.data());
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, normalMatrix);
+	// 描画したフレームの数
+	unsigned int frameCount(0);
 
-		// 図形を描画する
-		shape->draw();
+	// 図形の描画にかかった CPU の時間とそのフレーム数（--views のときに報告する）
+	double submitTime(0.0);
+	int submitFrames(0);
 
-		// 二つ目のモデルビュー変換行列を求める
-		const Matrix modelview1(modelview * Matrix::translate(0.0f, 0.0f, 3.0f));
+	// 記録の読み出しの発行にかかった CPU の時間とそのフレーム数
+	double captureTime(0.0);
+	int captureFrames(0);
 
-		// 二つ目の法線ベクトルの変換行列を求める
-		modelview1.getNormalMatrix(normalMatrix);
+	// タイマーを0にセット
+	glfwSetTime(0.0);
 
-		glUniformMatrix4fv(modelviewLoc, 1, GL_FALSE, modelview1.data());
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, normalMatrix);
+	// ウィンドウが開いている間描画を繰り返す
+	const auto render([&]() {
+		while (window.shouldClose() == GL_FALSE) {
+			// このフレームでのヒープの確保を数え始める
+			const size_t heap(HeapCounter::allocations());
+
+			// 記録するときは記録用のフレームバッファオブジェクトに描く
+			if (capture) capture->begin();
+
+			// 解像度を変えるときは縮小したフレームバッファオブジェクトに描く
+			if (resolution) resolution->begin();
+
+			// 記録するときはビューポートを書き出す
+			if (trace) trace->beginFrame();
+
+			// ウィンドウを消去する
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			// シェーダプログラムの使用開始
+			glUseProgram(program);
+
+			// 透視投影変換行列を求める
+			const GLfloat * const size(window.getSize());
+			const GLfloat fovy(window.getScale() * 0.01f);
+			const GLfloat windowAspect(capture
+				? static_cast<GLfloat>(capture->getWidth()) / capture->getHeight()
+				: size[0] / size[1]);
+			const GLfloat aspect(multiview ? multiview->getAspect(windowAspect) : windowAspect);
+			const Matrix projection(Matrix::perspective(fovy, aspect, 1.0f, 10.0f));
+
+			// モデル変換行列を求める
+			const GLfloat *const location(window.getLocation());
+			const Quaternion r(Quaternion::rotate(static_cast<GLfloat>(glfwGetTime()), 0.0f, 1.0f, 0.0f));
+			const Affine model(Affine::translate(location[0], location[1], 0.0f) * Affine(r));
+
+			// ビュー変換行列を求める
+			const Affine view(Matrix::lookat(3.0f, 4.0f, 5.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
+
+			// モデルビュー変換行列を求める
+			const Affine modelview(view * model);
+
+			// 複数のビューに描くときは視点を図形の周りに等間隔に回す（最初のビューはそのまま）
+			if (multiview) {
+				const Affine inverse(view.inverse());
+				for (int v = 0; v < multiview->getViewCount(); v++) {
+					const GLfloat angle(2.0f * PI * v / multiview->getViewCount());
+					const Affine orbit(Quaternion::rotate(angle, 0.0f, 1.0f, 0.0f));
+					multiview->setView(v, view * orbit * inverse, projection);
+				}
+				multiview->begin(viewLoc, projectionLoc, layeredLoc);
+			}
+
+			// ここから図形を描き終わるまでの CPU の時間を計る
+			const auto submitStart(chrono::steady_clock::now());
+
+			// 図形ごとの描画の情報はこのフレームだけ使う（GPU で描くときは作らない）
+			arena.reset();
+			const size_t count(placement.size());
+			DrawPacket *const packets(indirect ? NULL : arena.allocate<DrawPacket>(count));
+
+			if (indirect) {
+				// 見える図形のコマンドを GPU で作り，まとめて描く
+				indirect->cull(projection, modelview);
+				glUseProgram(indirectProgram);
+				glUniform1i(indirectColorLoc, 0);
+				glUniform1i(indirectTexturedLoc, textures.bind(texture, 0));
+				glUniformMatrix4fv(indirectProjectionLoc, 1, GL_FALSE, projection.data());
+				indirect->draw();
+				glUseProgram(program);
+			}
+			else {
+				// 図形ごとのモデルビュー変換行列と法線ベクトルの変換行列を並列に求める
+				jobs.parallel_for(count, 64, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++) {
+						DrawPacket &packet(packets[i]);
+						packet.modelview = modelview * placement[i];
+
+						// 回転と平行移動だけなので 3x3 部分をそのまま使う
+						packet.modelview.getNormalMatrix(packet.normalMatrix);
+						packet.visible = true;
+					}
+				});
+
+				// 一つ目の図形を遮蔽物として CPU のデプスバッファに描く（ほかのビューからは見えるので一つのときだけ）
+				if (!multiview) {
+					culler.clear();
+					culler.addOccluder(projection * packets[0].modelview.toMatrix(),
+						index != NULL ? indexcount : vertexcount, vertex, index);
+					culler.buildHierarchy();
+
+					// 残りの図形が一つ目に隠れていないかを並列に調べる
+					jobs.parallel_for(count - 1, 64, [&](size_t begin, size_t end) {
+						for (size_t i = begin + 1; i <= end; i++) {
+							packets[i].visible = culler.isVisible(projection * packets[i].modelview.toMatrix(),
+								shape->getBoundsMin(), shape->getBoundsMax());
+						}
+					});
+				}
+
+				// 転送済みのミップマップがあればテクスチャを使う
+				glUniform1i(colorLoc, 0);
+				glUniform1i(texturedLoc, textures.bind(texture, 0));
+
+				// uniform変数に値を設定して見える図形をビューの数だけインスタンス描画する
+				const GLsizei instances(multiview ? multiview->getViewCount() : 1);
+				glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, projection.data());
+				for (size_t i = 0; i < count; i++) {
+					const DrawPacket &packet(packets[i]);
+					if (!packet.visible || (!queries.empty() && i > 0)) continue;
+					glUniformMatrix4x3fv(modelviewLoc, 1, GL_FALSE, packet.modelview.data());
+					glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, packet.normalMatrix);
+					shape->draw(instances);
+				}
+
+				// クエリを使うときは一つ目の図形のデプスバッファに残りの図形の境界ボックスを色も深度も書かずに描き，
+				// 境界ボックスが一画素でも見えた図形だけを描く
+				if (!queries.empty()) {
+					int queryOccluded(0), queryTested(0);
+					glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+					glDepthMask(GL_FALSE);
+					glDisable(GL_CULL_FACE);
+					for (size_t i = 1; i < count; i++) {
+						if (!packets[i].visible) continue;
+
+						// 前のフレームの結果が出ていれば数える
+						GLuint samples;
+						if (queries[i]->getResult(samples)) {
+							++queryTested;
+							if (samples == 0) ++queryOccluded;
+						}
+
+						const Affine box(packets[i].modelview * bounds);
+						glUniformMatrix4x3fv(modelviewLoc, 1, GL_FALSE, box.data());
+						queries[i]->begin();
+						proxy->draw();
+						queries[i]->end();
+					}
+					glEnable(GL_CULL_FACE);
+					glDepthMask(GL_TRUE);
+					glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+					for (size_t i = 1; i < count; i++) {
+						const DrawPacket &packet(packets[i]);
+						if (!packet.visible) continue;
+						glUniformMatrix4x3fv(modelviewLoc, 1, GL_FALSE, packet.modelview.data());
+						glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, packet.normalMatrix);
+						queries[i]->beginConditional();
+						shape->draw(instances);
+						queries[i]->endConditional();
+					}
+
+					// GPU で隠れていた図形の数が変わったら報告する
+					if (queryOccluded != lastQueried) {
+						lastQueried = queryOccluded;
+						cerr << "Query occluded: " << queryOccluded << " / " << queryTested << endl;
+					}
+				}
+			}
+
+			// 図形の描画にかかった CPU の時間を 1秒分ほど溜めてビューあたりの時間を報告する
+			if (views > 0) {
+				submitTime += chrono::duration<double>(chrono::steady_clock::now() - submitStart).count();
+				if (++submitFrames == 60) {
+					const int n(multiview ? multiview->getViewCount() : 1);
+					const double perFrame(submitTime / submitFrames * 1e6);
+					cerr << "Submit: " << perFrame << " us per frame, " << perFrame / n
+						<< " us per view (" << n << " views)" << endl;
+					submitTime = 0.0;
+					submitFrames = 0;
+				}
+			}
+
+			// 地形を図形の下の 4 x 4 の範囲に収めて描く
+			if (terrain) {
+				const GLfloat w(terrain->getWidth()), d(terrain->getDepth());
+				const GLfloat s(4.0f / max(w, d));
+				const Affine terrainView(view * Affine::translate(0.0f, -1.5f, 0.0f)
+					* Affine::scale(s, s, s) * Affine::translate(-0.5f * w, 0.0f, -0.5f * d));
+
+				// 地形の座標系での視点の位置でレベルを選ぶ
+				const Affine inverse(terrainView.inverse());
+				terrain->update(inverse.data() + 9, fovy, 10.0f / s, static_cast<GLsizei>(size[1]));
+
+				GLfloat normalMatrix[9];
+				terrainView.getNormalMatrix(normalMatrix);
+				glUniformMatrix4x3fv(modelviewLoc, 1, GL_FALSE, terrainView.data());
+				glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, normalMatrix);
+				glUniform1i(texturedLoc, GL_FALSE);
+				terrain->draw(projection * terrainView.toMatrix());
+			}
+
+			// 点群を図形を中心とする一辺 6 の立方体に収めて描く
+			if (cloud) {
+				const GLfloat *const lo(cloud->getBoundsMin());
+				const GLfloat h(0.5f * cloud->getSize()), s(6.0f / cloud->getSize());
+				const Affine cloudView(view * Affine::scale(s, s, s)
+					* Affine::translate(-lo[0] - h, -lo[1] - h, -lo[2] - h));
+				const Affine inverse(cloudView.inverse());
+				cloud->update(projection * cloudView.toMatrix(), inverse.data() + 9, fovy,
+					static_cast<GLsizei>(size[1]));
+
+				glUseProgram(cloudProgram);
+				glUniformMatrix4x3fv(cloudModelviewLoc, 1, GL_FALSE, cloudView.data());
+				glUniformMatrix4fv(cloudProjectionLoc, 1, GL_FALSE, projection.data());
+				glUniform1f(cloudPointSizeLoc, 2.0f);
+				cloud->draw();
+				glUseProgram(program);
+			}
+
+			// カーソルの下にある図形が変わったら報告する（GPU で描くときは調べない）
+			int picked(-1);
+			if (packets) {
+				for (size_t i = 0; i < count; i++) picker.setTransform(static_cast<int>(i), packets[i].modelview);
+				Picker::Hit hit;
+				if (picker.pick(projection, window.getCursor(), hit)) picked = hit.instance;
+			}
+			if (picked != lastPicked) {
+				lastPicked = picked;
+				cerr << "Picked: " << picked << endl;
+			}
+
+			// 図形の境界ボックスを見えるものは緑，隠れたものは灰色，カーソルの下のものは常に手前に黄色で描く
+			if (lines && packets) {
+				for (size_t i = 0; i < count; i++) {
+					const Affine transform(model * placement[i]);
+					lines->setDepthTest(static_cast<int>(i) != picked);
+					if (static_cast<int>(i) == picked) lines->setColor(1.0f, 0.8f, 0.0f);
+					else if (packets[i].visible) lines->setColor(0.0f, 0.6f, 0.0f);
+					else lines->setColor(0.5f, 0.5f, 0.5f);
+					lines->box(shape->getBoundsMin(), shape->getBoundsMax(), transform);
+					lines->setDepthTest(true);
+					lines->axis(transform, 1.5f);
+				}
+
+				glUseProgram(lineProgram);
+				glUniformMatrix4x3fv(lineModelviewLoc, 1, GL_FALSE, view.data());
+				glUniformMatrix4fv(lineProjectionLoc, 1, GL_FALSE, projection.data());
+				lines->draw();
+				glUseProgram(program);
+			}
+
+			// 隠れていた物体の数が変わったら報告する
+			if (packets && !multiview && culler.getOccludedCount() != lastOccluded) {
+				lastOccluded = culler.getOccludedCount();
+				cerr << "Occluded: " << lastOccluded << " / " << culler.getTestedCount() << endl;
+			}
+
+			// テクスチャのミップマップを予算の範囲で転送する
+			textures.update();
+
+			// 転送したら常駐量と無圧縮で持った場合の量を報告する
+			if (textures.getUploadedBytes() != lastUploaded) {
+				lastUploaded = textures.getUploadedBytes();
+				cerr << "Texture: " << textures.getResidentBytes() / 1024 << " KB resident ("
+					<< textures.getUncompressedBytes() / 1024 << " KB uncompressed), "
+					<< lastUploaded / 1024 << " KB uploaded" << endl;
+			}
+
+			// 複数のビューに描き終えたらビューポートを戻す
+			if (multiview) multiview->end();
+
+			// 縮小して描いた画像を拡大する
+			if (resolution) resolution->end();
+
+			// 記録するときは読み出しを発行してウィンドウに転送する
+			if (capture) {
+				capture->end();
+
+				// 読み出しの発行にかかった CPU の時間を 1秒分ほど溜めて書き出しの状況と一緒に報告する
+				captureTime += capture->getCpuTime();
+				if (++captureFrames == 60) {
+					cerr << "Capture: " << captureTime / captureFrames * 1e6 << " us per frame, "
+						<< capture->getDroppedCount() << " dropped, " << capture->getQueueDepth() << " queued" << endl;
+					captureTime = 0.0;
+					captureFrames = 0;
+				}
+			}
+
+			// 記録が終わったら報告する
+			if (trace && trace->isRecording()) {
+				trace->endFrame();
+				if (!trace->isRecording()) {
+					cerr << "Trace: " << trace->getFrameCount() << " frames, " << trace->getByteCount() << " bytes" << endl;
+				}
+			}
+
+			// カラーバッファを入れ替えてイベントを取り出す
+			window.swapBuffers();
+
+			// 最初の数フレームを過ぎてもヒープを確保していたら報告する
+			const size_t allocated(HeapCounter::allocations() - heap);
+			if (++frameCount > 3 && allocated > 0) {
+				cerr << "Frame " << frameCount << ": " << allocated << " heap allocations" << endl;
+			}
+		}
+	});
+
+	if (threaded) {
+		// 描画スレッドにコンテキストを渡し，メインスレッドはイベントの取り出しだけを行う
+		window.detachContext();
+		thread renderer([&]() {
+			window.makeContextCurrent();
+			render();
+			glfwMakeContextCurrent(NULL);
+		});
+		while (window.shouldClose() == GL_FALSE) {
+			window.waitEvents();
+		}
+		renderer.join();
 
-		shape->draw();
+		// 後始末のためにコンテキストを戻す
+		window.makeContextCurrent();
 
-		// カラーバッファを入れ替えてイベントを取り出す
-		window.swapBuffers();
+		// 入力イベントの待ち行列の状態を報告する
+		cerr << "Input queue: max depth " << window.getMaxQueueDepth()
+			<< ", dropped " << window.getDroppedCount() << endl;
+	}
+	else {
+		render();
 	}
 
 	return 0;
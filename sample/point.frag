@@ -1,7 +1,13 @@
 #version 150 core
-in vec3 Idiff;
-in vec3 Ispec;
+in Vertex {
+	vec3 Idiff;
+	vec3 Ispec;
+	vec2 Tex;
+};
+uniform sampler2D color;
+uniform bool textured;
 out vec4 fragment;
 void main() {
-	fragment = vec4(Idiff + Ispec, 1.0);
+	vec3 Kt = textured ? texture(color, Tex).rgb : vec3(1.0);
+	fragment = vec4(Idiff * Kt + Ispec, 1.0);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #version 150 core
-uniform mat4 modelview;
-uniform mat4 projection;
+uniform mat4x3 modelview;
+uniform mat4x3 view[4] = mat4x3[4](mat4x3(1.0), mat4x3(1.0), mat4x3(1.0), mat4x3(1.0));
+uniform mat4 projection[4];
 uniform mat3 normalMatrix;
 const vec4 Lpos = vec4(0.0, 0.0, 5.0, 1.0);
 const vec3 Lamb = vec3(0.2);
@@ -12,16 +13,23 @@ const vec3 Kspec = vec3(0.3, 0.3, 0.3);
 const float Kshi = 30.0;
 in vec4 position;
 in vec3 normal;
-out vec3 Idiff;
-out vec3 Ispec;
+in vec2 texcoord;
+out Vertex {
+	vec3 Idiff;
+	vec3 Ispec;
+	vec2 Tex;
+};
+flat out int viewIndex;
 void main() {
-	vec4 P = modelview * position;
-	vec3 N = normalize(normalMatrix * normal);
+	vec4 P = vec4(view[gl_InstanceID] * vec4(modelview * position, 1.0), 1.0);
+	vec3 N = normalize(mat3(view[gl_InstanceID]) * normalMatrix * normal);
 	vec3 L = normalize((Lpos * P.w - P * Lpos.w).xyz);
 	vec3 Iamb = Kamb * Lamb;
 	Idiff = max(dot(N, L), 0.0) * Kdiff * Ldiff + Iamb;
 	vec3 V = -normalize(P.xyz);
 	vec3 H = normalize(L + V);
 	Ispec = pow(max(dot(N, H), 0.0), Kshi) * Kspec * Lspec;
-	gl_Position = projection * P;
+	Tex = texcoord;
+	viewIndex = gl_InstanceID;
+	gl_Position = projection[gl_InstanceID] * P;
 }
\ No newline at end of file
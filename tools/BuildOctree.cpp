@@ -0,0 +1,18 @@
+#include <cstdio>
+#include <cstdlib>
+#include "PointCloud.h"
+
+// 点群から描画用の八分木のファイルを作る
+//  argv[1]: 入力（PointCloud::Point を並べたファイル）
+//  argv[2]: 出力する八分木のファイル
+//  argv[3]: ノードあたりの点の数の上限（省略時は 16384）
+//  argv[4]: ノードの中で点を間引く格子の一辺の数（省略時は 64）
+int main(int argc, char *argv[]) {
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s input output [blockPoints [grid]]\n", argv[0]);
+		return 1;
+	}
+	const uint32_t blockPoints(argc > 3 ? atoi(argv[3]) : 16384);
+	const uint32_t grid(argc > 4 ? atoi(argv[4]) : 64);
+	return PointCloud::build(argv[1], argv[2], blockPoints, grid) ? 0 : 1;
+}
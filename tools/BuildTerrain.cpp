@@ -0,0 +1,34 @@
+#include <cstdio>
+#include <cstdlib>
+#include "Terrain.h"
+
+// 高さの標本から地形のタイルファイルを作る
+//  argv[1]: 入力（uint16_t の高さを横 width 個ずつ depth 行並べたリトルエンディアンの RAW ファイル）
+//  argv[2], argv[3]: 横と奥行きの標本の数
+//  argv[4]: 出力するタイルファイル
+//  argv[5]: チャンクの格子の数（省略時は 64）
+//  argv[6]: 標本の間隔（省略時は 1）
+//  argv[7]: 高さの単位（省略時は 1/256）
+int main(int argc, char *argv[]) {
+	if (argc < 5) {
+		fprintf(stderr, "Usage: %s input width depth output [chunk [spacing [scale]]]\n", argv[0]);
+		return 1;
+	}
+	const int width(atoi(argv[2])), depth(atoi(argv[3]));
+	const int chunk(argc > 5 ? atoi(argv[5]) : 64);
+	const GLfloat spacing(argc > 6 ? static_cast<GLfloat>(atof(argv[6])) : 1.0f);
+	const GLfloat scale(argc > 7 ? static_cast<GLfloat>(atof(argv[7])) : 1.0f / 256.0f);
+
+	const MappedFile input(argv[1]);
+	if (input.data() == NULL) {
+		fprintf(stderr, "Can't open heightmap: %s\n", argv[1]);
+		return 1;
+	}
+	if (width <= 0 || depth <= 0 || input.size() < size_t(width) * depth * sizeof(uint16_t)) {
+		fprintf(stderr, "Heightmap is smaller than %d x %d samples: %s\n", width, depth, argv[1]);
+		return 1;
+	}
+
+	const uint16_t *const height(reinterpret_cast<const uint16_t *>(input.data()));
+	return Terrain::build(argv[4], height, width, depth, chunk, spacing, scale) ? 0 : 1;
+}
@@ -0,0 +1,547 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include "MappedFile.h"
+#include "Window.h"
+#include "Program.h"
+#include "GlTrace.h"
+
+using namespace std;
+
+// 呼び出しの名前
+static const char *const opName[] = {
+	"", "frame_begin", "frame_end", "glGenBuffers", "glDeleteBuffers", "glBindBuffer", "glBufferData",
+	"glBufferSubData", "glGenVertexArrays", "glDeleteVertexArrays", "glBindVertexArray",
+	"glVertexAttribPointer", "glEnableVertexAttribArray", "glDisableVertexAttribArray", "program",
+	"glDeleteProgram", "glUseProgram", "glUniform", "glDrawArrays", "glDrawElements",
+	"glDrawArraysInstanced", "glDrawElementsInstanced", "glPrimitiveRestartIndex"
+};
+
+// 記録の内容を先頭から読み出す
+class Reader {
+public:
+	// コンストラクタ
+	//  data: 記録の内容, size: 長さ
+	Reader(const unsigned char *data, size_t size) : p(data), end(data + size), ok(true) {}
+
+	// 値を一つ読む
+	template <typename T>
+	T get() {
+		T value = T();
+		const unsigned char *const q(bytes(sizeof value));
+		if (q != NULL) memcpy(&value, q, sizeof value);
+		return value;
+	}
+
+	// 長さの付いた文字列を読む
+	string text() {
+		const uint32_t n(get<uint32_t>());
+		const unsigned char *const q(bytes(n));
+		return q != NULL ? string(reinterpret_cast<const char *>(q), n) : string();
+	}
+
+	// size バイトを読んで先頭を返す（足りなければ NULL）
+	const unsigned char *bytes(size_t size) {
+		if (!ok || size_t(end - p) < size) {
+			ok = false;
+			return NULL;
+		}
+		const unsigned char *const q(p);
+		p += size;
+		return q;
+	}
+
+	// 読み出しに失敗していないか
+	bool isValid() const { return ok; }
+
+private:
+	const unsigned char *p, *const end;
+	bool ok;
+};
+
+// 呼び出しの種類ごとの集計
+struct Stat {
+	uint64_t calls;
+	double total, max;
+};
+
+// 描画一回分の計測
+struct Draw {
+	int frame;
+	int op;
+	GLenum mode;
+	GLsizei count;
+	double cpu;
+	GLuint query;
+};
+
+// 記録した呼び出しを再生する
+class Replay {
+public:
+	// コンストラクタ
+	//  timer: 描画ごとに GPU の処理時間を計るか
+	Replay(bool timer) : timer(timer), program(0), frame(0), frameCalls(0), frameCpu(0.0) {
+		memset(stats, 0, sizeof stats);
+	}
+
+	// 記録を一つ実行して処理時間を集計する
+	//  op: 記録の種類, in: 記録の内容
+	//  内容が壊れていたら false を返す
+	bool execute(int op, Reader &in) {
+		const auto t0(chrono::steady_clock::now());
+		chrono::steady_clock::time_point t1;
+		bool drawn(false);
+		switch (op) {
+		case GlTrace::FRAME_BEGIN: {
+			const GLint *const viewport(reinterpret_cast<const GLint *>(in.bytes(16)));
+			const GLfloat *const clear(reinterpret_cast<const GLfloat *>(in.bytes(16)));
+			const uint8_t depth(in.get<uint8_t>()), cull(in.get<uint8_t>());
+			if (!in.isValid()) return false;
+			GLint v[4];
+			GLfloat c[4];
+			memcpy(v, viewport, sizeof v);
+			memcpy(c, clear, sizeof c);
+			glViewport(v[0], v[1], v[2], v[3]);
+			glClearColor(c[0], c[1], c[2], c[3]);
+			if (depth) glEnable(GL_DEPTH_TEST); else glDisable(GL_DEPTH_TEST);
+			if (cull) glEnable(GL_CULL_FACE); else glDisable(GL_CULL_FACE);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			frameStart = t0;
+			frameCalls = 0;
+			frameCpu = 0.0;
+			break;
+		}
+
+		case GlTrace::FRAME_END:
+			endFrame();
+			return true;
+
+		case GlTrace::GEN_BUFFER: {
+			GLuint n;
+			glGenBuffers(1, &n);
+			buffers[in.get<GLuint>()] = n;
+			break;
+		}
+
+		case GlTrace::DELETE_BUFFER: {
+			const GLuint name(in.get<GLuint>());
+			const GLuint n(lookup(buffers, name));
+			glDeleteBuffers(1, &n);
+			buffers.erase(name);
+			break;
+		}
+
+		case GlTrace::BIND_BUFFER: {
+			const GLenum target(in.get<GLenum>());
+			glBindBuffer(target, lookup(buffers, in.get<GLuint>()));
+			break;
+		}
+
+		case GlTrace::BUFFER_DATA: {
+			const GLenum target(in.get<GLenum>()), usage(in.get<GLenum>());
+			const uint64_t size(in.get<uint64_t>());
+			const uint8_t has(in.get<uint8_t>());
+			const unsigned char *const data(has ? in.bytes(size) : NULL);
+			if (!in.isValid()) return false;
+			glBufferData(target, size, data, usage);
+			break;
+		}
+
+		case GlTrace::BUFFER_SUB_DATA: {
+			const GLenum target(in.get<GLenum>());
+			const uint64_t offset(in.get<uint64_t>()), size(in.get<uint64_t>());
+			const unsigned char *const data(in.bytes(size));
+			if (!in.isValid()) return false;
+			glBufferSubData(target, offset, size, data);
+			break;
+		}
+
+		case GlTrace::GEN_VERTEX_ARRAY: {
+			GLuint n;
+			glGenVertexArrays(1, &n);
+			arrays[in.get<GLuint>()] = n;
+			break;
+		}
+
+		case GlTrace::DELETE_VERTEX_ARRAY: {
+			const GLuint name(in.get<GLuint>());
+			const GLuint n(lookup(arrays, name));
+			glDeleteVertexArrays(1, &n);
+			arrays.erase(name);
+			break;
+		}
+
+		case GlTrace::BIND_VERTEX_ARRAY:
+			glBindVertexArray(lookup(arrays, in.get<GLuint>()));
+			break;
+
+		case GlTrace::VERTEX_ATTRIB_POINTER: {
+			const GLuint index(in.get<GLuint>());
+			const GLint size(in.get<GLint>());
+			const GLenum type(in.get<GLenum>());
+			const uint8_t normalized(in.get<uint8_t>());
+			const GLsizei stride(in.get<GLsizei>());
+			const uint64_t offset(in.get<uint64_t>());
+			glVertexAttribPointer(index, size, type, normalized, stride, reinterpret_cast<const void *>(offset));
+			break;
+		}
+
+		case GlTrace::ENABLE_VERTEX_ATTRIB:
+			glEnableVertexAttribArray(in.get<GLuint>());
+			break;
+
+		case GlTrace::DISABLE_VERTEX_ATTRIB:
+			glDisableVertexAttribArray(in.get<GLuint>());
+			break;
+
+		case GlTrace::PROGRAM:
+			if (!link(in)) return false;
+			break;
+
+		case GlTrace::DELETE_PROGRAM: {
+			const GLuint name(in.get<GLuint>());
+			glDeleteProgram(lookup(programs, name));
+			programs.erase(name);
+			locations.erase(name);
+			break;
+		}
+
+		case GlTrace::USE_PROGRAM:
+			program = in.get<GLuint>();
+			glUseProgram(lookup(programs, program));
+			break;
+
+		case GlTrace::UNIFORM: {
+			const uint32_t kind(in.get<uint32_t>());
+			const GLint location(in.get<GLint>());
+			const GLsizei count(in.get<GLsizei>());
+			const GLboolean transpose(in.get<uint8_t>());
+			const unsigned char *const data(in.bytes(size_t(count) * GlTrace::components(kind) * 4));
+			if (!in.isValid() || GlTrace::components(kind) == 0) return false;
+
+			// 記録したときの場所を再生しているプログラムの場所に置き換える
+			const unordered_map<GLint, GLint> &map(locations[program]);
+			const auto l(map.find(location));
+			if (l == map.end()) break;
+			uniform(kind, l->second, count, transpose, data);
+			break;
+		}
+
+		case GlTrace::PRIMITIVE_RESTART: {
+			const uint8_t enable(in.get<uint8_t>());
+			const GLuint index(in.get<GLuint>());
+			if (!in.isValid()) return false;
+			if (enable) {
+				glEnable(GL_PRIMITIVE_RESTART);
+				glPrimitiveRestartIndex(index);
+			}
+			else glDisable(GL_PRIMITIVE_RESTART);
+			break;
+		}
+
+		case GlTrace::DRAW_ARRAYS:
+		case GlTrace::DRAW_ELEMENTS:
+		case GlTrace::DRAW_ARRAYS_INSTANCED:
+		case GlTrace::DRAW_ELEMENTS_INSTANCED: {
+			Draw d = { frame, op, in.get<GLenum>(), in.get<GLsizei>(), 0.0, 0 };
+			const bool arrays(op == GlTrace::DRAW_ARRAYS || op == GlTrace::DRAW_ARRAYS_INSTANCED);
+			GLint first(0), basevertex(0);
+			GLenum type(0);
+			uint64_t offset(0);
+			if (arrays) {
+				first = d.count;
+				d.count = in.get<GLsizei>();
+			}
+			else {
+				type = in.get<GLenum>();
+				offset = in.get<uint64_t>();
+				basevertex = in.get<GLint>();
+			}
+			const bool instanced(op == GlTrace::DRAW_ARRAYS_INSTANCED || op == GlTrace::DRAW_ELEMENTS_INSTANCED);
+			const GLsizei instances(instanced ? in.get<GLsizei>() : 1);
+			if (!in.isValid()) return false;
+
+			// GPU の処理時間は描画ごとにタイマークエリで計る
+			if (timer) {
+				if (queries.empty()) {
+					queries.resize(256);
+					glGenQueries(static_cast<GLsizei>(queries.size()), queries.data());
+				}
+				d.query = queries.back();
+				queries.pop_back();
+				glBeginQuery(GL_TIME_ELAPSED, d.query);
+			}
+			const auto s(chrono::steady_clock::now());
+			const void *const indices(reinterpret_cast<const void *>(offset));
+			if (arrays && instanced) glDrawArraysInstanced(d.mode, first, d.count, instances);
+			else if (arrays) glDrawArrays(d.mode, first, d.count);
+			else if (instanced) glDrawElementsInstanced(d.mode, d.count, type, indices, instances);
+			else if (basevertex != 0) glDrawElementsBaseVertex(d.mode, d.count, type, indices, basevertex);
+			else glDrawElements(d.mode, d.count, type, indices);
+			t1 = chrono::steady_clock::now();
+			d.cpu = chrono::duration<double, micro>(t1 - s).count();
+			if (timer) glEndQuery(GL_TIME_ELAPSED);
+			draws.push_back(d);
+			drawn = true;
+			break;
+		}
+
+		default:
+			return false;
+		}
+		if (!in.isValid()) return false;
+
+		// 描画はタイマークエリの終了を含めない
+		if (!drawn) t1 = chrono::steady_clock::now();
+		const double t(chrono::duration<double, micro>(t1 - t0).count());
+		Stat &s(stats[op]);
+		++s.calls;
+		s.total += t;
+		if (t > s.max) s.max = t;
+		++frameCalls;
+		frameCpu += t;
+		return true;
+	}
+
+	// 集計を CSV で出力する
+	//  perDraw: 描画ごとの計測も出力する
+	void report(bool perDraw) const {
+		printf("frame,calls,draws,cpu_ms,gpu_ms,wall_ms\n");
+		for (const string &line : frames) printf("%s\n", line.c_str());
+
+		printf("\ncall,count,total_ms,mean_us,max_us\n");
+		for (int op = 1; op < GlTrace::OP_COUNT; op++) {
+			const Stat &s(stats[op]);
+			if (s.calls == 0) continue;
+			printf("%s,%llu,%.3f,%.3f,%.3f\n", opName[op], static_cast<unsigned long long>(s.calls),
+				s.total * 1e-3, s.total / s.calls, s.max);
+		}
+
+		if (!perDraw) return;
+		printf("\nframe,draw,call,mode,count,cpu_us,gpu_us\n");
+		for (const string &line : drawLines) printf("%s\n", line.c_str());
+	}
+
+	// 作ったオブジェクトを削除する
+	void clear() {
+		for (const auto &b : buffers) glDeleteBuffers(1, &b.second);
+		for (const auto &a : arrays) glDeleteVertexArrays(1, &a.second);
+		for (const auto &p : programs) glDeleteProgram(p.second);
+		buffers.clear();
+		arrays.clear();
+		programs.clear();
+		locations.clear();
+		program = 0;
+	}
+
+private:
+	// 描画ごとに GPU の処理時間を計るか
+	const bool timer;
+
+	// 記録したときの名前から再生しているオブジェクトの名前への対応
+	unordered_map<GLuint, GLuint> buffers, arrays, programs;
+
+	// プログラムごとの uniform 変数の場所の対応
+	unordered_map<GLuint, unordered_map<GLint, GLint>> locations;
+
+	// 使用中のプログラムの記録したときの名前
+	GLuint program;
+
+	// 呼び出しの種類ごとの集計
+	Stat stats[GlTrace::OP_COUNT];
+
+	// フレームの番号と開始時刻，呼び出しの数と CPU の処理時間
+	int frame;
+	chrono::steady_clock::time_point frameStart;
+	uint64_t frameCalls;
+	double frameCpu;
+
+	// このフレームの描画と使っていないタイマークエリ
+	vector<Draw> draws;
+	vector<GLuint> queries;
+
+	// 出力するフレームごとと描画ごとの行
+	vector<string> frames, drawLines;
+
+	// 名前を置き換える（0 と知らない名前は 0）
+	static GLuint lookup(const unordered_map<GLuint, GLuint> &map, GLuint name) {
+		const auto i(map.find(name));
+		return i != map.end() ? i->second : 0;
+	}
+
+	// プログラムオブジェクトを作る
+	bool link(Reader &in) {
+		const GLuint name(in.get<GLuint>());
+		const GLuint p(glCreateProgram());
+
+		// シェーダ
+		const uint32_t shaders(in.get<uint32_t>());
+		for (uint32_t i = 0; i < shaders && in.isValid(); i++) {
+			const GLenum type(in.get<GLenum>());
+			const string source(in.text());
+			const GLchar *const src(source.c_str());
+			const GLuint s(glCreateShader(type));
+			glShaderSource(s, 1, &src, NULL);
+			glCompileShader(s);
+			if (printShaderInfoLog(s, "shader")) glAttachShader(p, s);
+			glDeleteShader(s);
+		}
+
+		// attribute 変数と出力変数の場所
+		const uint32_t attribs(in.get<uint32_t>());
+		for (uint32_t i = 0; i < attribs && in.isValid(); i++) {
+			const GLint location(in.get<GLint>());
+			glBindAttribLocation(p, location, in.text().c_str());
+		}
+		const uint32_t outputs(in.get<uint32_t>());
+		for (uint32_t i = 0; i < outputs && in.isValid(); i++) {
+			const GLint color(in.get<GLint>());
+			glBindFragDataLocation(p, color, in.text().c_str());
+		}
+		glLinkProgram(p);
+		printProgramInfoLog(p);
+
+		// uniform 変数の場所
+		unordered_map<GLint, GLint> &map(locations[name]);
+		map.clear();
+		const uint32_t uniforms(in.get<uint32_t>());
+		for (uint32_t i = 0; i < uniforms && in.isValid(); i++) {
+			const GLint location(in.get<GLint>());
+			map[location] = glGetUniformLocation(p, in.text().c_str());
+		}
+
+		const GLuint old(lookup(programs, name));
+		if (old != 0) glDeleteProgram(old);
+		programs[name] = p;
+		return in.isValid();
+	}
+
+	// uniform 変数に値を設定する
+	static void uniform(uint32_t kind, GLint location, GLsizei count, GLboolean transpose, const unsigned char *data) {
+		// 記録の中の値は境界が揃っていないことがあるので写してから渡す
+		vector<GLfloat> value(size_t(count) * GlTrace::components(kind));
+		memcpy(value.data(), data, value.size() * 4);
+		const GLfloat *const f(value.data());
+		const GLint *const i(reinterpret_cast<const GLint *>(f));
+		switch (kind) {
+		case GlTrace::UNIFORM_1IV: glUniform1iv(location, count, i); break;
+		case GlTrace::UNIFORM_1FV: glUniform1fv(location, count, f); break;
+		case GlTrace::UNIFORM_2FV: glUniform2fv(location, count, f); break;
+		case GlTrace::UNIFORM_3FV: glUniform3fv(location, count, f); break;
+		case GlTrace::UNIFORM_4FV: glUniform4fv(location, count, f); break;
+		case GlTrace::UNIFORM_MATRIX_3FV: glUniformMatrix3fv(location, count, transpose, f); break;
+		case GlTrace::UNIFORM_MATRIX_4FV: glUniformMatrix4fv(location, count, transpose, f); break;
+		case GlTrace::UNIFORM_MATRIX_4X3FV: glUniformMatrix4x3fv(location, count, transpose, f); break;
+		}
+	}
+
+	// フレームの終わりに GPU の完了を待って集計する
+	void endFrame() {
+		glFinish();
+		const double wall(chrono::duration<double, milli>(chrono::steady_clock::now() - frameStart).count());
+		double gpu(0.0);
+		char line[128];
+		for (size_t i = 0; i < draws.size(); i++) {
+			const Draw &d(draws[i]);
+			double g(-1.0);
+			if (d.query != 0) {
+				GLuint64 ns;
+				glGetQueryObjectui64v(d.query, GL_QUERY_RESULT, &ns);
+				g = ns * 1e-3;
+				gpu += g;
+				queries.push_back(d.query);
+			}
+			snprintf(line, sizeof line, "%d,%zu,%s,0x%04x,%d,%.3f,%.3f",
+				d.frame, i, opName[d.op], d.mode, d.count, d.cpu, g);
+			drawLines.push_back(line);
+		}
+		snprintf(line, sizeof line, "%d,%llu,%zu,%.3f,%.3f,%.3f", frame, static_cast<unsigned long long>(frameCalls),
+			draws.size(), frameCpu * 1e-3, timer ? gpu * 1e-3 : -1.0, wall);
+		frames.push_back(line);
+		draws.clear();
+		++frame;
+	}
+};
+
+// 記録した OpenGL の呼び出しを見えないウィンドウで再生して処理時間を計る
+//  argv[1]: 記録したファイル（sample の --trace で作る）
+//  --draws: 描画ごとの処理時間も出力する
+//  --repeat 回数: 記録を繰り返し再生する
+int main(int argc, char *argv[]) {
+	const char *name(NULL);
+	bool perDraw(false);
+	int repeat(1);
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--draws") == 0) perDraw = true;
+		else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) repeat = atoi(argv[++i]);
+		else name = argv[i];
+	}
+	if (name == NULL) {
+		fprintf(stderr, "Usage: %s trace [--draws] [--repeat n]\n", argv[0]);
+		return 1;
+	}
+
+	const MappedFile file(name);
+	if (file.data() == NULL || file.size() < 4 || memcmp(file.data(), "GLT1", 4) != 0) {
+		fprintf(stderr, "Can't read trace: %s\n", name);
+		return 1;
+	}
+
+	// 最初のフレームのビューポートの大きさでウィンドウを開く
+	int width(640), height(480);
+	Reader scan(file.data() + 4, file.size() - 4);
+	while (scan.isValid()) {
+		const uint8_t op(scan.get<uint8_t>());
+		const uint32_t size(scan.get<uint32_t>());
+		const unsigned char *const body(scan.bytes(size));
+		if (body != NULL && op == GlTrace::FRAME_BEGIN && size >= 16) {
+			GLint viewport[4];
+			memcpy(viewport, body, sizeof viewport);
+			width = viewport[0] + viewport[2];
+			height = viewport[1] + viewport[3];
+			break;
+		}
+	}
+
+	if (glfwInit() == GL_FALSE) {
+		fprintf(stderr, "Can't initialize GLFW\n");
+		return 1;
+	}
+	atexit(glfwTerminate);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	Window window(width, height, "replay");
+	glfwSwapInterval(0);
+	fprintf(stderr, "GL_RENDERER: %s\n", glGetString(GL_RENDERER));
+
+	const bool timer(GLEW_VERSION_3_3 || GLEW_ARB_timer_query);
+	if (!timer) fprintf(stderr, "Timer queries are not supported, GPU times are not measured\n");
+	Replay replay(timer);
+	for (int r = 0; r < repeat; r++) {
+		Reader in(file.data() + 4, file.size() - 4);
+		for (;;) {
+			const uint8_t op(in.get<uint8_t>());
+			const uint32_t size(in.get<uint32_t>());
+			if (!in.isValid()) break;
+			const unsigned char *const body(in.bytes(size));
+			Reader record(body, size);
+			if (body == NULL || !replay.execute(op, record)) {
+				fprintf(stderr, "Broken trace record: %d\n", op);
+				return 1;
+			}
+		}
+		replay.clear();
+	}
+	replay.report(perDraw);
+
+	return 0;
+}